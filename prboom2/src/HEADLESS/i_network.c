@@ -0,0 +1,79 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Network interface of the headless build, which plays no netgames.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+
+#ifdef HAVE_NET
+
+#include "SDL.h"
+
+#include "protocol.h"
+#include "i_network.h"
+#include "i_system.h"
+#include "lprintf.h"
+
+UDP_SOCKET udp_socket;
+
+void I_InitNetwork(void)
+{
+  I_Error("I_InitNetwork: no network games in the headless build");
+}
+
+UDP_SOCKET I_Socket(Uint16 port)
+{
+  return NULL;
+}
+
+int I_ConnectToServer(const char *serv)
+{
+  return -1;
+}
+
+size_t I_GetPacket(packet_header_t* buffer, size_t buflen)
+{
+  return 0;
+}
+
+void I_SendPacket(packet_header_t* packet, size_t len)
+{
+}
+
+void I_WaitForPacket(int ms)
+{
+}
+
+#endif /* HAVE_NET */
@@ -0,0 +1,177 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Sound and music interface of the headless build: nothing is
+ *      played, every sound is over as soon as it starts.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+
+#include "doomtype.h"
+#include "i_sound.h"
+#include "w_wad.h"
+#include "lprintf.h"
+
+// Config variables of SDL/i_sound.c, so the config file reads and
+// writes the same in both builds
+int snd_pcspeaker;
+int lowpass_filter;
+int snd_card = 1;
+int mus_card = 1;
+int snd_samplerate = 11025;
+int snd_samplecount = 512;
+int use_experimental_music = -1;
+const char *snd_soundfont;
+const char *snd_mididev;
+const char *snd_midiplayer;
+const char *midiplayers[midi_player_last + 1] = {
+  "sdl", "fluidsynth", "opl2", "portmidi", "alsa", NULL};
+int mus_fluidsynth_chorus;
+int mus_fluidsynth_reverb;
+int mus_fluidsynth_gain;
+int mus_opl_gain;
+int mus_opl_prerender;
+const char *mus_portmidi_reset_type;
+int mus_portmidi_reset_delay;
+int mus_portmidi_filter_sysex;
+int mus_portmidi_reverb_level;
+int mus_portmidi_chorus_level;
+
+void I_InitSound(void)
+{
+}
+
+void I_ShutdownSound(void)
+{
+}
+
+void I_SetChannels(void)
+{
+}
+
+int I_GetSfxLumpNum(sfxinfo_t *sfx)
+{
+  char namebuf[9];
+  const char *prefix;
+
+  // Different prefix for PC speaker sound effects.
+  prefix = (snd_pcspeaker ? "dp" : "ds");
+
+  sprintf(namebuf, "%s%s", prefix, sfx->name);
+  return W_CheckNumForName(namebuf); //e6y: make missing sounds non-fatal
+}
+
+int I_StartSound(int id, int channel, int vol, int sep, int pitch, int priority)
+{
+  return -1;
+}
+
+void I_StopSound(int handle)
+{
+}
+
+dboolean I_SoundIsPlaying(int handle)
+{
+  return false;
+}
+
+dboolean I_AnySoundStillPlaying(void)
+{
+  return false;
+}
+
+void I_UpdateSoundParams(int handle, int vol, int sep, int pitch)
+{
+}
+
+void I_BenchmarkSound(void)
+{
+  lprintf(LO_WARN, "I_BenchmarkSound: no sound in the headless build\n");
+}
+
+void I_SetSoundCap(void)
+{
+}
+
+unsigned char *I_GrabSound(int len)
+{
+  return NULL;
+}
+
+void I_InitMusic(void)
+{
+}
+
+void I_ShutdownMusic(void)
+{
+}
+
+void I_SetMusicVolume(int volume)
+{
+}
+
+void I_PauseSong(int handle)
+{
+}
+
+void I_ResumeSong(int handle)
+{
+}
+
+int I_RegisterSong(const void *data, size_t len)
+{
+  return 0;
+}
+
+int I_RegisterMusic(const char *filename, musicinfo_t *music)
+{
+  return 1;
+}
+
+void I_PlaySong(int handle, int looping)
+{
+}
+
+void I_StopSong(int handle)
+{
+}
+
+void I_UnRegisterSong(int handle)
+{
+}
+
+void M_ChangeMIDIPlayer(void)
+{
+}
@@ -0,0 +1,192 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Video, screenshot and joystick interface of the headless build:
+ *      there is no window, so nothing is ever shown or read.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "SDL.h"
+
+#include "doomstat.h"
+#include "doomdef.h"
+#include "doomtype.h"
+#include "v_video.h"
+#include "i_video.h"
+#include "i_joy.h"
+#include "f_wipe.h"
+#include "r_draw.h"
+#include "r_plane.h"
+#include "r_things.h"
+#include "i_system.h"
+#include "lprintf.h"
+
+// Config variables of SDL/i_video.c and SDL/i_joy.c, so the config file
+// reads and writes the same in both builds
+int render_vsync;
+int render_screen_multiply;
+int integer_scaling;
+int use_fullscreen;
+int desired_fullscreen;
+int exclusive_fullscreen;
+int gl_colorbuffer_bits = 16;
+int gl_depthbuffer_bits = 16;
+int process_affinity_mask;
+int process_priority;
+int vanilla_keymap;
+const char *sdl_video_window_pos;
+const char *screen_resolutions_list[] = { "320x200", NULL };
+const char *screen_resolution = "320x200";
+dboolean window_focused;
+SDL_Surface *screen;
+int renderW = 320;
+int renderH = 200;
+
+int usejoystick;
+int joyleft;
+int joyright;
+int joyup;
+int joydown;
+
+void I_PreInitGraphics(void)
+{
+  // no SDL main shim is linked into this build
+#ifdef SDL_MAIN_HANDLED
+  SDL_SetMainReady();
+#endif
+
+  // timers only
+  if (SDL_Init(0) < 0)
+    I_Error("Could not initialize SDL [%s]", SDL_GetError());
+}
+
+// The renderer is never run, but its buffers are sized at startup
+void I_InitScreenResolution(void)
+{
+  int i;
+
+  V_InitMode(VID_MODE8);
+  SCREENWIDTH = 320;
+  SCREENHEIGHT = 200;
+  SCREENPITCH = SCREENWIDTH;
+
+  // set first three to standard values
+  for (i=0; i<3; i++) {
+    screens[i].width = SCREENWIDTH;
+    screens[i].height = SCREENHEIGHT;
+    screens[i].byte_pitch = SCREENPITCH;
+    screens[i].short_pitch = SCREENPITCH / V_GetModePixelDepth(VID_MODE16);
+    screens[i].int_pitch = SCREENPITCH / V_GetModePixelDepth(VID_MODE32);
+  }
+
+  // statusbar
+  screens[4].width = SCREENWIDTH;
+  screens[4].height = SCREENHEIGHT;
+  screens[4].byte_pitch = SCREENPITCH;
+  screens[4].short_pitch = SCREENPITCH / V_GetModePixelDepth(VID_MODE16);
+  screens[4].int_pitch = SCREENPITCH / V_GetModePixelDepth(VID_MODE32);
+
+  R_InitMeltRes();
+  R_InitSpritesRes();
+  R_InitBuffersRes();
+  R_InitPlanesRes();
+  R_InitVisplanesRes();
+}
+
+void I_InitGraphics(void)
+{
+}
+
+void I_UpdateVideoMode(void)
+{
+}
+
+void I_ShutdownGraphics(void)
+{
+}
+
+void I_SetWindowCaption(void)
+{
+}
+
+void I_SetWindowIcon(void)
+{
+}
+
+void I_SetPalette(int pal)
+{
+}
+
+void I_UpdateNoBlit(void)
+{
+}
+
+void I_FinishUpdate(void)
+{
+}
+
+void I_StartTic(void)
+{
+}
+
+void I_StartFrame(void)
+{
+}
+
+void I_UpdateRenderSize(void)
+{
+}
+
+void UpdateGrab(void)
+{
+}
+
+int I_ScreenShot(const char *fname)
+{
+  lprintf(LO_WARN, "I_ScreenShot: no screen in the headless build\n");
+  return -1;
+}
+
+unsigned char *I_GrabScreen(void)
+{
+  return NULL;
+}
+
+void I_InitJoystick(void)
+{
+}
+
+void I_PollJoystick(void)
+{
+}
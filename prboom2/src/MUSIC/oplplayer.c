@@ -24,15 +24,25 @@
 //
 //-----------------------------------------------------------------------------
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "SDL_thread.h"
+#include "SDL_atomic.h"
+
 #include "doomdef.h"
 #include "memio.h"
 #include "mus2mid.h"
 
+#include "i_sound.h"
 #include "m_misc.h"
+#include "md5.h"
+#include "p_mapcache.h"
 #include "s_sound.h"
 #include "w_wad.h"
 #include "z_zone.h"
@@ -311,6 +321,10 @@ static dboolean music_initialized = false;
 //static dboolean musicpaused = false;
 static int current_music_volume;
 
+// Volume set by the player (0 - 127); current_music_volume is kept at
+// full volume while a song is pre-rendered.
+static int music_volume = 127;
+
 // GENMIDI lump instrument data:
 
 static const genmidi_instr_t *main_instrs;
@@ -334,6 +348,56 @@ static dboolean song_looping;
 
 int opl_io_port = 0x388;
 
+// With mus_opl_prerender, a song is not synthesized in the audio
+// callback: a thread plays it once through the OPL emulator into a
+// mono buffer, which the callback then only copies from, at the music
+// volume, wrapping around at the end if the song loops. The buffer is
+// a list of fixed size chunks so the thread can add to it while the
+// callback reads. With the level cache on, finished songs are saved
+// there, keyed by the song, the GENMIDI lump and the output settings.
+
+#define PRERENDER_SLICE   64            // samples rendered at a time
+#define PRERENDER_CHUNK   (64 * 1024)   // samples per buffer chunk
+#define PRERENDER_MAXTIME (20 * 60)     // seconds; longer songs loop there
+
+typedef struct
+{
+    dboolean active;              // a pre-rendered song is playing
+    dboolean looping;
+    dboolean paused;
+    dboolean cached;              // loaded from, or already saved to disk
+    dboolean keyed;               // key is valid
+    unsigned char key[16];
+    short **chunks;
+    unsigned int maxchunks;
+    unsigned int pos;             // next sample to play
+    SDL_Thread *thread;
+    SDL_atomic_t rendered;        // samples ready in chunks
+    SDL_atomic_t done;            // 1 when complete, 2 when cut short
+    SDL_atomic_t abort;
+} opl_prerender_t;
+
+static opl_prerender_t prerender;
+
+// A stopped rendering, handed over by PrerenderStop. The player entry
+// points all run with musmutex held, which the audio callback waits on,
+// so saving and freeing it is left to I_OPL_ReleasePrerender.
+
+typedef struct
+{
+    dboolean store;               // save to the level cache
+    unsigned char key[16];
+    short **chunks;
+    unsigned int maxchunks;
+    unsigned int samples;
+} opl_retired_t;
+
+static opl_retired_t retired;
+
+// Song registered last and the MD5 of its data.
+static const void *keyed_song;
+static unsigned char keyed_song_md5[16];
+
 // Load instrument table from GENMIDI lump:
 
 static dboolean LoadInstrumentTable(void)
@@ -585,6 +649,15 @@ void I_OPL_SetMusicVolume(int volume)
 
     // Internal state variable.
 
+    music_volume = opl_vol;
+
+    // A pre-rendered song is scaled when it is copied out.
+
+    if (prerender.active)
+    {
+        return;
+    }
+
     current_music_volume = opl_vol;
 
     // Update the volume of all voices.
@@ -1211,6 +1284,314 @@ static void StartTrack(const midi_file_t *file, unsigned int track_num)
     ScheduleTrack(track);
 }
 
+// Render the song playing on the OPL emulator into prerender.chunks,
+// until it ends or the song is stopped.
+
+static int PrerenderThread(void *arg)
+{
+    short slice[PRERENDER_SLICE * 2];
+    unsigned int maxsamples = prerender.maxchunks * PRERENDER_CHUNK;
+    unsigned int pos = 0;
+    int done = 1;
+
+    while (running_tracks > 0 && pos < maxsamples)
+    {
+        short *chunk;
+        unsigned int i;
+
+        if (SDL_AtomicGet(&prerender.abort))
+        {
+            done = 2;
+            break;
+        }
+
+        if (pos % PRERENDER_CHUNK == 0)
+        {
+            // The zone is not thread safe; use the C library directly.
+
+            chunk = (short*)(malloc)(PRERENDER_CHUNK * sizeof(*chunk));
+
+            if (chunk == NULL)
+            {
+                done = 2;
+                break;
+            }
+
+            prerender.chunks[pos / PRERENDER_CHUNK] = chunk;
+        }
+
+        chunk = prerender.chunks[pos / PRERENDER_CHUNK] + pos % PRERENDER_CHUNK;
+
+        // Both channels are the same; keep the left one.
+
+        OPL_Render_Samples(slice, PRERENDER_SLICE);
+
+        for (i=0; i<PRERENDER_SLICE; ++i)
+        {
+            chunk[i] = slice[i * 2];
+        }
+
+        pos += PRERENDER_SLICE;
+
+        // Publish the samples only after they are written.
+
+        SDL_MemoryBarrierRelease();
+        SDL_AtomicSet(&prerender.rendered, pos);
+    }
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&prerender.done, done);
+
+    return 0;
+}
+
+// Cache key: song data, GENMIDI and everything else the samples
+// depend on.
+
+static void PrerenderKey(unsigned char key[16])
+{
+    struct MD5Context md5;
+    int genmidi = W_GetNumForName("GENMIDI");
+    int params[3];
+
+    params[0] = opl_sample_rate;
+    params[1] = mus_opl_gain;
+    params[2] = PRERENDER_SLICE;
+
+    MD5Init(&md5);
+    MD5Update(&md5, (const unsigned char *) "OPLPR1", 6);
+    MD5Update(&md5, keyed_song_md5, sizeof(keyed_song_md5));
+    MD5Update(&md5, (const unsigned char *) W_CacheLumpNum(genmidi),
+              W_LumpLength(genmidi));
+    W_UnlockLumpNum(genmidi);
+    MD5Update(&md5, (const unsigned char *) params, sizeof(params));
+    MD5Final(key, &md5);
+}
+
+// Fill the chunks from a cached rendering, if there is one.
+
+static dboolean PrerenderLoad(void)
+{
+    short *data;
+    size_t size;
+    unsigned int samples;
+    unsigned int i;
+
+    data = (short*)P_MapCacheLoad("opl", prerender.key, &size);
+
+    if (data == NULL)
+    {
+        return false;
+    }
+
+    samples = size / sizeof(*data);
+
+    if (samples > prerender.maxchunks * PRERENDER_CHUNK)
+    {
+        samples = prerender.maxchunks * PRERENDER_CHUNK;
+    }
+
+    for (i=0; i * PRERENDER_CHUNK < samples; ++i)
+    {
+        unsigned int n = MIN(samples - i * PRERENDER_CHUNK, PRERENDER_CHUNK);
+
+        prerender.chunks[i] = (short*)(malloc)(PRERENDER_CHUNK * sizeof(short));
+        memcpy(prerender.chunks[i], data + i * PRERENDER_CHUNK,
+               n * sizeof(short));
+    }
+
+    free(data);
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&prerender.rendered, samples);
+    SDL_AtomicSet(&prerender.done, 1);
+
+    return true;
+}
+
+// Save a complete rendering to the level cache.
+
+static void PrerenderStore(const opl_retired_t *r)
+{
+    unsigned int samples = r->samples;
+    short *data;
+    unsigned int i;
+
+    data = (short*)malloc(samples * sizeof(*data));
+
+    if (data == NULL)
+    {
+        return;
+    }
+
+    for (i=0; i * PRERENDER_CHUNK < samples; ++i)
+    {
+        unsigned int n = MIN(samples - i * PRERENDER_CHUNK, PRERENDER_CHUNK);
+
+        memcpy(data + i * PRERENDER_CHUNK, r->chunks[i],
+               n * sizeof(short));
+    }
+
+    P_MapCacheStore("opl", r->key, data, samples * sizeof(*data));
+    free(data);
+}
+
+// Copy the next nsamp samples of the pre-rendered song to dest.
+
+static void PrerenderCopy(short *dest, unsigned int nsamp)
+{
+    // done is read first: once it is set, rendered is final.
+
+    int done = SDL_AtomicGet(&prerender.done);
+    unsigned int rendered = SDL_AtomicGet(&prerender.rendered);
+    unsigned int i;
+
+    // Pairs with the release before each publish in PrerenderThread.
+
+    SDL_MemoryBarrierAcquire();
+
+    for (i=0; i<nsamp; ++i)
+    {
+        int s = 0;
+
+        if (!prerender.paused)
+        {
+            if (prerender.pos >= rendered && done && prerender.looping)
+            {
+                prerender.pos = 0;
+            }
+
+            // Until the thread has caught up, play silence.
+
+            if (prerender.pos < rendered)
+            {
+                s = prerender.chunks[prerender.pos / PRERENDER_CHUNK]
+                                    [prerender.pos % PRERENDER_CHUNK];
+                s = s * music_volume / 127;
+                prerender.pos++;
+            }
+        }
+
+        dest[i * 2] = (short) s;
+        dest[i * 2 + 1] = (short) s;
+    }
+}
+
+// Save and free the last stopped rendering. Called by the sound code
+// with musmutex released, from the thread that stops songs.
+
+void I_OPL_ReleasePrerender(void)
+{
+    unsigned int i;
+
+    if (retired.chunks == NULL)
+    {
+        return;
+    }
+
+    if (retired.store)
+    {
+        PrerenderStore(&retired);
+    }
+
+    // Chunks come from the C library, see PrerenderThread.
+
+    for (i=0; i<retired.maxchunks; ++i)
+    {
+        (free)(retired.chunks[i]);
+    }
+
+    free(retired.chunks);
+
+    memset(&retired, 0, sizeof(retired));
+}
+
+static void PrerenderStop(void)
+{
+    if (prerender.thread != NULL)
+    {
+        SDL_AtomicSet(&prerender.abort, 1);
+        SDL_WaitThread(prerender.thread, NULL);
+    }
+
+    // Only if the previous one was never released.
+
+    I_OPL_ReleasePrerender();
+
+    retired.store = prerender.keyed && !prerender.cached
+                 && SDL_AtomicGet(&prerender.done) == 1 && P_MapCacheEnabled();
+    memcpy(retired.key, prerender.key, sizeof(retired.key));
+    retired.chunks = prerender.chunks;
+    retired.maxchunks = prerender.maxchunks;
+    retired.samples = SDL_AtomicGet(&prerender.rendered);
+
+    memset(&prerender, 0, sizeof(prerender));
+}
+
+static void I_OPL_StopSong(void);
+
+// Start pre-rendering a song; returns false to play it live instead.
+
+static dboolean PrerenderStart(const void *handle, int looping)
+{
+    const midi_file_t *file = (const midi_file_t*)handle;
+    unsigned int i;
+
+    prerender.maxchunks =
+        (PRERENDER_MAXTIME * opl_sample_rate) / PRERENDER_CHUNK + 1;
+    prerender.chunks = (short**)calloc(prerender.maxchunks, sizeof(short*));
+
+    if (prerender.chunks == NULL)
+    {
+        return false;
+    }
+
+    prerender.active = true;
+    prerender.looping = looping;
+    prerender.keyed = handle == keyed_song;
+
+    if (prerender.keyed && P_MapCacheEnabled())
+    {
+        PrerenderKey(prerender.key);
+
+        if (PrerenderLoad())
+        {
+            prerender.cached = true;
+            return true;
+        }
+    }
+
+    // Play the song once, at full volume; the thread stops at the end.
+
+    current_music_volume = 127;
+
+    tracks = (opl_track_data_t*)malloc(MIDI_NumTracks(file) * sizeof(opl_track_data_t));
+
+    num_tracks = MIDI_NumTracks(file);
+    running_tracks = num_tracks;
+    song_looping = false;
+
+    for (i=0; i<num_tracks; ++i)
+    {
+        StartTrack(file, i);
+    }
+
+    prerender.thread = SDL_CreateThread(PrerenderThread, "PrerenderThread", NULL);
+
+    if (prerender.thread == NULL)
+    {
+        // Undo the tracks started above; nothing was rendered, so the
+        // release only frees the (empty) chunk list.
+
+        lprintf(LO_WARN, "I_OPL_PlaySong: couldn't start render thread\n");
+        I_OPL_StopSong();
+        I_OPL_ReleasePrerender();
+        return false;
+    }
+
+    return true;
+}
+
 // Start playing a mid
 
 static void I_OPL_PlaySong(const void *handle, int looping)
@@ -1223,6 +1604,13 @@ static void I_OPL_PlaySong(const void *handle, int looping)
         return;
     }
 
+    if (mus_opl_prerender && PrerenderStart(handle, looping))
+    {
+        return;
+    }
+
+    current_music_volume = music_volume;
+
     file = (midi_file_t*)handle;
 
     // Allocate track data.
@@ -1248,6 +1636,12 @@ static void I_OPL_PauseSong(void)
         return;
     }
 
+    if (prerender.active)
+    {
+        prerender.paused = true;
+        return;
+    }
+
     // Pause OPL callbacks.
 
     OPL_SetPaused(1);
@@ -1272,6 +1666,8 @@ static void I_OPL_ResumeSong(void)
         return;
     }
 
+    prerender.paused = false;
+
     OPL_SetPaused(0);
 }
 
@@ -1284,6 +1680,12 @@ static void I_OPL_StopSong(void)
         return;
     }
 
+    // The render thread has to be done with the OPL state first.
+
+    if (prerender.active)
+    {
+        PrerenderStop();
+    }
 
     // Stop all playback.
 
@@ -1325,6 +1727,11 @@ static void I_OPL_UnRegisterSong(const void *handle)
     {
         MIDI_FreeFile((midi_file_t *) handle);
     }
+
+    if (handle == keyed_song)
+    {
+        keyed_song = NULL;
+    }
 }
 
 // Determine whether memory block is a .mid file
@@ -1366,7 +1773,18 @@ static const void *I_OPL_RegisterSong(const void *data, unsigned len)
     {
         lprintf (LO_WARN, "I_OPL_RegisterSong: Failed to load MID.\n");
     }
-    
+    else
+    {
+        struct MD5Context md5;
+
+        // Remembered as the pre-rendering cache key.
+
+        MD5Init(&md5);
+        MD5Update(&md5, (const unsigned char *) data, len);
+        MD5Final(keyed_song_md5, &md5);
+        keyed_song = result;
+    }
+
 
     return result;
 }
@@ -1379,6 +1797,7 @@ static void I_OPL_ShutdownMusic(void)
         // Stop currently-playing track, if there is one:
 
         I_OPL_StopSong();
+        I_OPL_ReleasePrerender();
 
         OPL_Shutdown();
 
@@ -1425,6 +1844,12 @@ const char *I_OPL_SynthName (void)
 
 void I_OPL_RenderSamples (void *dest, unsigned nsamp)
 {
+    if (prerender.active)
+    {
+        PrerenderCopy ((short *) dest, nsamp);
+        return;
+    }
+
     OPL_Render_Samples (dest, nsamp);
 }
 
@@ -30,5 +30,9 @@
 
 extern const music_player_t opl_synth_player;
 
+// Save and free a pre-rendered song stopped while musmutex was held;
+// call with musmutex released.
+void I_OPL_ReleasePrerender(void);
+
 
 #endif
@@ -52,7 +52,9 @@ typedef BOOL (WINAPI *SetAffinityFunc)(HANDLE hProcess, DWORD mask);
 
 #include <errno.h>
 
+#ifndef HEADLESS
 #include "TEXTSCREEN/txt_main.h"
+#endif
 
 #include "doomdef.h"
 #include "m_argv.h"
@@ -208,7 +210,7 @@ void I_Init2(void)
     }
   }
   R_InitInterpolation();
-  force_singletics_to = gametic + BACKUPTICS;
+  force_singletics_to = gametic + 2 * net_ticwindow;
 }
 
 /* cleanup handling -- killough:
@@ -323,6 +325,7 @@ static void PrintVer(void)
   lprintf(LO_INFO,"%s\n",I_GetVersionString(vbuf,200));
 }
 
+#ifndef HEADLESS
 //
 // ENDOOM support using text mode emulation
 //
@@ -400,6 +403,7 @@ static void I_EndDoom(void)
     TXT_Shutdown();
   }
 }
+#endif
 
 // Schedule a function to be called when the program exits.
 // If run_if_error is true, the function is called if the exit
@@ -456,8 +460,10 @@ void I_SafeExit(int rc)
 
 static void I_Quit (void)
 {
+#ifndef HEADLESS
   if (!demorecording)
     I_EndDoom();
+#endif
   if (demorecording)
     G_CheckDemoStatus();
   M_SaveDefaults ();
@@ -476,7 +482,9 @@ static void I_SetAffinityMask(void)
 {
   // Forcing single core only for "SDL MIDI Player"
   process_affinity_mask = 0;
-  if (!strcasecmp(snd_midiplayer, midiplayers[midi_player_sdl]))
+  // (not needed without music, and it would serialize -demobatch workers)
+  if (!strcasecmp(snd_midiplayer, midiplayers[midi_player_sdl]) &&
+      !M_CheckParm("-nosound") && !M_CheckParm("-nomusic"))
   {
     process_affinity_mask = 1;
   }
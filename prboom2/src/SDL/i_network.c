@@ -58,6 +58,8 @@
 #include "lprintf.h"
 #ifndef PRBOOM_SERVER
 #include "i_system.h"
+#include "m_argv.h"
+#include "z_zone.h"
 #endif
 //#include "doomstat.h"
 
@@ -74,6 +76,64 @@ size_t sentbytes, recvdbytes;
 
 UDP_PACKET *udp_packet;
 
+#ifndef PRBOOM_SERVER
+/* Simulated link, to try the netcode over loopback: -netdelay delays
+ * packets by that many ms each way, -netloss drops that percentage of
+ * them. Packets wait in a queue per direction until due. */
+typedef struct simpacket_s {
+  struct simpacket_s *next;
+  unsigned int due;
+  size_t len;
+  byte data[1];
+} simpacket_t;
+
+typedef struct {
+  simpacket_t *head, **tail;
+} simqueue_t;
+
+static int sim_delay, sim_loss;
+static simqueue_t sim_out = { NULL, &sim_out.head };
+static simqueue_t sim_in = { NULL, &sim_in.head };
+
+static void I_SimQueue(simqueue_t *q, const void *data, size_t len)
+{
+  simpacket_t *s;
+
+  if (rand() % 100 < sim_loss)
+    return;
+  s = Z_Malloc(sizeof(*s) + len, PU_STATIC, NULL);
+  s->next = NULL;
+  s->due = SDL_GetTicks() + sim_delay;
+  s->len = len;
+  memcpy(s->data, data, len);
+  *q->tail = s;
+  q->tail = &s->next;
+}
+
+// Returns the first packet of the queue if it is due
+static simpacket_t *I_SimDequeue(simqueue_t *q)
+{
+  simpacket_t *s = q->head;
+
+  if (!s || (int)(SDL_GetTicks() - s->due) < 0)
+    return NULL;
+  if (!(q->head = s->next))
+    q->tail = &q->head;
+  return s;
+}
+
+static void I_SimSendDue(void)
+{
+  simpacket_t *s;
+
+  while ((s = I_SimDequeue(&sim_out))) {
+    memcpy(udp_packet->data, s->data, udp_packet->len = s->len);
+    SDLNet_UDP_Send(udp_socket, 0, udp_packet);
+    Z_Free(s);
+  }
+}
+#endif
+
 /* I_ShutdownNetwork
  *
  * Shutdown the network code
@@ -97,6 +157,19 @@ void I_InitNetwork(void)
   atexit(I_ShutdownNetwork);
 #endif
   udp_packet = SDLNet_AllocPacket(10000);
+#ifndef PRBOOM_SERVER
+  {
+    int p;
+
+    if ((p = M_CheckParm("-netdelay")) && p < myargc-1)
+      sim_delay = MAX(atoi(myargv[p+1]), 0);
+    if ((p = M_CheckParm("-netloss")) && p < myargc-1)
+      sim_loss = BETWEEN(0, 100, atoi(myargv[p+1]));
+    if (sim_delay || sim_loss)
+      lprintf(LO_INFO, "I_InitNetwork: simulating %d ms delay, %d%% loss each way\n",
+              sim_delay, sim_loss);
+  }
+#endif
 }
 
 UDP_PACKET *I_AllocPacket(int size)
@@ -115,7 +188,15 @@ void I_FreePacket(UDP_PACKET *packet)
 
 void I_WaitForPacket(int ms)
 {
-  SDLNet_SocketSet ss = SDLNet_AllocSocketSet(1);
+  SDLNet_SocketSet ss;
+
+#ifndef PRBOOM_SERVER
+  I_SimSendDue();
+  // queued packets fall due without the socket waking us
+  if (sim_out.head || sim_in.head)
+    ms = MIN(ms, 1);
+#endif
+  ss = SDLNet_AllocSocketSet(1);
   SDLNet_UDP_AddSocket(ss, udp_socket);
   SDLNet_CheckSockets(ss,ms);
   SDLNet_FreeSocketSet(ss);
@@ -200,10 +281,10 @@ void I_CloseSocket(UDP_SOCKET sock)
   SDLNet_UDP_Close(sock);
 }
 
-UDP_CHANNEL I_RegisterPlayer(IPaddress *ipaddr)
+UDP_CHANNEL I_RegisterPlayer(IPaddress *ipaddr, int channel)
 {
-  static int freechannel;
-  return(SDLNet_UDP_Bind(udp_socket, freechannel++, ipaddr));
+  SDLNet_UDP_Unbind(udp_socket, channel);
+  return(SDLNet_UDP_Bind(udp_socket, channel, ipaddr));
 }
 
 void I_UnRegisterPlayer(UDP_CHANNEL channel)
@@ -230,7 +311,31 @@ static byte ChecksumPacket(const packet_header_t* buffer, size_t len)
   return sum;
 }
 
+#ifndef PRBOOM_SERVER
+static size_t I_GetSocketPacket(packet_header_t* buffer, size_t buflen);
+
+size_t I_GetPacket(packet_header_t* buffer, size_t buflen)
+{
+  simpacket_t *s;
+  size_t len;
+
+  if (!sim_delay && !sim_loss)
+    return I_GetSocketPacket(buffer, buflen);
+
+  I_SimSendDue();
+  while ((len = I_GetSocketPacket(buffer, buflen)))
+    I_SimQueue(&sim_in, buffer, len);
+  if (!(s = I_SimDequeue(&sim_in)))
+    return 0;
+  memcpy(buffer, s->data, len = s->len);
+  Z_Free(s);
+  return len;
+}
+
+static size_t I_GetSocketPacket(packet_header_t* buffer, size_t buflen)
+#else
 size_t I_GetPacket(packet_header_t* buffer, size_t buflen)
+#endif
 {
   int checksum;
   size_t len;
@@ -258,6 +363,13 @@ size_t I_GetPacket(packet_header_t* buffer, size_t buflen)
 void I_SendPacket(packet_header_t* packet, size_t len)
 {
   packet->checksum = ChecksumPacket(packet, len);
+#ifndef PRBOOM_SERVER
+  if (sim_delay || sim_loss) {
+    I_SimQueue(&sim_out, packet, len);
+    I_SimSendDue();
+    return;
+  }
+#endif
   memcpy(udp_packet->data, packet, udp_packet->len = len);
   SDLNet_UDP_Send(udp_socket, 0, udp_packet);
 }
@@ -269,6 +381,52 @@ void I_SendPacketTo(packet_header_t* packet, size_t len, UDP_CHANNEL *to)
   SDLNet_UDP_Send(udp_socket, *to, udp_packet);
 }
 
+#ifdef PRBOOM_SERVER
+/* The server queues the packets of a game and hands them to SDL_net in
+ * one go when it is done with the game */
+#define SEND_BATCH 64
+
+static UDP_PACKET **send_batch;
+static int send_queued;
+
+void I_QueuePacketTo(packet_header_t* packet, size_t len, UDP_CHANNEL *to)
+{
+  UDP_PACKET *p;
+
+  if (!send_batch)
+    send_batch = SDLNet_AllocPacketV(SEND_BATCH, 10000);
+  if (send_queued == SEND_BATCH)
+    I_FlushPackets();
+  p = send_batch[send_queued++];
+  packet->checksum = ChecksumPacket(packet, len);
+  memcpy(p->data, packet, p->len = len);
+  p->channel = *to;
+}
+
+void I_FlushPackets(void)
+{
+  if (send_queued)
+    SDLNet_UDP_SendV(udp_socket, send_batch, send_queued);
+  send_queued = 0;
+}
+
+/* I_WaitForSockets - I_WaitForPacket for all the sockets of the server,
+ * which stay the same for its lifetime */
+void I_WaitForSockets(UDP_SOCKET *socks, int n, int ms)
+{
+  static SDLNet_SocketSet ss;
+
+  if (!ss) {
+    int i;
+
+    ss = SDLNet_AllocSocketSet(n);
+    for (i=0; i<n; i++)
+      SDLNet_UDP_AddSocket(ss, socks[i]);
+  }
+  SDLNet_CheckSockets(ss, ms);
+}
+#endif
+
 void I_PrintAddress(FILE* fp, UDP_CHANNEL *addr)
 {
 /*
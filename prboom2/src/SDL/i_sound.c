@@ -126,6 +126,8 @@ typedef struct
   // left and right channel volume (0-127)
   int leftvol;
   int rightvol;
+  // sequence number the game thread gave this sound, see chan_finished
+  int seq;
 } channel_info_t;
 
 channel_info_t channelinfo[MAX_CHANNELS];
@@ -140,11 +142,49 @@ int   steptable[256];
 static int dumping_sound = 0;
 
 
-// lock for updating any params related to sfx
-SDL_mutex *sfxmutex;
 // lock for updating any params related to music
 SDL_mutex *musmutex;
 
+// Sound effect commands from the game thread to the mixer. The game
+// thread is the only one to move sndcmd_head and the mixer the only one
+// to move sndcmd_tail, so neither side takes a lock; a command that does
+// not fit is dropped and counted in sndcmd_dropped.
+
+#define SNDCMD_QUEUE 4096 // must be a power of two
+
+typedef enum
+{
+  sndcmd_start,
+  sndcmd_update,
+  sndcmd_stop
+} sndcmd_type_t;
+
+typedef struct
+{
+  sndcmd_type_t type;
+  int channel;
+  int id;
+  int seq;
+  const unsigned char *data;
+  size_t len;
+  int leftvol;
+  int rightvol;
+  int pitch;
+} sndcmd_t;
+
+static sndcmd_t sndcmds[SNDCMD_QUEUE];
+static SDL_atomic_t sndcmd_head; // next slot the game thread fills
+static SDL_atomic_t sndcmd_tail; // next slot the mixer reads
+static int sndcmd_dropped;
+
+// The game thread numbers the sounds it starts and remembers the number
+// of the one it last started on each channel (0 once it stopped it); the
+// mixer stores the number of each sound it stops in chan_finished. The
+// channel is playing as long as the two differ.
+static int chan_seq;
+static int chan_started[MAX_CHANNELS];
+static SDL_atomic_t chan_finished[MAX_CHANNELS];
+
 
 /* cph
  * stopchan
@@ -156,6 +196,7 @@ static void stopchan(int i)
   if (channelinfo[i].data) /* cph - prevent excess unlocks */
   {
     channelinfo[i].data = NULL;
+    SDL_AtomicSet(&chan_finished[i], channelinfo[i].seq);
   }
 }
 
@@ -250,30 +291,14 @@ static int getSliceSize(void)
   return 1024;
 }
 
-static void updateSoundParams(int handle, int volume, int seperation, int pitch)
-{
-  int slot = handle;
-  int   rightvol;
-  int   leftvol;
-
-#ifdef RANGECHECK
-  if ((handle < 0) || (handle >= MAX_CHANNELS))
-    I_Error("I_UpdateSoundParams: handle out of range");
-#endif
-
-  if (snd_pcspeaker)
-    return;
-
-  // Set stepping
-  // MWM 2000-12-24: Calculates proportion of channel samplerate
-  // to global samplerate for mixing purposes.
-  // Patched to shift left *then* divide, to minimize roundoff errors
-  // as well as to use SAMPLERATE as defined above, not to assume 11025 Hz
-  if (pitched_sounds)
-    channelinfo[slot].step = (unsigned int)(((uint64_t)channelinfo[slot].samplerate * steptable[pitch]) / snd_samplerate);
-  else
-    channelinfo[slot].step = ((channelinfo[slot].samplerate << 16) / snd_samplerate);
+//
+// getSoundVolumes
+// Left and right volume for a volume and stereo separation, called by
+// the game thread so that bad values are caught where they come from.
+//
 
+static void getSoundVolumes(int volume, int seperation, int *leftvol, int *rightvol)
+{
   // Separation, that is, orientation/stereo.
   //  range is: 1 - 256
   seperation += 1;
@@ -281,16 +306,34 @@ static void updateSoundParams(int handle, int volume, int seperation, int pitch)
   // Per left/right channel.
   //  x^2 seperation,
   //  adjust volume properly.
-  leftvol = volume - ((volume * seperation * seperation) >> 16);
+  *leftvol = volume - ((volume * seperation * seperation) >> 16);
   seperation = seperation - 257;
-  rightvol = volume - ((volume * seperation * seperation) >> 16);
+  *rightvol = volume - ((volume * seperation * seperation) >> 16);
 
   // Sanity check, clamp volume.
-  if (rightvol < 0 || rightvol > 127)
+  if (*rightvol < 0 || *rightvol > 127)
     I_Error("rightvol out of bounds");
 
-  if (leftvol < 0 || leftvol > 127)
+  if (*leftvol < 0 || *leftvol > 127)
     I_Error("leftvol out of bounds");
+}
+
+//
+// setSoundParams
+// Applies volumes and pitch to a channel, on the mixer side.
+//
+
+static void setSoundParams(int slot, int leftvol, int rightvol, int pitch)
+{
+  // Set stepping
+  // MWM 2000-12-24: Calculates proportion of channel samplerate
+  // to global samplerate for mixing purposes.
+  // Patched to shift left *then* divide, to minimize roundoff errors
+  // as well as to use SAMPLERATE as defined above, not to assume 11025 Hz
+  if (pitched_sounds)
+    channelinfo[slot].step = (unsigned int)(((uint64_t)channelinfo[slot].samplerate * steptable[pitch]) / snd_samplerate);
+  else
+    channelinfo[slot].step = ((channelinfo[slot].samplerate << 16) / snd_samplerate);
 
   // Get the proper lookup table piece
   //  for this volume level???
@@ -298,11 +341,104 @@ static void updateSoundParams(int handle, int volume, int seperation, int pitch)
   channelinfo[slot].rightvol = rightvol;
 }
 
+//
+// I_QueueSoundCommand
+// Called by the game thread only; returns false if the queue was full.
+//
+
+static dboolean I_QueueSoundCommand(const sndcmd_t *cmd)
+{
+  unsigned int head = SDL_AtomicGet(&sndcmd_head);
+
+  if (head - (unsigned int)SDL_AtomicGet(&sndcmd_tail) >= SNDCMD_QUEUE)
+  {
+    sndcmd_dropped++;
+    return false;
+  }
+  // the mixer is done reading the slot before it is overwritten
+  SDL_MemoryBarrierAcquire();
+
+  sndcmds[head & (SNDCMD_QUEUE - 1)] = *cmd;
+
+  // publishes the command only after it has been written
+  SDL_MemoryBarrierRelease();
+  SDL_AtomicSet(&sndcmd_head, head + 1);
+  return true;
+}
+
+//
+// I_RunSoundCommands
+// Called by the mixer only, before mixing a block.
+//
+
+static void I_RunSoundCommands(void)
+{
+  unsigned int tail = SDL_AtomicGet(&sndcmd_tail);
+  unsigned int head = SDL_AtomicGet(&sndcmd_head);
+
+  // the commands up to head are read only after head itself
+  SDL_MemoryBarrierAcquire();
+
+  for (; tail != head; tail++)
+  {
+    const sndcmd_t *cmd = &sndcmds[tail & (SNDCMD_QUEUE - 1)];
+
+    switch (cmd->type)
+    {
+      case sndcmd_start:
+        addsfx(cmd->id, cmd->channel, cmd->data, cmd->len);
+        channelinfo[cmd->channel].seq = cmd->seq;
+        setSoundParams(cmd->channel, cmd->leftvol, cmd->rightvol, cmd->pitch);
+        break;
+      case sndcmd_update:
+        setSoundParams(cmd->channel, cmd->leftvol, cmd->rightvol, cmd->pitch);
+        break;
+      case sndcmd_stop:
+        stopchan(cmd->channel);
+        break;
+    }
+  }
+
+  // hands the slots back only after the commands have been read
+  SDL_MemoryBarrierRelease();
+  SDL_AtomicSet(&sndcmd_tail, tail);
+}
+
+//
+// I_ResetSoundCommands
+// Empties the queue; only while the audio device is closed.
+//
+
+static void I_ResetSoundCommands(void)
+{
+  int i;
+
+  SDL_AtomicSet(&sndcmd_head, 0);
+  SDL_AtomicSet(&sndcmd_tail, 0);
+  for (i = 0; i < MAX_CHANNELS; i++)
+  {
+    chan_started[i] = 0;
+    SDL_AtomicSet(&chan_finished[i], 0);
+  }
+}
+
 void I_UpdateSoundParams(int handle, int volume, int seperation, int pitch)
 {
-  SDL_LockMutex (sfxmutex);
-  updateSoundParams(handle, volume, seperation, pitch);
-  SDL_UnlockMutex (sfxmutex);
+  sndcmd_t cmd;
+
+#ifdef RANGECHECK
+  if ((handle < 0) || (handle >= MAX_CHANNELS))
+    I_Error("I_UpdateSoundParams: handle out of range");
+#endif
+
+  if (snd_pcspeaker)
+    return;
+
+  cmd.type = sndcmd_update;
+  cmd.channel = handle;
+  cmd.pitch = pitch;
+  getSoundVolumes(volume, seperation, &cmd.leftvol, &cmd.rightvol);
+  I_QueueSoundCommand(&cmd);
 }
 
 //
@@ -384,6 +520,7 @@ int I_StartSound(int id, int channel, int vol, int sep, int pitch, int priority)
   const unsigned char *data;
   int lump;
   size_t len;
+  sndcmd_t cmd;
 
   if ((channel < 0) || (channel >= MAX_CHANNELS))
 #ifdef RANGECHECK
@@ -409,19 +546,27 @@ int I_StartSound(int id, int channel, int vol, int sep, int pitch, int priority)
   /* Find padded length */
   len -= 8;
   // do the lump caching outside the SDL_LockAudio/SDL_UnlockAudio pair
-  // use locking which makes sure the sound data is in a malloced area and
-  // not in a memory mapped one
+  // use locking which makes sure the sound data is resident, so the mixer
+  // never takes a page fault
   data = (const unsigned char *)W_LockLumpNum(lump);
 
-  SDL_LockMutex (sfxmutex);
-
-  // Returns a handle (not used).
-  addsfx(id, channel, data, len);
-  updateSoundParams(channel, vol, sep, pitch);
+  // 0 is never used, it marks a stopped channel
+  if (++chan_seq == 0)
+    chan_seq = 1;
 
-  SDL_UnlockMutex (sfxmutex);
+  cmd.type = sndcmd_start;
+  cmd.channel = channel;
+  cmd.id = id;
+  cmd.seq = chan_seq;
+  cmd.data = data;
+  cmd.len = len;
+  cmd.pitch = pitch;
+  getSoundVolumes(vol, sep, &cmd.leftvol, &cmd.rightvol);
 
+  if (!I_QueueSoundCommand(&cmd))
+    return -1;
 
+  chan_started[channel] = chan_seq;
   return channel;
 }
 
@@ -429,6 +574,8 @@ int I_StartSound(int id, int channel, int vol, int sep, int pitch, int priority)
 
 void I_StopSound (int handle)
 {
+  sndcmd_t cmd;
+
 #ifdef RANGECHECK
   if ((handle < 0) || (handle >= MAX_CHANNELS))
     I_Error("I_StopSound: handle out of range");
@@ -440,9 +587,10 @@ void I_StopSound (int handle)
     return;
   }
 
-  SDL_LockMutex (sfxmutex);
-  stopchan(handle);
-  SDL_UnlockMutex (sfxmutex);
+  cmd.type = sndcmd_stop;
+  cmd.channel = handle;
+  if (I_QueueSoundCommand(&cmd))
+    chan_started[handle] = 0;
 }
 
 
@@ -456,7 +604,8 @@ dboolean I_SoundIsPlaying(int handle)
   if (snd_pcspeaker)
     return I_PCS_SoundIsPlaying(handle);
 
-  return channelinfo[handle].data != NULL;
+  return chan_started[handle] &&
+         SDL_AtomicGet(&chan_finished[handle]) != chan_started[handle];
 }
 
 
@@ -469,12 +618,90 @@ dboolean I_AnySoundStillPlaying(void)
     return false;
 
   for (i = 0; i < MAX_CHANNELS; i++)
-    result |= channelinfo[i].data != NULL;
+    result |= I_SoundIsPlaying(i);
 
   return result;
 }
 
 
+//
+// I_BenchmarkSound
+// -benchsound: for BENCH_TICS tics, starts BENCH_SOUNDS sounds a tic
+// over all channels, stopping and updating them the way S_StartSound
+// and S_UpdateSounds do, and prints how long the game thread was held
+// up in those calls.
+//
+// Each sound queues up to three commands (stop, start, update), so
+// BENCH_SOUNDS keeps a tic's worth below the queue size: the timings
+// are for commands that were queued, not dropped. Any drops are
+// reported on their own.
+//
+
+#define BENCH_TICS   175
+#define BENCH_SOUNDS ((SNDCMD_QUEUE - 256) / 3)
+
+void I_BenchmarkSound(void)
+{
+  int sfx[NUMSFX];
+  int numsfx = 0;
+  int dropped = sndcmd_dropped;
+  double freq = (double)SDL_GetPerformanceFrequency();
+  Uint64 total = 0, worst = 0;
+  int tic, i;
+
+  if (!sound_inited || nosfxparm || snd_pcspeaker)
+  {
+    lprintf(LO_WARN, "I_BenchmarkSound: sound effects are off\n");
+    return;
+  }
+
+  for (i = 1; i < NUMSFX; i++)
+    if (S_sfx[i].lumpnum >= 0 && W_LumpLength(S_sfx[i].lumpnum) > 8)
+      sfx[numsfx++] = i;
+
+  if (!numsfx)
+  {
+    lprintf(LO_WARN, "I_BenchmarkSound: no sound effects found\n");
+    return;
+  }
+
+  srand(1);
+  for (tic = 0; tic < BENCH_TICS; tic++)
+  {
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 elapsed;
+
+    for (i = 0; i < BENCH_SOUNDS; i++)
+    {
+      int channel = i % numChannels;
+
+      if (I_SoundIsPlaying(channel))
+        I_StopSound(channel);
+      I_StartSound(sfx[rand() % numsfx], channel, rand() % 128, rand() % 256, 128, 0);
+      I_UpdateSoundParams(channel, rand() % 128, rand() % 256, 128);
+    }
+
+    elapsed = SDL_GetPerformanceCounter() - start;
+    total += elapsed;
+    worst = MAX(worst, elapsed);
+
+    // give the mixer a tic to catch up, as in a game
+    I_uSleep(1000000 / TICRATE);
+  }
+
+  for (i = 0; i < numChannels; i++)
+    I_StopSound(i);
+
+  lprintf(LO_INFO, "I_BenchmarkSound: %d sounds a tic on %d channels, "
+          "%.3f ms a tic on average, %.3f ms at most\n",
+          BENCH_SOUNDS, numChannels, total * 1000.0 / freq / BENCH_TICS,
+          worst * 1000.0 / freq);
+  if (sndcmd_dropped != dropped)
+    lprintf(LO_WARN, "I_BenchmarkSound: %d of at most %d commands dropped, "
+            "the mixer fell behind; timings include them\n",
+            sndcmd_dropped - dropped, BENCH_TICS * BENCH_SOUNDS * 3);
+}
+
 //
 // This function loops all active (internal) sound
 //  channels, retrieves a given number of samples
@@ -494,23 +721,212 @@ static void Exp_UpdateMusic (void *buff, unsigned nsamp);
 // from pcsound_sdl.c
 void PCSound_Mix_Callback(void *udata, Uint8 *stream, int len);
 
+// Mixing is done a block at a time, one channel after another: each
+// playing channel is resampled into mix_samples, which is scaled by the
+// channel volumes and added to the interleaved stereo accumulator
+// mix_acc; the sum is clamped into the output stream once per block.
+// The scaling and clamping have SSE2 versions, picked in I_InitSound.
+
+#define MIX_BLOCK 512 // stereo frames per pass
+
+static int mix_samples[MIX_BLOCK];
+static float mix_acc[MIX_BLOCK * 2];
+
+//
+// I_ResampleChannel
+//
+// Fills out with up to count samples of the channel at the output rate
+// and returns how many were written, which is less than count when the
+// sound ends (the channel is stopped then).
+//
+
+static int I_ResampleChannel(int chan, int *out, int count)
+{
+  channel_info_t *ci = channelinfo + chan;
+  int i;
+
+  for (i = 0; i < count && ci->data; i++)
+  {
+    int s;
+
+    // linear filtering
+    // the old SRC did linear interpolation back into 8 bit, and then expanded to 16 bit.
+    // this does interpolation and 8->16 at same time, allowing slightly higher quality
+    if (ci->bits == 16)
+    {
+      s = (short)(ci->data[0] | (ci->data[1] << 8)) * (255 - (ci->stepremainder >> 8))
+        + (short)(ci->data[2] | (ci->data[3] << 8)) * (ci->stepremainder >> 8);
+    }
+    else
+    {
+      s = (ci->data[0] * (0x10000 - ci->stepremainder))
+        + (ci->data[1] * (ci->stepremainder))
+        - 0x800000; // convert to signed
+    }
+
+    // lowpass
+    if (lowpass_filter)
+    {
+      s = ci->prevS + ci->alpha * (s - ci->prevS);
+      ci->prevS = s;
+    }
+
+    out[i] = s;
+
+    ci->stepremainder += ci->step;
+
+    // MSB is next sample
+    if (ci->bits == 16)
+      ci->data += (ci->stepremainder >> 16) * 2;
+    else
+      ci->data += ci->stepremainder >> 16;
+
+    ci->stepremainder &= 0xffff;
+
+    // Check whether we are done.
+    if (ci->data >= ci->enddata)
+      stopchan(chan);
+  }
+
+  return i;
+}
+
+// acc[0..count) = out[0..count)
+static void I_MixLoad_C(float *acc, const short *out, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++)
+    acc[i] = out[i];
+}
+
+// adds frames samples of s, scaled by lv and rv, to the stereo acc
+static void I_MixChannel_C(float *acc, const int *s, int frames, float lv, float rv)
+{
+  int i;
+
+  for (i = 0; i < frames; i++)
+  {
+    acc[i * 2 + 0] += s[i] * lv;
+    acc[i * 2 + 1] += s[i] * rv;
+  }
+}
+
+// out[0..count) = acc[0..count), clamped to 16 bit
+static void I_MixStore_C(short *out, const float *acc, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    int v = (int)acc[i];
+
+    if (v > SHRT_MAX)
+      out[i] = SHRT_MAX;
+    else if (v < SHRT_MIN)
+      out[i] = SHRT_MIN;
+    else
+      out[i] = (short)v;
+  }
+}
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define MIX_SSE2
+
+#include <emmintrin.h>
+
+// allow building the SSE2 code without -msse2 on 32 bit x86;
+// it is only called after SDL_HasSSE2()
+#if defined(__GNUC__) && !defined(__SSE2__)
+#define SSE2_FUNC __attribute__((target("sse2")))
+#else
+#define SSE2_FUNC
+#endif
+
+SSE2_FUNC static void I_MixLoad_SSE2(float *acc, const short *out, int count)
+{
+  int i;
+
+  for (i = 0; i + 8 <= count; i += 8)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)(out + i));
+
+    // sign extend by unpacking into the high halves and shifting down
+    _mm_storeu_ps(acc + i, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)));
+    _mm_storeu_ps(acc + i + 4, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)));
+  }
+  I_MixLoad_C(acc + i, out + i, count - i);
+}
+
+SSE2_FUNC static void I_MixChannel_SSE2(float *acc, const int *s, int frames, float lv, float rv)
+{
+  __m128 vol = _mm_setr_ps(lv, rv, lv, rv);
+  int i;
+
+  for (i = 0; i + 4 <= frames; i += 4)
+  {
+    __m128 v = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(s + i)));
+    float *a = acc + i * 2;
+
+    // s0 s0 s1 s1 and s2 s2 s3 s3 against the l r l r volumes
+    _mm_storeu_ps(a, _mm_add_ps(_mm_loadu_ps(a), _mm_mul_ps(_mm_unpacklo_ps(v, v), vol)));
+    _mm_storeu_ps(a + 4, _mm_add_ps(_mm_loadu_ps(a + 4), _mm_mul_ps(_mm_unpackhi_ps(v, v), vol)));
+  }
+  I_MixChannel_C(acc + i * 2, s + i, frames - i, lv, rv);
+}
+
+SSE2_FUNC static void I_MixStore_SSE2(short *out, const float *acc, int count)
+{
+  int i;
+
+  for (i = 0; i + 8 <= count; i += 8)
+  {
+    __m128i lo = _mm_cvttps_epi32(_mm_loadu_ps(acc + i));
+    __m128i hi = _mm_cvttps_epi32(_mm_loadu_ps(acc + i + 4));
+
+    // packs saturates, which is the clamp
+    _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(lo, hi));
+  }
+  I_MixStore_C(out + i, acc + i, count - i);
+}
+#endif
+
+static void (*I_MixLoad)(float *acc, const short *out, int count) = I_MixLoad_C;
+static void (*I_MixChannel)(float *acc, const int *s, int frames, float lv, float rv) = I_MixChannel_C;
+static void (*I_MixStore)(short *out, const float *acc, int count) = I_MixStore_C;
+
+//
+// I_InitMixer
+//
+// Picks the SSE2 mixing functions when the CPU has them, unless -nosimd
+// asks for the plain C ones.
+//
+
+static void I_InitMixer(void)
+{
+  I_MixLoad = I_MixLoad_C;
+  I_MixChannel = I_MixChannel_C;
+  I_MixStore = I_MixStore_C;
+
+#ifdef MIX_SSE2
+  if (!M_CheckParm("-nosimd") && SDL_HasSSE2())
+  {
+    I_MixLoad = I_MixLoad_SSE2;
+    I_MixChannel = I_MixChannel_SSE2;
+    I_MixStore = I_MixStore_SSE2;
+  }
+#endif
+}
+
 static void I_UpdateSound(void *unused, Uint8 *stream, int len)
 {
-  // Mix current sound data.
-  // Data, from raw sound, for right and left.
-  // register unsigned char sample;
-  register int    dl;
-  register int    dr;
-
-  // Pointers in audio stream, left, right, end.
-  signed short   *leftout;
-  signed short   *rightout;
-  signed short   *leftend;
-  // Step in stream, left and right, thus two.
-  int       step;
+  // Position in the audio stream, left and right alternating.
+  signed short *out;
+  // Stereo frames left to mix.
+  int frames;
 
   // Mixing channel index.
-  int       chan;
+  int chan;
 
   if (snd_midiplayer == NULL) // This is but a temporary fix. Please do remove after a more definitive one!
     memset(stream, 0, len);
@@ -537,119 +953,38 @@ static void I_UpdateSound(void *unused, Uint8 *stream, int len)
     return;
   }
 
-  SDL_LockMutex (sfxmutex);
-  // Left and right channel
-  //  are in audio stream, alternating.
-  leftout = (signed short *)stream;
-  rightout = ((signed short *)stream) + 1;
-  step = 2;
-
-  // Determine end, for left channel only
-  //  (right channel is implicit).
-  leftend = leftout + (len / 4) * step;
+  out = (signed short *)stream;
+  frames = len / 4;
 
-  // Mix sounds into the mixing buffer.
-  // Loop over step*SAMPLECOUNT,
-  //  that is 512 values for two channels.
-  while (leftout != leftend)
+  while (frames > 0)
   {
-    // Reset left/right value.
-    //dl = 0;
-    //dr = 0;
-    dl = *leftout;
-    dr = *rightout;
-
-    // Love thy L2 chache - made this a loop.
-    // Now more channels could be set at compile time
-    //  as well. Thus loop those  channels.
-    for ( chan = 0; chan < numChannels; chan++ )
+    int count = MIN(frames, MIX_BLOCK);
+
+    I_RunSoundCommands();
+
+    // sound effects are added on top of the music already in the stream
+    I_MixLoad(mix_acc, out, count * 2);
+
+    for (chan = 0; chan < numChannels; chan++)
     {
       channel_info_t *ci = channelinfo + chan;
 
-      // Check channel, if active.
       if (ci->data)
       {
-        int s;
-        // Get the raw data from the channel.
-        // no filtering
-        //s = ci->data[0] * 0x10000 - 0x800000;
-
-        // linear filtering
-        // the old SRC did linear interpolation back into 8 bit, and then expanded to 16 bit.
-        // this does interpolation and 8->16 at same time, allowing slightly higher quality
-        if (ci->bits == 16)
-        {
-          s = (short)(ci->data[0] | (ci->data[1] << 8)) * (255 - (ci->stepremainder >> 8))
-            + (short)(ci->data[2] | (ci->data[3] << 8)) * (ci->stepremainder >> 8);
-        }
-        else
-        {
-          s = (ci->data[0] * (0x10000 - ci->stepremainder))
-            + (ci->data[1] * (ci->stepremainder))
-            - 0x800000; // convert to signed
-        }
-
-        // lowpass
-        if (lowpass_filter)
-        {
-          s = ci->prevS + ci->alpha * (s - ci->prevS);
-          ci->prevS = s;
-        }
-
-        // Add left and right part
-        //  for this channel (sound)
-        //  to the current data.
-        // Adjust volume accordingly.
-
         // full loudness (vol=127) is actually 127/191
+        float lv = ci->leftvol / 49152.0f;
+        float rv = ci->rightvol / 49152.0f;
+        int n = I_ResampleChannel(chan, mix_samples, count);
 
-        dl += ci->leftvol * s / 49152;  // >> 15;
-        dr += ci->rightvol * s / 49152; // >> 15;
-
-        // Increment index ???
-        ci->stepremainder += ci->step;
-
-        // MSB is next sample???
-        if (ci->bits == 16)
-          ci->data += (ci->stepremainder >> 16) * 2;
-        else
-          ci->data += ci->stepremainder >> 16;
-
-        // Limit to LSB???
-        ci->stepremainder &= 0xffff;
-
-        // Check whether we are done.
-        if (ci->data >= ci->enddata)
-          stopchan(chan);
+        I_MixChannel(mix_acc, mix_samples, n, lv, rv);
       }
     }
 
-    // Clamp to range. Left hardware channel.
-    // Has been char instead of short.
-    // if (dl > 127) *leftout = 127;
-    // else if (dl < -128) *leftout = -128;
-    // else *leftout = dl;
+    I_MixStore(out, mix_acc, count * 2);
 
-    if (dl > SHRT_MAX)
-      *leftout = SHRT_MAX;
-    else if (dl < SHRT_MIN)
-      *leftout = SHRT_MIN;
-    else
-      *leftout = (signed short)dl;
-
-    // Same for right hardware channel.
-    if (dr > SHRT_MAX)
-      *rightout = SHRT_MAX;
-    else if (dr < SHRT_MIN)
-      *rightout = SHRT_MIN;
-    else
-      *rightout = (signed short)dr;
-
-    // Increment current pointers in stream
-    leftout += step;
-    rightout += step;
+    out += count * 2;
+    frames -= count;
   }
-  SDL_UnlockMutex (sfxmutex);
 }
 
 void I_ShutdownSound(void)
@@ -663,12 +998,6 @@ void I_ShutdownSound(void)
     SDL_CloseAudio();
     lprintf(LO_INFO, "\n");
     sound_inited = false;
-
-    if (sfxmutex)
-    {
-      SDL_DestroyMutex (sfxmutex);
-      sfxmutex = NULL;
-    }
   }
 }
 
@@ -692,6 +1021,9 @@ void I_InitSound(void)
   if (sound_inited)
       I_ShutdownSound();
 
+  // the mixer is not running now
+  I_ResetSoundCommands();
+
   // Secure and configure sound device first.
   lprintf(LO_INFO, "I_InitSound: ");
 
@@ -751,7 +1083,7 @@ void I_InitSound(void)
     first_sound_init = false;
   }
 
-  sfxmutex = SDL_CreateMutex ();
+  I_InitMixer();
 
   // If we are using the PC speaker, we now need to initialise it.
   if (snd_pcspeaker)
@@ -1347,6 +1679,7 @@ int mus_fluidsynth_chorus;
 int mus_fluidsynth_reverb;
 int mus_fluidsynth_gain; // NSM  fine tune fluidsynth output level
 int mus_opl_gain; // NSM  fine tune OPL output level
+int mus_opl_prerender; // render OPL songs ahead of time on a thread
 const char *mus_portmidi_reset_type; // portmidi reset type
 int mus_portmidi_reset_delay; // portmidi delay after reset
 int mus_portmidi_filter_sysex; // portmidi block sysex from midi files
@@ -1417,6 +1750,7 @@ static void Exp_PauseSong (int handle)
       break;
   }  
   SDL_UnlockMutex (musmutex);
+  I_OPL_ReleasePrerender ();
 }
 
 static void Exp_ResumeSong (int handle)
@@ -1447,6 +1781,7 @@ static void Exp_StopSong(int handle)
     SDL_LockMutex (musmutex);
     music_players[current_player]->stop ();
     SDL_UnlockMutex (musmutex);
+    I_OPL_ReleasePrerender ();
   }
 }
 
@@ -1463,6 +1798,7 @@ static void Exp_UnRegisterSong(int handle)
       song_data = NULL;
     }
     SDL_UnlockMutex (musmutex);
+    I_OPL_ReleasePrerender ();
   }
 }
 
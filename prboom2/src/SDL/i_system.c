@@ -224,6 +224,37 @@ dboolean I_FileToBuffer(const char *filename, byte **data, int *size)
 
   return result;
 }
+
+/*
+ * I_GetUptimeMS
+ *
+ * Milliseconds since the SDL library was initialised, at startup.
+ */
+unsigned int I_GetUptimeMS(void)
+{
+  return SDL_GetTicks();
+}
+
+/*
+ * I_GetResidentMemory
+ *
+ * Resident set size of the process in KB, or 0 if unknown.
+ */
+size_t I_GetResidentMemory(void)
+{
+  size_t rss = 0;
+#if defined(__linux__)
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f)
+  {
+    unsigned long size, resident;
+    if (fscanf(f, "%lu %lu", &size, &resident) == 2)
+      rss = (size_t)resident * (sysconf(_SC_PAGESIZE) / 1024);
+    fclose(f);
+  }
+#endif
+  return rss;
+}
 #endif // PRBOOM_SERVER
 
 /* 
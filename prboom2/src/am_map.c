@@ -58,6 +58,7 @@
 #include "r_demo.h"
 #include "m_misc.h"
 #include "m_bbox.h"
+#include "m_profile.h"
 
 extern dboolean gamekeydown[];
 
@@ -1325,6 +1326,259 @@ static int AM_DoorColor(int type)
   }
 }
 
+//
+// Automap index
+//
+// A grid over the map listing the lines and the sectors whose bounding
+// boxes overlap each cell, in index order, so a frame only looks at the
+// part of the map in view. A query returns every item the full scan's
+// bbox test would pass (and some it won't), sorted, so that everything
+// is still drawn in the same order. The index also keeps every vertex as
+// last rotated, for as long as the view doesn't change.
+//
+// It lives in PU_LEVEL memory; Z_FreeTags clears am_index at the next
+// level and the index is built again when the automap is next drawn.
+//
+
+typedef struct
+{
+  fixed_t x, y;          // lower left corner of the grid, map coords
+  int shift;             // cells are 1 << shift map coords across
+  int width, height;
+
+  int *linecells;        // cell i has lineitems[linecells[i]] up to
+  int *lineitems;        //  lineitems[linecells[i + 1]]
+  int *sectorcells;
+  int *sectoritems;
+  unsigned int *linestamp, *sectorstamp;
+  unsigned int stamp;    // of the last query
+  int *visible;          // result of the last query
+
+  mpoint_t *points;      // vertexes as last transformed
+  unsigned int *pointstamp;
+  unsigned int pointframe;
+  am_frame_t frame;      // view the points were transformed for
+  int rotate;
+} am_index_t;
+
+static am_index_t *am_index;
+
+// Bounding box of line or sector i in map coords
+static void AM_IndexItemBox(dboolean sectorindex, int i, fixed_t *box)
+{
+  if (sectorindex)
+  {
+    box[BOXLEFT] = sectors[i].bbox[BOXLEFT];
+    box[BOXRIGHT] = sectors[i].bbox[BOXRIGHT];
+    box[BOXBOTTOM] = sectors[i].bbox[BOXBOTTOM];
+    box[BOXTOP] = sectors[i].bbox[BOXTOP];
+  }
+  else
+  {
+    box[BOXLEFT] = lines[i].bbox[BOXLEFT] >> FRACTOMAPBITS;
+    box[BOXRIGHT] = lines[i].bbox[BOXRIGHT] >> FRACTOMAPBITS;
+    box[BOXBOTTOM] = lines[i].bbox[BOXBOTTOM] >> FRACTOMAPBITS;
+    box[BOXTOP] = lines[i].bbox[BOXTOP] >> FRACTOMAPBITS;
+  }
+}
+
+// Cells overlapping a box; false if it misses the grid
+static dboolean AM_IndexCellRange(const fixed_t *box, int *x1, int *y1, int *x2, int *y2)
+{
+  if (box[BOXRIGHT] < am_index->x || box[BOXTOP] < am_index->y)
+    return false;
+
+  *x1 = box[BOXLEFT] <= am_index->x ? 0 :
+    (int)(((int_64_t)box[BOXLEFT] - am_index->x) >> am_index->shift);
+  *y1 = box[BOXBOTTOM] <= am_index->y ? 0 :
+    (int)(((int_64_t)box[BOXBOTTOM] - am_index->y) >> am_index->shift);
+  *x2 = (int)(((int_64_t)box[BOXRIGHT] - am_index->x) >> am_index->shift);
+  *y2 = (int)(((int_64_t)box[BOXTOP] - am_index->y) >> am_index->shift);
+
+  if (*x1 >= am_index->width || *y1 >= am_index->height)
+    return false;
+  *x2 = MIN(*x2, am_index->width - 1);
+  *y2 = MIN(*y2, am_index->height - 1);
+  return true;
+}
+
+static void AM_IndexItems(dboolean sectorindex, int count, int **cellsp, int **itemsp)
+{
+  int numcells = am_index->width * am_index->height;
+  int *cells = Z_Calloc(numcells + 1, sizeof(*cells), PU_LEVEL, 0);
+  int *fill, *items;
+  int i, x, y, x1, y1, x2, y2;
+  fixed_t box[4];
+
+  for (i = 0; i < count; i++)
+  {
+    AM_IndexItemBox(sectorindex, i, box);
+    if (AM_IndexCellRange(box, &x1, &y1, &x2, &y2))
+      for (y = y1; y <= y2; y++)
+        for (x = x1; x <= x2; x++)
+          cells[y * am_index->width + x + 1]++;
+  }
+  for (i = 0; i < numcells; i++)
+    cells[i + 1] += cells[i];
+
+  items = Z_Malloc(cells[numcells] * sizeof(*items), PU_LEVEL, 0);
+  fill = Z_Malloc(numcells * sizeof(*fill), PU_STATIC, 0);
+  memcpy(fill, cells, numcells * sizeof(*fill));
+
+  for (i = 0; i < count; i++)
+  {
+    AM_IndexItemBox(sectorindex, i, box);
+    if (AM_IndexCellRange(box, &x1, &y1, &x2, &y2))
+      for (y = y1; y <= y2; y++)
+        for (x = x1; x <= x2; x++)
+          items[fill[y * am_index->width + x]++] = i;
+  }
+  Z_Free(fill);
+
+  *cellsp = cells;
+  *itemsp = items;
+}
+
+static void AM_BuildIndex(void)
+{
+  fixed_t minx = INT_MAX, miny = INT_MAX, maxx = INT_MIN, maxy = INT_MIN;
+  int i;
+
+  Z_Malloc(sizeof(*am_index), PU_LEVEL, (void **)&am_index);
+
+  for (i = 0; i < numvertexes; i++)
+  {
+    minx = MIN(minx, vertexes[i].x >> FRACTOMAPBITS);
+    maxx = MAX(maxx, vertexes[i].x >> FRACTOMAPBITS);
+    miny = MIN(miny, vertexes[i].y >> FRACTOMAPBITS);
+    maxy = MAX(maxy, vertexes[i].y >> FRACTOMAPBITS);
+  }
+  if (minx > maxx)
+    minx = maxx = miny = maxy = 0;
+
+  // 128 unit cells at least, and no more cells than lines
+  am_index->x = minx;
+  am_index->y = miny;
+  am_index->shift = MAPBITS + 7;
+  do
+  {
+    am_index->width = (int)(((int_64_t)maxx - minx) >> am_index->shift) + 1;
+    am_index->height = (int)(((int_64_t)maxy - miny) >> am_index->shift) + 1;
+  } while ((int_64_t)am_index->width * am_index->height > MAX(numlines, 64) &&
+           ++am_index->shift < 31);
+
+  AM_IndexItems(false, numlines, &am_index->linecells, &am_index->lineitems);
+  AM_IndexItems(true, numsectors, &am_index->sectorcells, &am_index->sectoritems);
+
+  am_index->linestamp = Z_Calloc(numlines, sizeof(*am_index->linestamp), PU_LEVEL, 0);
+  am_index->sectorstamp = Z_Calloc(numsectors, sizeof(*am_index->sectorstamp), PU_LEVEL, 0);
+  am_index->stamp = 0;
+  am_index->visible = Z_Malloc(MAX(numlines, numsectors) * sizeof(*am_index->visible), PU_LEVEL, 0);
+
+  am_index->points = Z_Malloc(numvertexes * sizeof(*am_index->points), PU_LEVEL, 0);
+  am_index->pointstamp = Z_Calloc(numvertexes, sizeof(*am_index->pointstamp), PU_LEVEL, 0);
+  am_index->pointframe = 1;
+  am_index->rotate = automapmode & am_rotate;
+  am_index->frame = am_frame;
+}
+
+static int C_DECL AM_CompareItems(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+//
+// AM_QueryIndex
+//
+// Sets *visible to the lines (or sectors) in cells the frame overlaps,
+// in increasing order, and returns how many there are. Returns -1 when
+// the frame covers so much of the map that a full scan is cheaper.
+//
+static int AM_QueryIndex(dboolean sectorindex, const int **visible)
+{
+  const int *cells = sectorindex ? am_index->sectorcells : am_index->linecells;
+  const int *items = sectorindex ? am_index->sectoritems : am_index->lineitems;
+  unsigned int *stamps = sectorindex ? am_index->sectorstamp : am_index->linestamp;
+  int x1, y1, x2, y2, x, y, j, n = 0;
+
+  *visible = am_index->visible;
+
+  if (!AM_IndexCellRange(am_frame.bbox, &x1, &y1, &x2, &y2))
+    return 0;
+
+  if ((x2 - x1 + 1) * (y2 - y1 + 1) * 2 > am_index->width * am_index->height)
+    return -1;
+
+  if (!++am_index->stamp)
+  {
+    memset(am_index->linestamp, 0, numlines * sizeof(*am_index->linestamp));
+    memset(am_index->sectorstamp, 0, numsectors * sizeof(*am_index->sectorstamp));
+    am_index->stamp = 1;
+  }
+
+  for (y = y1; y <= y2; y++)
+    for (x = x1; x <= x2; x++)
+    {
+      int cell = y * am_index->width + x;
+
+      for (j = cells[cell]; j < cells[cell + 1]; j++)
+        if (stamps[items[j]] != am_index->stamp)
+        {
+          stamps[items[j]] = am_index->stamp;
+          am_index->visible[n++] = items[j];
+        }
+    }
+
+  if (x1 != x2 || y1 != y2)
+    qsort(am_index->visible, n, sizeof(*am_index->visible), AM_CompareItems);
+  return n;
+}
+
+//
+// AM_GetVertexPoint
+//
+// A vertex rotated or converted for drawing, from the index if the view
+// hasn't changed since it was last done.
+//
+static void AM_GetVertexPoint(const vertex_t *v, mpoint_t *p)
+{
+  int i = v - vertexes;
+
+  if (am_index->pointstamp[i] != am_index->pointframe)
+  {
+    mpoint_t *q = &am_index->points[i];
+
+    q->x = v->x >> FRACTOMAPBITS;
+    q->y = v->y >> FRACTOMAPBITS;
+    if (automapmode & am_rotate)
+      AM_rotatePoint(q);
+    else
+      AM_SetMPointFloatValue(q);
+    am_index->pointstamp[i] = am_index->pointframe;
+  }
+  *p = am_index->points[i];
+}
+
+static void AM_UpdateIndex(void)
+{
+  if (!am_index)
+    AM_BuildIndex();
+
+  // unrotated points only depend on am_frame.precise
+  if (am_index->rotate != (automapmode & am_rotate) ||
+      am_index->frame.precise != am_frame.precise ||
+      (am_index->rotate && memcmp(&am_index->frame, &am_frame, sizeof(am_frame))))
+  {
+    am_index->rotate = automapmode & am_rotate;
+    am_index->frame = am_frame;
+    if (!++am_index->pointframe)
+    {
+      memset(am_index->pointstamp, 0, numvertexes * sizeof(*am_index->pointstamp));
+      am_index->pointframe = 1;
+    }
+  }
+}
+
 //
 // Determines visible lines, draws them.
 // This is LineDef based, not LineSeg based.
@@ -1343,12 +1597,22 @@ static int AM_DoorColor(int type)
 //
 static void AM_drawWalls(void)
 {
-  int i;
+  int i, j, n;
+  const int *visible;
   static mline_t l;
 
+  n = AM_QueryIndex(false, &visible);
+  if (n < 0)
+  {
+    n = numlines;
+    visible = NULL;
+  }
+
   // draw the unclipped visible portions of all lines
-  for (i=0;i<numlines;i++)
+  for (j=0;j<n;j++)
   {
+    i = visible ? visible[j] : j;
+
     if (lines[i].bbox[BOXLEFT] >> FRACTOMAPBITS > am_frame.bbox[BOXRIGHT] ||
       lines[i].bbox[BOXRIGHT] >> FRACTOMAPBITS < am_frame.bbox[BOXLEFT] ||
       lines[i].bbox[BOXBOTTOM] >> FRACTOMAPBITS > am_frame.bbox[BOXTOP] ||
@@ -1357,21 +1621,8 @@ static void AM_drawWalls(void)
       continue;
     }
 
-    l.a.x = lines[i].v1->x >> FRACTOMAPBITS;
-    l.a.y = lines[i].v1->y >> FRACTOMAPBITS;
-    l.b.x = lines[i].v2->x >> FRACTOMAPBITS;
-    l.b.y = lines[i].v2->y >> FRACTOMAPBITS;
-
-    if (automapmode & am_rotate)
-    {
-      AM_rotatePoint(&l.a);
-      AM_rotatePoint(&l.b);
-    }
-    else
-    {
-      AM_SetMPointFloatValue(&l.a);
-      AM_SetMPointFloatValue(&l.b);
-    }
+    AM_GetVertexPoint(lines[i].v1, &l.a);
+    AM_GetVertexPoint(lines[i].v2, &l.b);
 
     // if line has been seen or IDDT has been used
     if (ddt_cheating || (lines[i].flags & ML_MAPPED))
@@ -1893,9 +2144,22 @@ static void AM_DrawNiceThings(void)
   // walls
   if (ddt_cheating == 2)
   {
+    const int *visible = NULL;
+    int j, n = -1;
+
+    if (!(players[displayplayer].cheats & CF_NOCLIP))
+      n = AM_QueryIndex(true, &visible);
+    if (n < 0)
+    {
+      n = numsectors;
+      visible = NULL;
+    }
+
     // for all sectors
-    for (i = 0; i < numsectors; i++)
+    for (j = 0; j < n; j++)
     {
+      i = visible ? visible[j] : j;
+
       if (!(players[displayplayer].cheats & CF_NOCLIP) &&
         (sectors[i].bbox[BOXLEFT] > am_frame.bbox[BOXRIGHT] ||
         sectors[i].bbox[BOXRIGHT] < am_frame.bbox[BOXLEFT] ||
@@ -1972,7 +2236,8 @@ static void AM_DrawNiceThings(void)
 //
 static void AM_drawThings(void)
 {
-  int   i;
+  int   i, j, n = -1;
+  const int *visible = NULL;
   mobj_t* t;
 
 #if defined(HAVE_LIBSDL2_IMAGE) && defined(GL_DOOM)
@@ -1989,8 +2254,16 @@ static void AM_drawThings(void)
   if (ddt_cheating != 2)
     return;
 
+  if (!(players[displayplayer].cheats & CF_NOCLIP))
+    n = AM_QueryIndex(true, &visible);
+  if (n < 0)
+  {
+    n = numsectors;
+    visible = NULL;
+  }
+
   // for all sectors
-  for (i=0;i<numsectors;i++)
+  for (j=0;j<n;j++)
   {
    // e6y
    // Two-pass method for better usability of automap:
@@ -2000,6 +2273,8 @@ static void AM_drawThings(void)
    int pass;
    int enemies = 0;
 
+   i = visible ? visible[j] : j;
+
    if (!(players[displayplayer].cheats & CF_NOCLIP) &&
      (sectors[i].bbox[BOXLEFT] > am_frame.bbox[BOXRIGHT] ||
      sectors[i].bbox[BOXRIGHT] < am_frame.bbox[BOXLEFT] ||
@@ -2318,6 +2593,8 @@ void AM_Drawer (void)
   if (!(automapmode & am_active))
     return;
 
+  PROFILE_BEGIN(prof_automap);
+
   if (automapmode & am_follow)
     AM_doFollowPlayer();
 
@@ -2330,6 +2607,7 @@ void AM_Drawer (void)
     AM_changeWindowLoc();
 
   AM_setFrameVariables();
+  AM_UpdateIndex();
 
 #ifdef GL_DOOM
   if (V_GetMode() == VID_MODEGL)
@@ -2370,4 +2648,6 @@ void AM_Drawer (void)
 #endif
 
   AM_drawMarks();
+
+  PROFILE_END(prof_automap);
 }
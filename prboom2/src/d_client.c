@@ -85,9 +85,26 @@ int ticdup = 1;
 static int xtratics = 0;
 int              wanted_player_number;
 int solo_net = 0;
+int net_ticwindow = 6; // tics built ahead of gametic, -ticwindow
+
+#ifdef HAVE_NET
+static dboolean  deltatics;    // server takes PKT_DTICC
+static int       remoteack;    // first of our tics the server lacks
+static int       lastsent;     // maketic at the last PKT_DTICC
+static int       lastsendtime;
+static unsigned  stallms;      // time TryRunTics waited for the server
+#endif
 
 static void D_QuitNetGame (void);
 
+static void D_InitTicWindow(void)
+{
+  int p = M_CheckParm("-ticwindow");
+
+  if (p && p < myargc-1)
+    net_ticwindow = BETWEEN(1, BACKUPTICS/2 - 1, atoi(myargv[p+1]));
+}
+
 #ifndef HAVE_NET
 doomcom_t*      doomcom;
 #endif
@@ -114,6 +131,7 @@ void D_InitNetGame (void)
     packet_header_t *packet = Z_Malloc(1000, PU_STATIC, NULL);
     struct setup_packet_s *sinfo = (void*)(packet+1);
   struct { packet_header_t head; short pn; } PACKEDATTR initpacket;
+    size_t len;
 
     I_InitNetwork();
   udp_socket = I_Socket(0);
@@ -127,7 +145,7 @@ void D_InitNetGame (void)
 	packet_set(&initpacket.head, PKT_INIT, 0);
 	I_SendPacket(&initpacket.head, sizeof(initpacket));
 	I_WaitForPacket(5000);
-      } while (!I_GetPacket(packet, 1000));
+      } while (!(len = I_GetPacket(packet, 1000)));
       if (packet->type == PKT_DOWN) I_Error("Server aborted the game");
     } while (packet->type != PKT_SETUP);
 
@@ -156,10 +174,14 @@ void D_InitNetGame (void)
   D_AddFile(p, source_net);
   p += strlen(p) + 1;
       }
+      // newer servers append their flags
+      if (p < (char*)packet + len)
+        deltatics = (*p & NETFLAG_DELTATICS) && !M_CheckParm("-nodeltatics");
     }
     Z_Free(packet);
   }
   localcmds = netcmds[displayplayer = consoleplayer];
+  D_InitTicWindow();
   for (i=0; i<numplayers; i++)
     playeringame[i] = true;
   for (; i<MAXPLAYERS; i++)
@@ -178,6 +200,7 @@ void D_InitNetGame (void)
   solo_net = (M_CheckParm("-solo-net") != 0);
   coop_spawns = (M_CheckParm("-coop_spawns") != 0);
   netgame = solo_net;
+  D_InitTicWindow();
 
   for (i=0; i<doomcom->numplayers; i++)
     playeringame[i] = true;
@@ -270,6 +293,34 @@ dboolean D_NetGetWad(const char* name)
 #endif
 }
 
+// Send all our tics the server has not acknowledged yet, and tell it
+// which of its tics we need next.
+static void D_SendDeltaTics(void)
+{
+  int from = MAX(remoteack, maketic - 128); // at most 128 tics per packet
+  int tics = MAX(maketic - from, 0);
+  packet_header_t *packet = Z_Malloc(sizeof(packet_header_t) + 6 + tics * TD_MAXSIZE,
+                                     PU_STATIC, NULL);
+  byte *p = (byte*)(packet+1);
+  ticcmd_t prev;
+  int tic;
+
+  packet_set(packet, PKT_DTICC, from);
+  *p++ = consoleplayer;
+  p = WriteTicNum(p, remotetic);
+  *p++ = tics;
+  memset(&prev, 0, sizeof(prev));
+  for (tic = from; tic < from + tics; tic++) {
+    p = WriteTicDelta(p, &prev, &localcmds[tic%BACKUPTICS]);
+    prev = localcmds[tic%BACKUPTICS];
+  }
+  I_SendPacket(packet, p - (byte*)packet);
+  Z_Free(packet);
+
+  lastsent = maketic;
+  lastsendtime = I_GetTime();
+}
+
 void NetUpdate(void)
 {
   static int lastmadetic;
@@ -303,6 +354,38 @@ void NetUpdate(void)
       }
     }
   }
+  break;
+      case PKT_DTICS:
+  {
+    const byte *p = (const byte*)(packet+1);
+    const byte *end = (const byte*)packet + recvlen;
+    int tic = doom_ntohl(packet->tic);
+    ticcmd_t cmds[MAXPLAYERS];
+    int tics;
+
+    if (recvlen < sizeof(*packet) + 5) break;
+    remoteack = MAX(remoteack, ReadTicNum(p));
+    tics = p[4];
+    p += 5;
+    // Missed some: our next PKT_DTICC tells the server where to resume
+    if (tic > remotetic) break;
+    memset(cmds, 0, sizeof(cmds));
+    while (tics--) {
+      int n, players;
+
+      if (p >= end) break;
+      players = *p++;
+      for (n=0; n<MAXPLAYERS && p; n++)
+        if (players & (1 << n))
+          p = ReadTicDelta(p, end, &cmds[n]);
+      if (!p) break;
+      if (tic++ < remotetic) continue; // Already have it
+      for (n=0; n<MAXPLAYERS; n++)
+        if (players & (1 << n))
+          netcmds[n][remotetic%BACKUPTICS] = cmds[n];
+      remotetic++;
+    }
+  }
   break;
       case PKT_RETRANS: // Resend request
           remotesend = doom_ntohl(packet->tic);
@@ -344,17 +427,21 @@ void NetUpdate(void)
     if (ffmap) newtics++;
     while (newtics--) {
       I_StartTic();
-      if (maketic - gametic > BACKUPTICS/2) break;
+      if (maketic - gametic > net_ticwindow) break;
       
       // e6y
-      // Eliminating the sudden jump of six frames(BACKUPTICS/2) 
+      // Eliminating the sudden jump of six frames(net_ticwindow) 
       // after change of realtic_clock_rate.
       if (maketic - gametic && gametic <= force_singletics_to && realtic_clock_rate < 200) break;
 
       G_BuildTiccmd(&localcmds[maketic%BACKUPTICS]);
       maketic++;
     }
-    if (server && maketic > remotesend) { // Send the tics to the server
+    if (server && deltatics) {
+      // At least once a tic, so losses are made up without a stall
+      if (maketic > lastsent || I_GetTime() != lastsendtime)
+        D_SendDeltaTics();
+    } else if (server && maketic > remotesend) { // Send the tics to the server
       int sendtics;
       remotesend -= xtratics;
       if (remotesend < 0) remotesend = 0;
@@ -389,7 +476,7 @@ void D_BuildNewTiccmds(void)
     while (newtics--)
     {
       I_StartTic();
-      if (maketic - gametic > BACKUPTICS/2) break;
+      if (maketic - gametic > net_ticwindow) break;
       G_BuildTiccmd(&localcmds[maketic%BACKUPTICS]);
       maketic++;
     }
@@ -480,6 +567,9 @@ void TryRunTics (void)
 #endif
     runtics = (server ? remotetic : maketic) - gametic;
     if (!runtics) {
+#ifdef HAVE_NET
+      unsigned waitstart = I_GetUptimeMS();
+#endif
       if (!movement_smooth || !window_focused) {
 #ifdef HAVE_NET
         if (server)
@@ -488,9 +578,14 @@ void TryRunTics (void)
 #endif
           I_uSleep(ms_to_next_tick*1000);
       }
+#ifdef HAVE_NET
+      // only waits with a whole window of our tics built are stalls
+      if (server && maketic - gametic > net_ticwindow)
+        stallms += I_GetUptimeMS() - waitstart;
+#endif
       if (I_GetTime() - entertime > 10) {
 #ifdef HAVE_NET
-        if (server) {
+        if (server && !deltatics) {
           char buf[sizeof(packet_header_t)+1];
           remotesend--;
           packet_set((packet_header_t *)buf, PKT_RETRANS, remotetic);
@@ -538,6 +633,8 @@ static void D_QuitNetGame (void)
   int i;
 
   if (!server) return;
+  lprintf(LO_INFO, "D_QuitNetGame: waited %u ms for the server over %d tics (%.2f ms a tic)\n",
+          stallms, gametic, gametic ? (double)stallms / gametic : 0.0);
   buf[sizeof(packet_header_t)] = consoleplayer;
   packet_set(packet, PKT_QUIT, gametic);
 
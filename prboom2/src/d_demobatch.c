@@ -0,0 +1,442 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Batch demo regression runner.
+ *
+ *      -demobatch <manifest.csv> plays every demo listed in a manifest
+ *      in the format of tests/demo-testing.csv, running up to -jobs
+ *      engine processes at once with -nodraw -nosound, and reports
+ *      per-demo result, speed, final state hash (see p_checksum.c) and
+ *      exit level stats (see statdump.c).
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#include <fcntl.h>
+
+#include "SDL.h"
+
+#include "doomtype.h"
+#include "d_demobatch.h"
+#include "i_main.h"
+#include "i_system.h"
+#include "lprintf.h"
+#include "m_argv.h"
+#include "m_io.h"
+
+#define DB_MAXFIELDS 16
+
+// manifest columns we use; the rest (reason, bug refs) are informational
+enum {
+  db_iwad,
+  db_pwad,
+  db_demo,
+  db_expected,
+  db_numcolumns
+};
+
+static const char *db_column_names[db_numcolumns] = {
+  "IWAD", "PWAD", "Demo", "Final checksum"
+};
+
+typedef struct
+{
+  char *iwad;
+  char *pwad;
+  char *demo;
+  char *expected;     // optional final checksum the run must reproduce
+
+  char chkfile[PATH_MAX];
+  char statfile[PATH_MAX];
+
+#ifdef _WIN32
+  intptr_t pid;
+#else
+  pid_t pid;
+#endif
+  unsigned int starttime;
+  unsigned int endtime;
+  int status;
+} demojob_t;
+
+static demojob_t *jobs;
+static int numjobs;
+
+//
+// CSV parsing
+//
+// Splits one manifest line in place. Handles quoted fields with embedded
+// commas and "" escapes, which is all demo-testing.csv needs.
+//
+
+static int DB_SplitLine(char *line, char **fields, int maxfields)
+{
+  int n = 0;
+  char *in = line;
+
+  while (n < maxfields)
+  {
+    char *out = in;
+
+    fields[n++] = out;
+    if (*in == '"')
+    {
+      in++;
+      while (*in)
+      {
+        if (*in == '"' && in[1] == '"')
+        {
+          *out++ = '"';
+          in += 2;
+        }
+        else if (*in == '"')
+        {
+          in++;
+          break;
+        }
+        else
+          *out++ = *in++;
+      }
+    }
+    while (*in && *in != ',' && *in != '\n' && *in != '\r')
+      *out++ = *in++;
+
+    if (*in != ',')
+    {
+      *out = 0;
+      break;
+    }
+    *out = 0;
+    in++;
+  }
+  return n;
+}
+
+// prefer a file next to the manifest, otherwise let the engine search for it
+static char *DB_ResolvePath(const char *dir, const char *name)
+{
+  char *path;
+
+  if (!*name)
+    return NULL;
+
+  path = malloc(strlen(dir) + strlen(name) + 2);
+  sprintf(path, "%s/%s", dir, name);
+  if (M_access(path, R_OK) == 0)
+    return path;
+
+  strcpy(path, name);
+  return path;
+}
+
+static void DB_ReadManifest(const char *manifest)
+{
+  FILE *f;
+  char line[1024];
+  char *fields[DB_MAXFIELDS];
+  int column[db_numcolumns];
+  int numfields, i, j;
+  char *dir, *p;
+
+  if (!(f = M_fopen(manifest, "rb")))
+    I_Error("DB_ReadManifest: cannot open %s", manifest);
+
+  dir = strdup(manifest);
+  if ((p = strrchr(dir, '/')) || (p = strrchr(dir, '\\')))
+    *p = 0;
+  else
+    strcpy(dir, ".");
+
+  if (!fgets(line, sizeof(line), f))
+    I_Error("DB_ReadManifest: %s is empty", manifest);
+
+  numfields = DB_SplitLine(line, fields, DB_MAXFIELDS);
+  for (i = 0; i < db_numcolumns; i++)
+  {
+    column[i] = -1;
+    for (j = 0; j < numfields; j++)
+      if (!strcasecmp(fields[j], db_column_names[i]))
+        column[i] = j;
+  }
+  if (column[db_iwad] < 0 || column[db_demo] < 0)
+    I_Error("DB_ReadManifest: %s needs at least \"IWAD\" and \"Demo\" columns", manifest);
+
+  while (fgets(line, sizeof(line), f))
+  {
+    demojob_t *job;
+    const char *value[db_numcolumns];
+
+    numfields = DB_SplitLine(line, fields, DB_MAXFIELDS);
+    for (i = 0; i < db_numcolumns; i++)
+      value[i] = (column[i] >= 0 && column[i] < numfields) ? fields[column[i]] : "";
+
+    if (!*value[db_iwad] || !*value[db_demo])
+      continue;
+
+    jobs = realloc(jobs, (numjobs + 1) * sizeof(*jobs));
+    job = &jobs[numjobs];
+    memset(job, 0, sizeof(*job));
+    job->iwad = strdup(value[db_iwad]);
+    job->pwad = DB_ResolvePath(dir, value[db_pwad]);
+    job->demo = DB_ResolvePath(dir, value[db_demo]);
+    job->expected = *value[db_expected] ? strdup(value[db_expected]) : NULL;
+
+    doom_snprintf(job->chkfile, sizeof(job->chkfile), "%s/%s-batch-%d-%d.chk",
+      I_GetTempDir(), PACKAGE_TARNAME, (int)getpid(), numjobs);
+    doom_snprintf(job->statfile, sizeof(job->statfile), "%s/%s-batch-%d-%d.txt",
+      I_GetTempDir(), PACKAGE_TARNAME, (int)getpid(), numjobs);
+
+    numjobs++;
+  }
+
+  fclose(f);
+  free(dir);
+}
+
+//
+// Worker processes
+//
+
+static void DB_StartJob(demojob_t *job)
+{
+  const char *argv[32];
+  int argc = 0;
+
+  argv[argc++] = myargv[0];
+  argv[argc++] = "-iwad";
+  argv[argc++] = job->iwad;
+  if (job->pwad)
+  {
+    argv[argc++] = "-file";
+    argv[argc++] = job->pwad;
+  }
+  argv[argc++] = "-fastdemo";
+  argv[argc++] = job->demo;
+  argv[argc++] = "-nodraw";
+  argv[argc++] = "-nosound";
+  argv[argc++] = "-nomouse";
+  argv[argc++] = "-nojoy";
+  argv[argc++] = "-checksum";
+  argv[argc++] = job->chkfile;
+  argv[argc++] = "-statdump";
+  argv[argc++] = job->statfile;
+  argv[argc] = NULL;
+
+  job->starttime = SDL_GetTicks();
+
+#ifdef _WIN32
+  job->pid = _spawnv(_P_NOWAIT, myargv[0], argv);
+  if (job->pid == -1)
+    I_Error("DB_StartJob: cannot start %s", myargv[0]);
+#else
+  if ((job->pid = fork()) == -1)
+    I_Error("DB_StartJob: fork failed");
+
+  if (job->pid == 0)
+  {
+    // keep the workers' console output from interleaving with the report
+    int null = open("/dev/null", O_WRONLY);
+
+    if (null != -1)
+    {
+      dup2(null, 1);
+      dup2(null, 2);
+    }
+    execvp(myargv[0], (char * const *)argv);
+    _exit(-1);
+  }
+#endif
+}
+
+// waits for any worker to finish and returns its job
+static demojob_t *DB_WaitJob(void)
+{
+  int i;
+
+#ifdef _WIN32
+  HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+  int index[MAXIMUM_WAIT_OBJECTS];
+  int count = 0;
+  DWORD rc, code;
+
+  for (i = 0; i < numjobs && count < MAXIMUM_WAIT_OBJECTS; i++)
+  {
+    if (jobs[i].pid > 0 && !jobs[i].endtime)
+    {
+      index[count] = i;
+      handles[count++] = (HANDLE)jobs[i].pid;
+    }
+  }
+  if (!count)
+    return NULL;
+
+  rc = WaitForMultipleObjects(count, handles, FALSE, INFINITE);
+  if (rc < WAIT_OBJECT_0 || rc >= WAIT_OBJECT_0 + count)
+    return NULL;
+
+  i = index[rc - WAIT_OBJECT_0];
+  GetExitCodeProcess(handles[rc - WAIT_OBJECT_0], &code);
+  CloseHandle(handles[rc - WAIT_OBJECT_0]);
+  jobs[i].status = (int)code;
+#else
+  int status;
+  pid_t pid = wait(&status);
+
+  if (pid == -1)
+    return NULL;
+
+  for (i = 0; i < numjobs; i++)
+    if (jobs[i].pid == pid)
+      break;
+  if (i == numjobs)
+    return NULL;
+
+  jobs[i].status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+
+  jobs[i].endtime = SDL_GetTicks();
+  return &jobs[i];
+}
+
+//
+// Reporting
+//
+// The worker's -checksum stream gives the number of tics played and, via
+// its "final:" line, proof that the demo reached its end plus the hash of
+// the whole run. Exit code is not used, since -fastdemo always quits
+// through I_Error.
+//
+
+static dboolean DB_ReportJob(demojob_t *job)
+{
+  FILE *f;
+  char line[512];
+  char final[64] = "";
+  int tic = -1, lasttic = -1;
+  double seconds = (job->endtime - job->starttime) / 1000.0;
+  dboolean passed;
+
+  if ((f = M_fopen(job->chkfile, "rb")))
+  {
+    while (fgets(line, sizeof(line), f))
+    {
+      if (sscanf(line, "%d,", &tic) == 1)
+        lasttic = tic;
+      else if (!strncmp(line, "final: ", 7))
+        sscanf(line + 7, "%63s", final);
+    }
+    fclose(f);
+    M_remove(job->chkfile);
+  }
+
+  passed = *final && (!job->expected || !strcasecmp(final, job->expected));
+
+  lprintf(LO_INFO, "%s %s%s%s: %d tics, %.1f tics/sec, final %s\n",
+    passed ? "PASS" : "FAIL",
+    job->demo, job->pwad ? " with " : "", job->pwad ? job->pwad : "",
+    lasttic + 1, seconds > 0 ? (lasttic + 1) / seconds : 0.0,
+    *final ? final : "(demo did not finish)");
+
+  if (*final && job->expected && !passed)
+    lprintf(LO_INFO, "  expected final %s\n", job->expected);
+
+  if ((f = M_fopen(job->statfile, "rb")))
+  {
+    while (fgets(line, sizeof(line), f))
+      lprintf(LO_INFO, "  %s", line);
+    fclose(f);
+    M_remove(job->statfile);
+  }
+
+  return passed;
+}
+
+//
+// D_DemoBatch
+//
+// Runs the whole manifest and quits with a non-zero code if any demo failed.
+//
+
+void D_DemoBatch(const char *manifest)
+{
+  int maxworkers = SDL_GetCPUCount();
+  int next = 0, running = 0, failed = 0;
+  int p;
+
+  if ((p = M_CheckParm("-jobs")) && p < myargc-1)
+    maxworkers = atoi(myargv[p+1]);
+  if (maxworkers < 1)
+    maxworkers = 1;
+
+  DB_ReadManifest(manifest);
+
+  lprintf(LO_INFO, "D_DemoBatch: %d demo(s) from %s, %d worker(s)\n",
+    numjobs, manifest, maxworkers);
+
+  while (next < numjobs || running)
+  {
+    demojob_t *job;
+
+    while (next < numjobs && running < maxworkers)
+    {
+      DB_StartJob(&jobs[next++]);
+      running++;
+    }
+
+    if (!(job = DB_WaitJob()))
+      break;
+    running--;
+
+    if (!DB_ReportJob(job))
+      failed++;
+  }
+
+  lprintf(LO_INFO, "D_DemoBatch: %d passed, %d failed\n",
+    numjobs - failed, failed);
+
+  I_SafeExit(failed ? 1 : 0);
+}
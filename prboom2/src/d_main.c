@@ -67,6 +67,8 @@
 #include "m_misc.h"
 #include "m_menu.h"
 #include "p_checksum.h"
+#include "m_profile.h"
+#include "d_demobatch.h"
 #include "i_main.h"
 #include "i_system.h"
 #include "i_sound.h"
@@ -90,6 +92,7 @@
 //e6y
 #include "r_demo.h"
 #include "e6y.h"
+#include "g_demoseek.h"
 #ifdef USE_WINDOWS_LAUNCHER
 #include "e6y_launcher.h"
 #endif
@@ -198,7 +201,8 @@ void D_PostEvent(event_t *ev)
       else
       {
         // key_use is used for seeing the current frame
-        if (ev->data1 != key_use && ev->data1 != key_demo_skip)
+        if (ev->data1 != key_use && ev->data1 != key_demo_skip &&
+            ev->data1 != key_demo_rewind && ev->data1 != key_demo_fastforward)
         {
           return;
         }
@@ -425,9 +429,11 @@ void D_Display (fixed_t frac)
   HU_DrawDemoProgress(true); //e6y
 
   // normal update
-  if (!wipe)
+  if (!wipe) {
+    PROFILE_BEGIN(prof_blit);
     I_FinishUpdate ();              // page flip or blit buffer
-  else {
+    PROFILE_END(prof_blit);
+  } else {
     // wipe update
     wipe_EndScreen();
     D_Wipe();
@@ -1633,6 +1639,14 @@ static void D_DoomMainSetup(void)
     } while (rsp_found==true);
   }
 
+  // compare two -checksum streams and quit, no game data needed
+  if ((p = M_CheckParm ("-checksumdiff")) && p < myargc-2)
+    P_CompareChecksums(myargv[p+1], myargv[p+2]);
+
+  // play a whole manifest of demos in worker processes and quit
+  if ((p = M_CheckParm ("-demobatch")) && p < myargc-1)
+    D_DemoBatch(myargv[p+1]);
+
   // e6y: moved to main()
   /*
   lprintf(LO_INFO,"M_LoadDefaults: Load system defaults.\n");
@@ -1837,6 +1851,14 @@ static void D_DoomMainSetup(void)
   nodrawers = M_CheckParm ("-nodraw");
   noblit = M_CheckParm ("-noblit");
 
+#ifdef HEADLESS
+  // nothing to see or hear; time the playsim instead
+  nomusicparm = nosfxparm = true;
+  nodrawers = noblit = true;
+  profiling = true;
+#endif
+  M_ProfileInit();
+
   //proff 11/22/98: Added setting of viewangleoffset
   p = M_CheckParm("-viewangle");
   if (p && p < myargc-1)
@@ -2144,6 +2166,12 @@ static void D_DoomMainSetup(void)
   lprintf(LO_INFO,"R_Init: Init DOOM refresh daemon - ");
   R_Init();
 
+  if (M_CheckParm("-benchdrawers"))
+  {
+    R_BenchmarkDrawers();
+    I_SafeExit(0);
+  }
+
   //jff 9/3/98 use logical output routine
   lprintf(LO_INFO,"\nP_Init: Init Playloop state.\n");
   P_Init();
@@ -2156,6 +2184,12 @@ static void D_DoomMainSetup(void)
   lprintf(LO_INFO,"S_Init: Setting up sound.\n");
   S_Init(snd_SfxVolume /* *8 */, snd_MusicVolume /* *8*/ );
 
+  if (M_CheckParm("-benchsound"))
+  {
+    I_BenchmarkSound();
+    I_SafeExit(0);
+  }
+
   //jff 9/3/98 use logical output routine
   lprintf(LO_INFO,"HU_Init: Setting up heads up display.\n");
   HU_Init();
@@ -2163,11 +2197,13 @@ static void D_DoomMainSetup(void)
   if (!(M_CheckParm("-nodraw") && M_CheckParm("-nosound")))
     I_InitGraphics();
 
+#ifndef HEADLESS
   // NSM
   if ((p = M_CheckParm("-viddump")) && (p < myargc-1))
   {
     I_CapturePrep(myargv[p + 1]);
   }
+#endif
 
   //jff 9/3/98 use logical output routine
   lprintf(LO_INFO,"ST_Init: Init status bar.\n");
@@ -2206,7 +2242,13 @@ static void D_DoomMainSetup(void)
       P_RecordChecksum (myargv[p]);
     }
 
-  if ((p = M_CheckParm ("-fastdemo")) && ++p < myargc)
+  p = M_CheckParm("-fastdemo");
+#ifdef HEADLESS
+  // there is no display to keep pace with
+  if (!p && !(p = M_CheckParm("-timedemo")))
+    p = M_CheckParm("-playdemo");
+#endif
+  if (p && ++p < myargc)
     {                                 // killough
       fastdemo = true;                // run at fastest speed possible
       timingdemo = true;              // show stats after quit
@@ -2269,6 +2311,8 @@ void D_DoomMain(void)
 {
   D_DoomMainSetup(); // CPhipps - setup out of main execution stack
 
+  W_ReportStats("startup");
+
   D_DoomLoop ();  // never returns
 }
 
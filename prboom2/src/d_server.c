@@ -198,7 +198,7 @@ getopt(nargc, nargv, ostr)
 #endif
 
 #define MAXPLAYERS 4
-#define BACKUPTICS 12
+#define BACKUPTICS 128
 
 // Dummies to forfill l_udp.c unused client stuff
 int M_CheckParm(const char* p) { p = NULL; return 1; }
@@ -214,24 +214,65 @@ void NORETURN I_Error(const char *error, ...) // killough 3/20/98: add const
   exit(-1);
 }
 
-int playerjoingame[MAXPLAYERS], playerleftgame[MAXPLAYERS];
-UDP_CHANNEL remoteaddr[MAXPLAYERS];
-enum { pc_unused, pc_connected, pc_ready, pc_confirmedready, pc_playing, pc_quit } playerstate[MAXPLAYERS];
-int displaycounter;
-
-dboolean n_players_in_state(int n, int ps) {
+enum playerstate_e { pc_unused, pc_connected, pc_ready, pc_confirmedready, pc_playing, pc_quit };
+
+/* One game; the server runs -g of them, each on its own UDP port
+ * counting up from the -p port, and waits on all their sockets at once */
+typedef struct {
+  UDP_SOCKET socket;
+  Uint16 port;
+  struct setup_packet_s setupinfo;
+  int playerjoingame[MAXPLAYERS], playerleftgame[MAXPLAYERS];
+  UDP_CHANNEL remoteaddr[MAXPLAYERS];
+  enum playerstate_e playerstate[MAXPLAYERS];
+  int remoteticfrom[MAXPLAYERS];
+  int remoteticto[MAXPLAYERS];
+  int backoffcounter[MAXPLAYERS];
+  dboolean deltaclient[MAXPLAYERS];
+  dboolean sendnow[MAXPLAYERS];
+  int lastsent[MAXPLAYERS]; // end of the tics sent to each player so far
+  int curplayers;
+  int confirming;
+  dboolean ingame;
+  int exectics; // gametics completed
+  int displaycounter;
+  ticcmd_t netcmds[MAXPLAYERS][BACKUPTICS];
+
+  /* Counters, cleared by each -S report */
+  unsigned int packetsin, packetsout;
+  unsigned int resent;     // tics sent to a player again
+  unsigned int resendreqs; // PKT_RETRANS sent or received
+  int queuedepth;          // most tics held back for the slowest player
+} game_t;
+
+game_t *games;
+int numgames = 1;
+int numplayers = 2, xtratics = 0;
+char**wadname = NULL;
+char**wadget = NULL;
+int numwads = 0;
+
+dboolean n_players_in_state(game_t *g, int n, int ps) {
 	int i,j;
 	for (i=j=0;i<MAXPLAYERS;i++)
-		if (playerstate[i] == ps) j++;
+		if (g->playerstate[i] == ps) j++;
 	return (j == n);
 }
 
-void BroadcastPacket(packet_header_t *packet, size_t len)
+// Queues a packet for player n; they go out together when the game has
+// been run, see I_FlushPackets
+void SendPacketTo(game_t *g, int n, packet_header_t *packet, size_t len)
+{
+  I_QueuePacketTo(packet, len, &g->remoteaddr[n]);
+  g->packetsout++;
+}
+
+void BroadcastPacket(game_t *g, packet_header_t *packet, size_t len)
 {
   int i;
   for (i=0; i<MAXPLAYERS; i++)
-    if (playerstate[i] != pc_unused && playerstate[i] != pc_quit)
-      I_SendPacketTo(packet, len, &remoteaddr[i]);
+    if (g->playerstate[i] != pc_unused && g->playerstate[i] != pc_quit)
+      SendPacketTo(g, i, packet, len);
 }
 
 byte def_game_options[GAME_OPTIONS_SIZE] = \
@@ -278,33 +319,62 @@ void NORETURN sig_handler(int signum)
 void doexit(void)
 {
   packet_header_t packet;
+  int i;
 
   // Send "downed" packet
   packet_set(&packet, PKT_DOWN, 0);
-  BroadcastPacket(&packet, sizeof packet);
+  for (i=0; i<numgames; i++) {
+    udp_socket = games[i].socket;
+    BroadcastPacket(&games[i], &packet, sizeof packet);
+    I_FlushPackets();
+  }
 }
 
-#ifndef USE_SDL_NET
-static void I_InitSockets(int v4port)
-{
-  v4socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
-  I_SetupSocket(v4socket, v4port, AF_INET);
-}
-#else
-static void I_InitSockets(Uint16 port)
+static UDP_SOCKET I_InitSockets(Uint16 port)
 {
-  I_InitNetwork();
-  udp_socket = I_Socket(port);
-  if (!udp_socket) I_Error("I_InitSockets: failed to open UDP port %d\n",port);
+  UDP_SOCKET sock = I_Socket(port);
+  if (!sock) I_Error("I_InitSockets: failed to open UDP port %d\n",port);
+  return sock;
 }
-#endif
 
 long int ptic(packet_header_t* p)
 {
     return doom_ntohl(p->tic);
 }
 
+// Send player n tics from to lowtic as a PKT_DTICS, with the next of its
+// own tics we need as the acknowledgement
+void SendDeltaTics(game_t *g, int n, int from, int lowtic)
+{
+  int tics = MIN(MAX(lowtic - from, 0), 128);
+  packet_header_t *packet = malloc(sizeof(packet_header_t) + 5 +
+         tics * (1 + MAXPLAYERS * TD_MAXSIZE));
+  byte *p = (void*)(packet+1);
+  ticcmd_t prev[MAXPLAYERS];
+  int tic;
+
+  packet_set(packet, PKT_DTICS, from);
+  p = WriteTicNum(p, g->remoteticfrom[n]);
+  *p++ = tics;
+  memset(prev, 0, sizeof(prev));
+  for (tic = from; tic < from + tics; tic++) {
+    int j;
+    byte *players = p++;
+
+    *players = 0;
+    for (j=0; j<MAXPLAYERS; j++)
+      if ((g->playerjoingame[j] <= tic) && (g->playerleftgame[j] > tic)) {
+        ticcmd_t cmd;
 
+        RawToTic(&cmd, &g->netcmds[j][tic%BACKUPTICS]);
+        p = WriteTicDelta(p, &prev[j], &cmd);
+        prev[j] = cmd;
+        *players |= 1 << j;
+      }
+  }
+  SendPacketTo(g, n, packet, p - ((byte*)packet));
+  free(packet);
+}
 
 void read_config_file(FILE* fp, struct setup_packet_s* sp)
 {
@@ -336,145 +406,51 @@ void read_config_file(FILE* fp, struct setup_packet_s* sp)
 
 static int badplayer(int n) { return (n < 0 || n >= MAXPLAYERS); }
 
-int main(int argc, char** argv)
-{
-#ifndef USE_SDL_NET
-  int localport = 5030;
-#else
-  Uint16 localport = 5030;
-#endif
-  int numplayers = 2, xtratics = 0, ticdup = 1;
-  int exectics = 0; // gametics completed
-  struct setup_packet_s setupinfo = { 2, 0, 1, 1, 1, 0, best_compatibility, 0, 0};
-  char**wadname = NULL;
-  char**wadget = NULL;
-  int numwads = 0;
-  {
-    int opt;
-    byte *gameopt = setupinfo.game_options;
-
-    memcpy(gameopt, &def_game_options, sizeof (setupinfo.game_options));
-    while ((opt = getopt(argc, argv, "c:t:x:p:e:l:adrfns:N:vw:")) != EOF)
-      switch (opt) {
-      case 'c':
-        {
-	  FILE *cf = fopen(optarg,"r");
-	  if (!cf) { perror("fopen"); return -1; }
-	  read_config_file(cf,&setupinfo);
-	  fclose(cf);
-	}
-	break;
-      case 't':
-  if (optarg) ticdup = atoi(optarg);
-  break;
-      case 'x':
-  if (optarg) xtratics = atoi(optarg);
-  break;
-      case 'p':
-  if (optarg) localport = atoi(optarg);
-  break;
-      case 'e':
-  if (optarg) setupinfo.episode = atoi(optarg);
-  break;
-      case 'l':
-  if (optarg) setupinfo.level = atoi(optarg);
-  break;
-      case 'a':
-  setupinfo.deathmatch = 2;
-  break;
-      case 'd':
-  setupinfo.deathmatch = 1;
-  break;
-      case 'r':
-  setupinfo.game_options[6] = 1;
-  break;
-      case 'f':
-  setupinfo.game_options[7] = 1;
-  break;
-      case 'n':
-  setupinfo.game_options[8] = 1;
-  break;
-      case 's':
-  if (optarg) setupinfo.skill = atoi(optarg)-1;
-  break;
-      case 'N':
-  if (optarg) setupinfo.players = numplayers = atoi(optarg);
-  break;
-      case 'v':
-  verbose++;
-  break;
-      case 'w':
-  if (optarg) {
-    char *p;
-    wadname = realloc(wadname, ++numwads * sizeof *wadname);
-    wadget  = realloc(wadget ,   numwads * sizeof *wadget );
-    wadname[numwads-1] = strdup(optarg);
-    if ((p = strchr(wadname[numwads-1], ','))) {
-      *p++ = 0; wadget[numwads-1] = p;
-    } else wadget[numwads-1] = NULL;
-  }
-  break;
-      }
-  }
-
-  setupinfo.ticdup = ticdup; setupinfo.extratic = xtratics;
-  { /* Random number seed
-     * Mirrors the corresponding code in G_ReadOptions */
-    int rngseed = (int)time(NULL);
-    setupinfo.game_options[13] = rngseed & 0xff;
-    rngseed >>= 8;
-    setupinfo.game_options[12] = rngseed & 0xff;
-    rngseed >>= 8;
-    setupinfo.game_options[11] = rngseed & 0xff;
-    rngseed >>= 8;
-    setupinfo.game_options[10] = rngseed & 0xff;
-  }
-  I_InitSockets(localport);
-
-  printf("Listening on port %d, waiting for %d players\n", localport, numplayers);
+static void SetRandomSeed(struct setup_packet_s* sp, int rngseed)
+{ /* Random number seed
+   * Mirrors the corresponding code in G_ReadOptions */
+  sp->game_options[13] = rngseed & 0xff;
+  rngseed >>= 8;
+  sp->game_options[12] = rngseed & 0xff;
+  rngseed >>= 8;
+  sp->game_options[11] = rngseed & 0xff;
+  rngseed >>= 8;
+  sp->game_options[10] = rngseed & 0xff;
+}
 
-  { // no players initially
-    int i;
-    for (i=0; i<MAXPLAYERS; i++) {
-      playerjoingame[i] = INT_MAX;
-      playerleftgame[i] = 0;
-      playerstate[i] = pc_unused;
-    }
+// Empty the game, ready for players to join
+static void ResetGame(game_t *g)
+{
+  int i;
 
-    // Print wads
-    for (i=0; i<numwads; i++)
-      printf("Wad %s (%s)\n", wadname[i], wadget[i] ? wadget[i] : "");
+  for (i=0; i<MAXPLAYERS; i++) {
+    if (g->playerstate[i] != pc_unused)
+      I_UnRegisterPlayer(g->remoteaddr[i]);
+    g->playerjoingame[i] = INT_MAX;
+    g->playerleftgame[i] = 0;
+    g->playerstate[i] = pc_unused;
+    g->remoteticfrom[i] = g->remoteticto[i] = 0;
+    g->backoffcounter[i] = g->lastsent[i] = 0;
+    g->deltaclient[i] = g->sendnow[i] = false;
   }
+  g->curplayers = g->confirming = g->exectics = 0;
+  g->ingame = false;
+  SetRandomSeed(&g->setupinfo, (int)time(NULL) + (int)(g - games));
+}
 
-  // Exit and signal handling
-  atexit(doexit); // heh
-  signal(SIGTERM, sig_handler);
-  signal(SIGINT , sig_handler);
-#ifndef USE_SDL_NET
-  signal(SIGQUIT, sig_handler);
-  signal(SIGKILL, sig_handler);
-  signal(SIGHUP , sig_handler);
-#endif
-
-  {
-    int remoteticfrom[MAXPLAYERS] = { 0, 0, 0, 0 };
-    int remoteticto[MAXPLAYERS] = { 0, 0, 0, 0 };
-    int backoffcounter[MAXPLAYERS] = { 0, 0, 0, 0 };
-    int curplayers = 0;
-    int confirming = 0;
-    dboolean ingame = false;
-    ticcmd_t netcmds[MAXPLAYERS][BACKUPTICS];
-
-    while (1) {
-  packet_header_t *packet = malloc(10000);
-  size_t len;
+// Count the tics from to to that player n has been sent before
+static void CountSentTics(game_t *g, int n, int from, int to)
+{
+  g->resent += MAX(MIN(g->lastsent[n], to) - from, 0);
+  g->lastsent[n] = MAX(g->lastsent[n], to);
+}
 
-  I_WaitForPacket(120*1000);
-  while ((len = I_GetPacket(packet, 10000))) {
+static void ProcessPacket(game_t *g, packet_header_t *packet, size_t len)
+{
     if (verbose>2) printf("Received packet:");
     switch (packet->type) {
     case PKT_INIT:
-      if (!ingame) {
+      if (!g->ingame) {
         {
     int n;
     struct setup_packet_s *sinfo = (void*)(packet+1);
@@ -482,56 +458,54 @@ int main(int argc, char** argv)
     /* Find player number and add to the game */
     n = *(short*)(packet+1);
 
-    if (badplayer(n) || playerstate[n] != pc_unused)
+    if (badplayer(n) || g->playerstate[n] != pc_unused)
      for (n=0; n<numplayers; n++)
-      if (playerstate[n] == pc_unused) break;
+      if (g->playerstate[n] == pc_unused) break;
 
     if (n == numplayers) break; // Full game
-    playerstate[n] = pc_connected;
-#ifndef USE_SDL_NET
-    remoteaddr[n] = sentfrom;
-#else
-    if (sentfrom==-1)
-      remoteaddr[n]=I_RegisterPlayer(&sentfrom_addr);
-#endif
+    g->playerstate[n] = pc_connected;
+    // A channel per player slot, so games on other sockets can't run out
+    g->remoteaddr[n] = I_RegisterPlayer(&sentfrom_addr, n);
 
     printf("Join by ");
-    I_PrintAddress(stdout, &remoteaddr[n]);
-#ifdef USE_SDL_NET
-    printf(" (channel %d)",remoteaddr[n]);
-#endif
-    printf(" as player %d\n",n);
+    I_PrintAddress(stdout, &g->remoteaddr[n]);
+    printf(" (channel %d)",g->remoteaddr[n]);
+    printf(" as player %d",n);
+    if (numgames > 1) printf(" on port %d", g->port);
+    printf("\n");
     {
       int i;
       size_t extrabytes = 0;
       // Send setup packet
       packet_set(packet, PKT_SETUP, 0);
-      memcpy(sinfo, &setupinfo, sizeof setupinfo);
+      memcpy(sinfo, &g->setupinfo, sizeof g->setupinfo);
       sinfo->yourplayer = n;
       sinfo->numwads = numwads;
       for (i=0; i<numwads; i++) {
         strcpy(sinfo->wadnames + extrabytes, wadname[i]);
         extrabytes += strlen(wadname[i]) + 1;
       }
-      I_SendPacketTo(packet, sizeof *packet + sizeof setupinfo + extrabytes,
-         remoteaddr+n);
+      sinfo->wadnames[extrabytes++] = NETFLAG_DELTATICS;
+      I_SendPacketTo(packet, sizeof *packet + sizeof g->setupinfo + extrabytes,
+         g->remoteaddr+n);
       I_uSleep(10000);
-      I_SendPacketTo(packet, sizeof *packet + sizeof setupinfo + extrabytes,
-         remoteaddr+n);
+      I_SendPacketTo(packet, sizeof *packet + sizeof g->setupinfo + extrabytes,
+         g->remoteaddr+n);
+      g->packetsout += 2;
     }
         }
       }
       break;
     case PKT_GO:
-      if (!ingame) {
+      if (!g->ingame) {
         int from = *(byte*)(packet+1);
 
-	if (badplayer(from) || playerstate[from] == pc_unused) break;
-	if (confirming) {
-		if (playerstate[from] != pc_confirmedready) curplayers++;
-		playerstate[from] = pc_confirmedready;
+	if (badplayer(from) || g->playerstate[from] == pc_unused) break;
+	if (g->confirming) {
+		if (g->playerstate[from] != pc_confirmedready) g->curplayers++;
+		g->playerstate[from] = pc_confirmedready;
 	} else
-		playerstate[from] = pc_ready;
+		g->playerstate[from] = pc_ready;
       }
       break;
     case PKT_TICC:
@@ -543,26 +517,53 @@ int main(int argc, char** argv)
 
         if (verbose>2)
             printf("tics %ld - %ld from %d\n", ptic(packet), ptic(packet) + tics - 1, from);
-        if (ptic(packet) > remoteticfrom[from]) {
+        if (ptic(packet) > g->remoteticfrom[from]) {
             // Missed tics, so request a resend
-            packet_set(packet, PKT_RETRANS, remoteticfrom[from]);
-            I_SendPacketTo(packet, sizeof *packet, remoteaddr+from);
+            packet_set(packet, PKT_RETRANS, g->remoteticfrom[from]);
+            SendPacketTo(g, from, packet, sizeof *packet);
+            g->resendreqs++;
         } else {
             ticcmd_t *newtic = (void*)(((byte*)(packet+1))+2);
-            if (ptic(packet) + tics < remoteticfrom[from]) break; // Won't help
-            remoteticfrom[from] = ptic(packet);
+            if (ptic(packet) + tics < g->remoteticfrom[from]) break; // Won't help
+            g->remoteticfrom[from] = ptic(packet);
             while (tics--)
-              netcmds[from][remoteticfrom[from]++%BACKUPTICS] =  *newtic++;
+              g->netcmds[from][g->remoteticfrom[from]++%BACKUPTICS] =  *newtic++;
         }
       }
       break;
+    case PKT_DTICC:
+      {
+        const byte *p = (const byte*)(packet+1);
+        const byte *end = (const byte*)packet + len;
+        int from, tic, tics;
+        ticcmd_t cmd;
+
+        if (len < sizeof *packet + 6) break;
+        from = p[0];
+	if (badplayer(from)) break;
+        g->deltaclient[from] = g->sendnow[from] = true;
+        g->remoteticto[from] = MAX(g->remoteticto[from], ReadTicNum(p+1));
+        tics = p[5];
+        p += 6;
+
+        if (verbose>2)
+            printf("delta tics %ld - %ld from %d\n", ptic(packet), ptic(packet) + tics - 1, from);
+        // Missed some; the ack we send tells the client where to resume
+        if ((tic = ptic(packet)) > g->remoteticfrom[from]) break;
+        memset(&cmd, 0, sizeof(cmd));
+        while (tics-- && (p = ReadTicDelta(p, end, &cmd)))
+          if (tic++ == g->remoteticfrom[from])
+            TicToRaw(&g->netcmds[from][g->remoteticfrom[from]++%BACKUPTICS], &cmd);
+      }
+      break;
     case PKT_RETRANS:
       {
         int from = *(byte*)(packet+1);
 	if (badplayer(from)) break;
 
         if (verbose>2) printf("%d requests resend from %ld\n", from, ptic(packet));
-        remoteticto[from] = ptic(packet);
+        g->remoteticto[from] = ptic(packet);
+        g->resendreqs++;
       }
       break;
     case PKT_QUIT:
@@ -570,23 +571,28 @@ int main(int argc, char** argv)
         int from = *(byte*)(packet+1);
 	if (badplayer(from)) break;
 
-	if (!ingame && playerstate[from] != pc_unused) {
+	if (!g->ingame && g->playerstate[from] != pc_unused) {
 	  // If we already got a PKT_GO, we have to remove this player frmo the count of ready players. And we then flag this player slot as vacant.
 	  printf("player %d pulls out\n", from);
-	  if (playerstate[from] == pc_confirmedready) curplayers--;
-	  playerstate[from] = pc_unused;
+	  if (g->playerstate[from] == pc_confirmedready) g->curplayers--;
+	  g->playerstate[from] = pc_unused;
+	  I_UnRegisterPlayer(g->remoteaddr[from]);
 	} else
-        if (playerleftgame[from] == INT_MAX) { // In the game
-	  playerleftgame[from] = ptic(packet);
-	  --curplayers;
-	  if (verbose) printf("%d quits at %ld (%d left)\n", from, ptic(packet),curplayers);
-	  if (ingame && !curplayers) exit(0); // All players have exited
+        if (g->playerleftgame[from] == INT_MAX) { // In the game
+	  g->playerleftgame[from] = ptic(packet);
+	  --g->curplayers;
+	  if (verbose) printf("%d quits at %ld (%d left)\n", from, ptic(packet),g->curplayers);
+	  if (g->ingame && !g->curplayers) { // All players have exited
+	    if (numgames == 1) exit(0);
+	    printf("Game on port %d over, waiting for players\n", g->port);
+	    ResetGame(g);
+	  }
         }
       }
       // fallthrough
       // and broadcast it
     case PKT_EXTRA:
-      BroadcastPacket(packet, len);
+      BroadcastPacket(g, packet, len);
       if (packet->type == PKT_EXTRA) {
         if (verbose>2) printf("misc from %d\n", *(((byte*)(packet+1))+1));
       }
@@ -599,7 +605,7 @@ int main(int argc, char** argv)
         size_t size = sizeof(packet_header_t);
         packet_header_t *reply;
 
-	if (badplayer(from) || playerstate[from] != pc_unused) break;
+	if (badplayer(from) || g->playerstate[from] != pc_unused) break;
 
         if (verbose) printf("Request for %s ", name);
         for (i=0; i<numwads; i++)
@@ -609,7 +615,7 @@ int main(int argc, char** argv)
         if ((i==numwads) || !wadget[i]) {
     if (verbose) printf("n/a\n");
     *(char*)(packet+1) = 0;
-    I_SendPacketTo(packet, size+1, remoteaddr + from);
+    SendPacketTo(g, from, packet, size+1);
         } else {
     size += strlen(wadname[i]) + strlen(wadget[i]) + 2;
     reply = malloc(size);
@@ -617,7 +623,7 @@ int main(int argc, char** argv)
     strcpy((char*)(reply+1), wadname[i]);
     strcpy((char*)(reply+1) + strlen(wadname[i]) + 1, wadget[i]);
     printf("sending %s\n", wadget[i]);
-    I_SendPacketTo(reply, size, remoteaddr + from);
+    SendPacketTo(g, from, reply, size);
     free(reply);
         }
       }
@@ -626,109 +632,140 @@ int main(int argc, char** argv)
       printf("Unrecognised packet type %d\n", packet->type);
       break;
     }
-  }
-  free(packet);
-  if (!ingame && n_players_in_state(numplayers,pc_confirmedready)) {
+}
+
+// Start, confirm and send out the tics of a game after its packets have
+// been read
+static void RunGame(game_t *g)
+{
+  packet_header_t *packet;
+
+  if (!g->ingame && n_players_in_state(g, numplayers,pc_confirmedready)) {
     int i;
     packet_header_t gopacket;
     packet = &gopacket;
-    ingame=true;
-    printf("All players joined, beginning game.\n");
+    g->ingame=true;
+    printf("All players joined, beginning game");
+    if (numgames > 1) printf(" on port %d", g->port);
+    printf(".\n");
     for (i=0; i<MAXPLAYERS; i++) {
-      if (playerstate[i] == pc_confirmedready) {
-	      playerjoingame[i] = 0;
-	      playerleftgame[i] = INT_MAX;
-	      playerstate[i] = pc_playing;
+      if (g->playerstate[i] == pc_confirmedready) {
+	      g->playerjoingame[i] = 0;
+	      g->playerleftgame[i] = INT_MAX;
+	      g->playerstate[i] = pc_playing;
       }
     }
     packet_set(packet, PKT_GO, 0);
-    BroadcastPacket(packet, sizeof *packet);
+    BroadcastPacket(g, packet, sizeof *packet);
+    I_FlushPackets();
     I_uSleep(10000);
-    BroadcastPacket(packet, sizeof *packet);
+    BroadcastPacket(g, packet, sizeof *packet);
+    I_FlushPackets();
     I_uSleep(10000);
   }
-  if (confirming && !--confirming && !ingame) {
+  if (g->confirming && !--g->confirming && !g->ingame) {
     int i;
-    curplayers = 0;
+    g->curplayers = 0;
     for (i=0; i<MAXPLAYERS; i++) {
-      if (playerstate[i] == pc_ready) {
-	      playerstate[i] = pc_unused;
+      if (g->playerstate[i] == pc_ready) {
+	      g->playerstate[i] = pc_unused;
+	      I_UnRegisterPlayer(g->remoteaddr[i]);
 	      printf("Player %d dropped, no PKT_GO received in confirmation\n", i);
       }
-      if (playerstate[i] == pc_confirmedready) playerstate[i] = pc_ready;
+      if (g->playerstate[i] == pc_confirmedready) g->playerstate[i] = pc_ready;
     }
   }
-  if (!ingame && n_players_in_state(numplayers,pc_ready)) {
+  if (!g->ingame && n_players_in_state(g, numplayers,pc_ready)) {
 	  printf("All players ready, now confirming.\n");
-	  confirming = 100;
+	  g->confirming = 100;
   }
 
-  if (ingame) { // Run some tics
-  int lowtic = INT_MAX;
+  if (g->ingame) { // Run some tics
+  int lowtic = INT_MAX, hightic = 0;
   int i;
   for (i=0; i<MAXPLAYERS; i++)
-    if (playerstate[i] == pc_playing || playerstate[i] == pc_quit) {
-      if (remoteticfrom[i] < playerleftgame[i]-1 && remoteticfrom[i]<lowtic)
-        lowtic = remoteticfrom[i];
+    if (g->playerstate[i] == pc_playing || g->playerstate[i] == pc_quit) {
+      if (g->remoteticfrom[i] < g->playerleftgame[i]-1 && g->remoteticfrom[i]<lowtic)
+        lowtic = g->remoteticfrom[i];
+      hightic = MAX(hightic, g->remoteticfrom[i]);
     }
 
-  if (verbose>1) printf("%d new tics can be run\n", lowtic - exectics);
+  if (verbose>1) printf("%d new tics can be run\n", lowtic - g->exectics);
 
-  if (lowtic > exectics)
-    exectics = lowtic; // count exec'ed tics
+  if (lowtic > g->exectics)
+    g->exectics = lowtic; // count exec'ed tics
+  if (lowtic != INT_MAX)
+    g->queuedepth = MAX(g->queuedepth, hightic - lowtic);
   // Now send all tics up to lowtic
   for (i=0; i<MAXPLAYERS; i++)
-    if (playerstate[i] == pc_playing) {
+    if (g->playerstate[i] == pc_playing) {
       int tics;
-      if (lowtic <= remoteticto[i]) continue;
-      if ((remoteticto[i] -= xtratics) < 0) remoteticto[i] = 0;
-      tics = MIN(lowtic - remoteticto[i], 128); // limit number of sent tics (CVE-2019-20797)
+      if (g->deltaclient[i]) {
+        // Everything it has not acknowledged, each time
+        if (g->sendnow[i] || lowtic > g->lastsent[i]) {
+          int from = MAX(g->remoteticto[i], lowtic - 128);
+
+          if (verbose>1) printf("sending tics %d - %d to %d\n", from, lowtic - 1, i);
+          SendDeltaTics(g, i, from, lowtic);
+          CountSentTics(g, i, from, lowtic);
+          g->sendnow[i] = false;
+        }
+      } else {
+      if (lowtic <= g->remoteticto[i]) continue;
+      if ((g->remoteticto[i] -= xtratics) < 0) g->remoteticto[i] = 0;
+      tics = MIN(lowtic - g->remoteticto[i], 128); // limit number of sent tics (CVE-2019-20797)
+      CountSentTics(g, i, g->remoteticto[i], g->remoteticto[i] + tics);
       {
         byte *p;
         packet = malloc(sizeof(packet_header_t) + 1 +
          tics * (1 + numplayers * (1 + sizeof(ticcmd_t))));
         p = (void*)(packet+1);
-        packet_set(packet, PKT_TICS, remoteticto[i]);
+        packet_set(packet, PKT_TICS, g->remoteticto[i]);
         *p++ = tics;
         if (verbose>1) printf("sending %d tics to %d\n", tics, i);
         while (tics--) {
     int j, playersthistic = 0;
     byte *q = p++;
     for (j=0; j<MAXPLAYERS; j++)
-      if ((playerjoingame[j] <= remoteticto[i]) &&
-          (playerleftgame[j] > remoteticto[i])) {
+      if ((g->playerjoingame[j] <= g->remoteticto[i]) &&
+          (g->playerleftgame[j] > g->remoteticto[i])) {
         *p++ = j;
-        memcpy(p, &netcmds[j][remoteticto[i]%BACKUPTICS], sizeof(ticcmd_t));
+        memcpy(p, &g->netcmds[j][g->remoteticto[i]%BACKUPTICS], sizeof(ticcmd_t));
         p += sizeof(ticcmd_t);
         playersthistic++;
       }
     *q = playersthistic;
-    remoteticto[i]++;
+    g->remoteticto[i]++;
         }
-        I_SendPacketTo(packet, p - ((byte*)packet), remoteaddr+i);
+        SendPacketTo(g, i, packet, p - ((byte*)packet));
         free(packet);
       }
+      }
       {
-        if (remoteticfrom[i] == remoteticto[i]) {
-	  backoffcounter[i] = 0;
-	} else if (remoteticfrom[i] > remoteticto[i]+1) {
-	  if ((backoffcounter[i] += remoteticfrom[i] - remoteticto[i] - 1) > 35) {
-	    packet_header_t *packet = malloc(sizeof(packet_header_t));
-	    packet_set(packet, PKT_BACKOFF, remoteticto[i]);
-	    I_SendPacketTo(packet,sizeof *packet,remoteaddr+i);
-	    backoffcounter[i] = 0;
+        // A delta client's remoteticto is its ack, a round trip behind what
+        // it has been sent, so measure how far ahead it is against lastsent
+        int sentto = g->deltaclient[i] ? g->lastsent[i] : g->remoteticto[i];
+
+        if (g->remoteticfrom[i] == sentto) {
+	  g->backoffcounter[i] = 0;
+	} else if (g->remoteticfrom[i] > sentto+1) {
+	  if ((g->backoffcounter[i] += g->remoteticfrom[i] - sentto - 1) > 35) {
+	    packet_header_t backoff;
+	    packet_set(&backoff, PKT_BACKOFF, sentto);
+	    SendPacketTo(g, i, &backoff, sizeof backoff);
+	    g->backoffcounter[i] = 0;
 	    if (verbose) printf("telling client %d to back off\n",i);
-	    free(packet);
 	  }
 	}
       }
     }
   }
-      if (!((ingame ? 0xff : 0xf) & displaycounter++)) { 
+      if (!((g->ingame ? 0xff : 0xf) & g->displaycounter++)) {
         int i;
+        if (numgames > 1) fprintf(stderr,"Port %d: ", g->port);
         fprintf(stderr,"Player states: [");
         for (i=0;i<MAXPLAYERS;i++) {
-            switch (playerstate[i]) {
+            switch (g->playerstate[i]) {
                 case pc_unused: fputc(' ',stderr); break;
                 case pc_connected: fputc('c',stderr); break;
                 case pc_ready: fputc('r',stderr); break;
@@ -739,6 +776,181 @@ int main(int argc, char** argv)
         }
         fprintf(stderr,"]\n");
       }
+}
+
+static void PrintStats(game_t *g, unsigned int ms)
+{
+  double secs = ms / 1000.0;
+
+  printf("Port %d: %.1f packets/s in, %.1f packets/s out, %u tics resent, "
+         "%u resend requests, queue depth %d\n", g->port,
+         g->packetsin / secs, g->packetsout / secs, g->resent,
+         g->resendreqs, g->queuedepth);
+  g->packetsin = g->packetsout = g->resent = g->resendreqs = 0;
+  g->queuedepth = 0;
+}
+
+int main(int argc, char** argv)
+{
+  Uint16 localport = 5030;
+  int ticdup = 1;
+  int statsinterval = 0;
+  struct setup_packet_s setupinfo = { 2, 0, 1, 1, 1, 0, best_compatibility, 0, 0};
+  UDP_SOCKET *sockets;
+  {
+    int opt;
+    byte *gameopt = setupinfo.game_options;
+
+    memcpy(gameopt, &def_game_options, sizeof (setupinfo.game_options));
+    while ((opt = getopt(argc, argv, "c:t:x:p:e:l:adrfns:N:vw:g:S:")) != EOF)
+      switch (opt) {
+      case 'c':
+        {
+	  FILE *cf = fopen(optarg,"r");
+	  if (!cf) { perror("fopen"); return -1; }
+	  read_config_file(cf,&setupinfo);
+	  fclose(cf);
+	}
+	break;
+      case 't':
+  if (optarg) ticdup = atoi(optarg);
+  break;
+      case 'x':
+  if (optarg) xtratics = atoi(optarg);
+  break;
+      case 'p':
+  if (optarg) localport = atoi(optarg);
+  break;
+      case 'e':
+  if (optarg) setupinfo.episode = atoi(optarg);
+  break;
+      case 'l':
+  if (optarg) setupinfo.level = atoi(optarg);
+  break;
+      case 'a':
+  setupinfo.deathmatch = 2;
+  break;
+      case 'd':
+  setupinfo.deathmatch = 1;
+  break;
+      case 'r':
+  setupinfo.game_options[6] = 1;
+  break;
+      case 'f':
+  setupinfo.game_options[7] = 1;
+  break;
+      case 'n':
+  setupinfo.game_options[8] = 1;
+  break;
+      case 's':
+  if (optarg) setupinfo.skill = atoi(optarg)-1;
+  break;
+      case 'N':
+  if (optarg) setupinfo.players = numplayers = atoi(optarg);
+  break;
+      case 'v':
+  verbose++;
+  break;
+      case 'w':
+  if (optarg) {
+    char *p;
+    wadname = realloc(wadname, ++numwads * sizeof *wadname);
+    wadget  = realloc(wadget ,   numwads * sizeof *wadget );
+    wadname[numwads-1] = strdup(optarg);
+    if ((p = strchr(wadname[numwads-1], ','))) {
+      *p++ = 0; wadget[numwads-1] = p;
+    } else wadget[numwads-1] = NULL;
+  }
+  break;
+      case 'g':
+  if (optarg) numgames = MAX(atoi(optarg), 1);
+  break;
+      case 'S':
+  if (optarg) statsinterval = atoi(optarg);
+  break;
+      }
+  }
+
+  setupinfo.ticdup = ticdup; setupinfo.extratic = xtratics;
+  I_InitNetwork();
+  games = calloc(numgames, sizeof *games);
+  sockets = malloc(numgames * sizeof *sockets);
+  {
+    int i;
+    for (i=0; i<numgames; i++) {
+      game_t *g = &games[i];
+
+      g->port = localport + i;
+      g->setupinfo = setupinfo;
+      udp_socket = sockets[i] = g->socket = I_InitSockets(g->port);
+      ResetGame(g); // no players initially
+    }
+  }
+
+  if (numgames > 1)
+    printf("Listening on ports %d-%d, waiting for %d players in each of %d games\n",
+           localport, localport + numgames - 1, numplayers, numgames);
+  else
+    printf("Listening on port %d, waiting for %d players\n", localport, numplayers);
+
+  { // Print wads
+    int i;
+    for (i=0; i<numwads; i++)
+      printf("Wad %s (%s)\n", wadname[i], wadget[i] ? wadget[i] : "");
+  }
+
+  // Exit and signal handling
+  atexit(doexit); // heh
+  signal(SIGTERM, sig_handler);
+  signal(SIGINT , sig_handler);
+#ifndef USE_SDL_NET
+  signal(SIGQUIT, sig_handler);
+  signal(SIGKILL, sig_handler);
+  signal(SIGHUP , sig_handler);
+#endif
+
+  {
+    packet_header_t *packet = malloc(10000);
+    dboolean *received = malloc(numgames * sizeof *received);
+    unsigned int laststats = SDL_GetTicks();
+
+    while (1) {
+      int i;
+      dboolean any = false;
+
+      I_WaitForSockets(sockets, numgames, 120*1000);
+      for (i=0; i<numgames; i++) {
+        game_t *g = &games[i];
+        size_t len;
+
+        udp_socket = g->socket;
+        received[i] = false;
+        while ((len = I_GetPacket(packet, 10000))) {
+          g->packetsin++;
+          received[i] = any = true;
+          ProcessPacket(g, packet, len);
+        }
+        I_FlushPackets();
+      }
+      // RunGame counts the confirmation and back-off timeouts in wakeups,
+      // so only run the games whose own socket woke us (or all of them on
+      // a timeout), as a server with a single game would
+      for (i=0; i<numgames; i++) {
+        game_t *g = &games[i];
+
+        if (!received[i] && any)
+          continue;
+        udp_socket = g->socket;
+        RunGame(g);
+        I_FlushPackets();
+      }
+      if (statsinterval && SDL_GetTicks() - laststats >= statsinterval * 1000u) {
+        unsigned int now = SDL_GetTicks();
+
+        for (i=0; i<numgames; i++)
+          PrintStats(&games[i], now - laststats);
+        laststats = now;
+      }
     }
   }
 }
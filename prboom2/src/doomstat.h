@@ -316,10 +316,13 @@ extern int    skyflatnum;
 extern  int        maketic;
 
 // Networking and tick handling related.
-#define BACKUPTICS              12
+// Size of the ticcmd rings; up to net_ticwindow tics are built ahead of
+// gametic, which has to stay below BACKUPTICS/2.
+#define BACKUPTICS              128
 
 extern  ticcmd_t   netcmds[][BACKUPTICS];
 extern  int        ticdup;
+extern  int        net_ticwindow;
 
 //-----------------------------------------------------------------------------
 
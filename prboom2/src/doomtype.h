@@ -122,6 +122,14 @@ typedef unsigned __int64 uint_64_t;
   #define INLINE inline        /* use standard inline */
 #endif
 
+/* Storage that each thread gets its own copy of; used for the working
+ * state of the software renderer, which can draw from several threads */
+#ifdef _MSC_VER
+  #define THREADLOCAL __declspec(thread)
+#else
+  #define THREADLOCAL __thread
+#endif
+
 /* cph - move compatibility levels here so we can use them in d_server.c */
 typedef enum {
   doom_12_compatibility,   /* Doom v1.2 */
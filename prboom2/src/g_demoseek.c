@@ -0,0 +1,272 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      In-memory game state snapshots for seeking in demos.
+ *
+ *      While a demo plays, the level is serialized with the savegame
+ *      archivers every demo_snapshot_interval seconds. Seeking restores
+ *      the nearest snapshot at or before the target tic and fast-forwards
+ *      the rest with the -skipsec machinery, so rewinding or jumping
+ *      ahead to a part of the demo already seen costs at most one
+ *      interval of simulation instead of a replay from the start.
+ *
+ *      At most demo_snapshot_count snapshots are kept. When they run
+ *      out, every other one is dropped and the interval doubles, so the
+ *      whole demo stays covered whatever its length. The first snapshot
+ *      of the demo is always kept.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+
+#include "doomstat.h"
+#include "d_event.h"
+#include "g_game.h"
+#include "g_demoseek.h"
+#include "am_map.h"
+#include "e6y.h"
+#include "lprintf.h"
+#include "z_zone.h"
+
+typedef struct
+{
+  int tic;               // gametic when taken, before that tic ran
+  int demo_curr_tic;
+  const byte *demo_p;
+  byte *data;
+  size_t size;
+} demosnapshot_t;
+
+int demo_snapshot_interval; // seconds, 0 disables snapshots
+int demo_snapshot_count;
+
+int key_demo_rewind;
+int key_demo_fastforward;
+
+static demosnapshot_t *snapshots; // sorted by tic
+static int numsnapshots;
+static int maxsnapshots;
+static int snapshot_step;
+
+static int seek_target = -1;
+
+void G_DemoSeekClear(void)
+{
+  int i;
+
+  for (i = 0; i < numsnapshots; i++)
+    free(snapshots[i].data);
+  free(snapshots);
+  snapshots = NULL;
+  numsnapshots = maxsnapshots = 0;
+  seek_target = -1;
+}
+
+// index of the first snapshot taken at or after tic
+static int G_DemoSeekFind(int tic)
+{
+  int lo = 0, hi = numsnapshots;
+
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (snapshots[mid].tic < tic)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void G_DemoSeekThin(void)
+{
+  int i, n = 1;
+
+  snapshot_step *= 2;
+  for (i = 1; i < numsnapshots; i++)
+  {
+    if (snapshots[i].tic % snapshot_step == 0)
+    {
+      snapshots[n++] = snapshots[i];
+    }
+    else
+    {
+      free(snapshots[i].data);
+    }
+  }
+
+  // nothing was off the new grid; drop the oldest after the first instead
+  if (n == numsnapshots)
+  {
+    free(snapshots[1].data);
+    memmove(&snapshots[1], &snapshots[2], (numsnapshots - 2) * sizeof(*snapshots));
+    n--;
+  }
+
+  numsnapshots = n;
+}
+
+static void G_DemoSeekTake(void)
+{
+  demosnapshot_t *snap;
+  int pos;
+
+  if (!snapshots)
+  {
+    maxsnapshots = MAX(demo_snapshot_count, 2);
+    snapshots = malloc(maxsnapshots * sizeof(*snapshots));
+    snapshot_step = demo_snapshot_interval * TICRATE;
+  }
+  else if (gametic % snapshot_step)
+  {
+    return;
+  }
+
+  pos = G_DemoSeekFind(gametic);
+  if (pos < numsnapshots && snapshots[pos].tic == gametic)
+    return; // already seen this part of the demo
+
+  if (numsnapshots == maxsnapshots)
+  {
+    G_DemoSeekThin();
+    if (gametic % snapshot_step)
+      return;
+    pos = G_DemoSeekFind(gametic);
+  }
+
+  memmove(&snapshots[pos + 1], &snapshots[pos], (numsnapshots - pos) * sizeof(*snapshots));
+  numsnapshots++;
+
+  snap = &snapshots[pos];
+  snap->tic = gametic;
+  snap->demo_curr_tic = demo_curr_tic;
+  snap->demo_p = demo_p;
+  snap->data = G_WriteSnapshot(&snap->size);
+}
+
+static void G_DemoSeekRestore(demosnapshot_t *snap)
+{
+  int oldtic = gametic;
+  dboolean oldusergame = usergame;
+  dboolean automap = automapmode & am_active;
+
+  G_ReadSnapshot(snap->data);
+
+  // keep TryRunTics' count of tics to run what it was
+  maketic += gametic - oldtic;
+
+  demo_p = snap->demo_p;
+  demo_curr_tic = snap->demo_curr_tic;
+
+  usergame = oldusergame;
+  wipegamestate = gamestate;
+  if (automap)
+    AM_Start();
+}
+
+static void G_DemoSeekPerform(int target)
+{
+  int pos;
+
+  if (!numsnapshots)
+    return;
+
+  if (target < snapshots[0].tic)
+    target = snapshots[0].tic;
+
+  // latest snapshot at or before the target
+  pos = G_DemoSeekFind(target + 1) - 1;
+
+  if (target < gametic || snapshots[pos].tic > gametic)
+    G_DemoSeekRestore(&snapshots[pos]);
+
+  if (target > gametic)
+  {
+    demo_skiptics = target;
+    if (!doSkip)
+      G_SkipDemoStart();
+  }
+  else if (doSkip)
+  {
+    G_SkipDemoStop();
+  }
+}
+
+//
+// G_DemoSeekTicker
+// Called from G_Ticker once pending game actions are done, before the
+// tic's commands are read, which is the only point where the state seen
+// here and the one restored match exactly.
+//
+
+void G_DemoSeekTicker(void)
+{
+  if (!demoplayback || democontinue)
+  {
+    if (snapshots)
+      G_DemoSeekClear();
+    return;
+  }
+
+  if (seek_target >= 0)
+  {
+    int target = seek_target;
+
+    seek_target = -1;
+    G_DemoSeekPerform(target);
+  }
+
+  if (demo_snapshot_interval > 0 && gamestate == GS_LEVEL &&
+      gameaction == ga_nothing && !paused)
+  {
+    G_DemoSeekTake();
+  }
+}
+
+//
+// G_DemoSeek
+// Queues a seek by the given number of tics from the current position,
+// or from the end of a seek that is still in progress.
+//
+
+void G_DemoSeek(int tics)
+{
+  int from = gametic;
+
+  if (seek_target >= 0)
+    from = seek_target;
+  else if (doSkip && demo_skiptics > gametic)
+    from = demo_skiptics;
+
+  seek_target = MAX(from + tics, 0);
+}
@@ -48,6 +48,9 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
 
 #include "doomstat.h"
 #include "d_net.h"
@@ -86,6 +89,8 @@
 #include "r_fps.h"
 #include "e6y.h"//e6y
 #include "statdump.h"
+#include "g_demoseek.h"
+#include "m_profile.h"
 
 #include "m_io.h"
 
@@ -350,6 +355,7 @@ int    bodyqueslot, bodyquesize;        // killough 2/8/98
 mobj_t **bodyque = 0;                   // phares 8/10/98
 
 static void G_DoSaveGame (dboolean menu);
+static int G_InflateSaveGame(byte **buffer, int length);
 
 //e6y: save/restore all data which could be changed by G_ReadDemoHeader
 static void G_SaveRestoreGameOptions(int save);
@@ -1151,6 +1157,8 @@ void G_Ticker (void)
         }
     }
 
+  G_DemoSeekTicker();
+
   if (paused & 2 || (!demoplayback && menuactive && !netgame))
     basetic++;  // For revenant tracers and RNG -- we must maintain sync
   else {
@@ -2183,6 +2191,7 @@ void G_DoLoadGame(void)
   if (length<=0)
     I_Error("Couldn't read file %s: %s", name, "(Unknown Error)");
   free(name);
+  length = G_InflateSaveGame(&savebuffer, length);
   save_p = savebuffer + SAVESTRINGSIZE;
 
   // CPhipps - read the description field, compare with supported ones
@@ -2368,6 +2377,199 @@ void G_SaveGame(int slot, char *description)
 #endif
 }
 
+//
+// Savegame streaming
+//
+// A savegame is written to disk while it is being archived, rather than
+// built whole in memory first. CheckSaveGame hands the buffer to the
+// file whenever it holds more than SAVESTREAMCHUNK bytes. The
+// description and version header stay plain so that M_ReadSaveStrings
+// can read them; the rest is gzip compressed when zlib is available.
+//
+// The file is written under a temporary name and only replaces the old
+// savegame once it is complete.
+//
+
+#define SAVESTREAMCHUNK (256*1024)
+#define SAVEHEADERSIZE (SAVESTRINGSIZE+VERSIONSIZE)
+
+static FILE *savestream;
+static char *savestream_tmp;
+static size_t savestream_header; // header bytes still to write plain
+static dboolean savestream_error;
+#ifdef HAVE_LIBZ
+static z_stream savezstream;
+#endif
+
+static dboolean G_OpenSaveStream(const char *name)
+{
+  savestream_tmp = malloc(strlen(name) + 5);
+  sprintf(savestream_tmp, "%s.tmp", name);
+
+  if (!(savestream = M_fopen(savestream_tmp, "wb")))
+  {
+    free(savestream_tmp);
+    savestream_tmp = NULL;
+    return false;
+  }
+
+  savestream_header = SAVEHEADERSIZE;
+  savestream_error = false;
+
+#ifdef HAVE_LIBZ
+  memset(&savezstream, 0, sizeof(savezstream));
+  // windowBits + 16 selects the gzip wrapper, see G_InflateSaveGame
+  if (deflateInit2(&savezstream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    fclose(savestream);
+    savestream = NULL;
+    M_remove(savestream_tmp);
+    free(savestream_tmp);
+    savestream_tmp = NULL;
+    return false;
+  }
+#endif
+
+  return true;
+}
+
+static void G_WriteSaveStream(const byte *data, size_t length, dboolean finish)
+{
+#ifdef HAVE_LIBZ
+  byte out[16384];
+#endif
+
+  if (savestream_header)
+  {
+    size_t n = MIN(length, savestream_header);
+
+    if (fwrite(data, 1, n, savestream) != n)
+      savestream_error = true;
+    savestream_header -= n;
+    data += n;
+    length -= n;
+  }
+
+#ifdef HAVE_LIBZ
+
+  savezstream.next_in = (Bytef *)data;
+  savezstream.avail_in = length;
+  do
+  {
+    size_t have;
+
+    savezstream.next_out = out;
+    savezstream.avail_out = sizeof(out);
+    deflate(&savezstream, finish ? Z_FINISH : Z_NO_FLUSH);
+    have = sizeof(out) - savezstream.avail_out;
+    if (fwrite(out, 1, have, savestream) != have)
+      savestream_error = true;
+  } while (savezstream.avail_out == 0);
+#else
+  if (fwrite(data, 1, length, savestream) != length)
+    savestream_error = true;
+#endif
+}
+
+// Writes out what has been archived so far and moves save_p back to the
+// start of the buffer. Unless finishing, up to 3 bytes are held back so
+// that the buffer keeps the 4-byte phase of the file, which PADSAVEP
+// depends on. Returns the new buffer position.
+static size_t G_FlushSaveStream(dboolean finish)
+{
+  size_t pos = save_p - savebuffer;
+  size_t length = finish ? pos : pos & ~3;
+
+  G_WriteSaveStream(savebuffer, length, finish);
+  memmove(savebuffer, savebuffer + length, pos - length);
+  save_p = savebuffer + (pos - length);
+  return pos - length;
+}
+
+static dboolean G_CloseSaveStream(const char *name)
+{
+  G_FlushSaveStream(true);
+#ifdef HAVE_LIBZ
+  deflateEnd(&savezstream);
+#endif
+  if (fclose(savestream))
+    savestream_error = true;
+  savestream = NULL;
+
+  // Keep the old savegame unless the new one is complete
+  if (!savestream_error && M_rename(savestream_tmp, name))
+    savestream_error = true;
+  if (savestream_error)
+    M_remove(savestream_tmp);
+
+  free(savestream_tmp);
+  savestream_tmp = NULL;
+
+  return !savestream_error;
+}
+
+// Unpacks a savegame written through G_OpenSaveStream in place of the
+// buffer read from disk: the gzip body follows the plain header.
+// Savegames from older versions are not compressed and are left as they
+// are; their checksum could in theory start like a gzip stream, so a
+// body that does not inflate is taken to be one of those.
+static int G_InflateSaveGame(byte **buffer, int length)
+{
+  const byte *body = *buffer + SAVEHEADERSIZE;
+
+  if (length < SAVEHEADERSIZE + 3 ||
+      body[0] != 0x1f || body[1] != 0x8b || body[2] != 8) // gzip, deflate
+    return length;
+
+#ifdef HAVE_LIBZ
+  {
+    z_stream zs;
+    byte *output;
+    size_t outlen = 4 * length;
+    int err;
+
+    memset(&zs, 0, sizeof(zs));
+    output = Z_Malloc(outlen, PU_STATIC, 0);
+    memcpy(output, *buffer, SAVEHEADERSIZE);
+    zs.next_in = (Bytef *)body;
+    zs.avail_in = length - SAVEHEADERSIZE;
+    zs.next_out = output + SAVEHEADERSIZE;
+    zs.avail_out = outlen - SAVEHEADERSIZE;
+
+    if (inflateInit2(&zs, 15 + 16) != Z_OK)
+      I_Error("G_DoLoadGame: Error initializing savegame decompression");
+
+    // resize if output buffer runs full
+    while ((err = inflate(&zs, Z_NO_FLUSH)) == Z_OK)
+    {
+      if (zs.avail_out == 0)
+      {
+        output = realloc(output, outlen * 2);
+        zs.next_out = output + outlen;
+        zs.avail_out = outlen;
+        outlen *= 2;
+      }
+    }
+
+    inflateEnd(&zs);
+
+    if (err != Z_STREAM_END)
+    {
+      Z_Free(output);
+      return length;
+    }
+
+    Z_Free(*buffer);
+    *buffer = output;
+    return SAVEHEADERSIZE + zs.total_out;
+  }
+#else
+  I_Error("G_DoLoadGame: Savegame is compressed, but this build has no zlib support");
+  return -1;
+#endif
+}
+
 // Check for overrun and realloc if necessary -- Lee Killough 1/22/98
 void (CheckSaveGame)(size_t size, const char* file, int line)
 {
@@ -2381,6 +2583,12 @@ void (CheckSaveGame)(size_t size, const char* file, int line)
 
   if (pos > prev_check)
     I_Error("CheckSaveGame at %s:%d called for insufficient buffer (%u < %u)", prevf, prevl, prev_check, pos);
+#endif
+
+  if (savestream && pos >= SAVESTREAMCHUNK)
+    pos = G_FlushSaveStream(false);
+
+#ifdef RANGECHECK
   prev_check = size + pos;
   prevf = file;
   prevl = line;
@@ -2423,6 +2631,14 @@ static void G_DoSaveGame (dboolean menu)
 
   description = savedescription;
 
+  if (!G_OpenSaveStream(name))
+  {
+    doom_printf("Game save failed!");
+    savedescription[0] = 0;
+    free(name);
+    return;
+  }
+
   save_p = savebuffer = malloc(savegamesize);
 
   CheckSaveGame(SAVESTRINGSIZE+VERSIONSIZE+sizeof(uint_64_t));
@@ -2528,7 +2744,7 @@ static void G_DoSaveGame (dboolean menu)
   *save_p++ = 0xe6;   // consistancy marker
 
   Z_CheckHeap();
-  doom_printf( "%s", M_WriteFile(name, savebuffer, save_p - savebuffer)
+  doom_printf( "%s", G_CloseSaveStream(name)
          ? s_GGSAVED /* Ty - externalised */
          : "Game save failed!"); // CPhipps - not externalised
 
@@ -2551,6 +2767,129 @@ static void G_DoSaveGame (dboolean menu)
   free(name);
 }
 
+//
+// G_WriteSnapshot
+// Serializes the running level into a new buffer, for seeking in demos
+// (see g_demoseek.c). Unlike a savegame it has no header to check, since
+// it is only ever read back by the same session with the same wads.
+//
+
+byte *G_WriteSnapshot(size_t *length)
+{
+  byte *buffer;
+  int i;
+
+  save_p = savebuffer = malloc(savegamesize);
+
+  CheckSaveGame(3+MAXPLAYERS+8*sizeof(int));
+
+  *save_p++ = gameskill;
+  *save_p++ = gameepisode;
+  *save_p++ = gamemap;
+
+  for (i=0 ; i<MAXPLAYERS ; i++)
+    *save_p++ = playeringame[i];
+
+  // the float bob of flying monsters follows gametic, so it is restored
+  // along with everything derived from it
+  memcpy(save_p, &gametic, sizeof gametic);
+  save_p += sizeof gametic;
+  memcpy(save_p, &basetic, sizeof basetic);
+  save_p += sizeof basetic;
+  memcpy(save_p, &levelstarttic, sizeof levelstarttic);
+  save_p += sizeof levelstarttic;
+  memcpy(save_p, &leveltime, sizeof leveltime);
+  save_p += sizeof leveltime;
+  memcpy(save_p, &totalleveltimes, sizeof totalleveltimes);
+  save_p += sizeof totalleveltimes;
+  memcpy(save_p, &totalkills, sizeof totalkills);
+  save_p += sizeof totalkills;
+  memcpy(save_p, &totalitems, sizeof totalitems);
+  save_p += sizeof totalitems;
+  memcpy(save_p, &totalsecret, sizeof totalsecret);
+  save_p += sizeof totalsecret;
+
+  P_ArchivePlayers();
+  P_ThinkerToIndex();
+  P_ArchiveWorld();
+  P_ArchiveThinkers();
+  P_IndexToThinker();
+  P_ArchiveSpecials();
+  P_ArchiveRNG();
+  P_ArchiveMap();
+  P_ArchiveLinks();
+
+  *save_p++ = 0xe6;   // consistancy marker
+
+  *length = save_p - savebuffer;
+  buffer = realloc(savebuffer, *length);
+  savebuffer = save_p = NULL;
+  return buffer;
+}
+
+//
+// G_ReadSnapshot
+// Reloads the level saved by G_WriteSnapshot, including gametic.
+//
+
+void G_ReadSnapshot(byte *buffer)
+{
+  int i;
+
+  save_p = buffer;
+
+  gameskill = *save_p++;
+  gameepisode = *save_p++;
+  gamemap = *save_p++;
+  gamemapinfo = G_LookupMapinfo(gameepisode, gamemap);
+
+  for (i=0 ; i<MAXPLAYERS ; i++)
+    playeringame[i] = *save_p++;
+
+  G_InitNew (gameskill, gameepisode, gamemap);
+
+  memcpy(&gametic, save_p, sizeof gametic);
+  save_p += sizeof gametic;
+  memcpy(&basetic, save_p, sizeof basetic);
+  save_p += sizeof basetic;
+  memcpy(&levelstarttic, save_p, sizeof levelstarttic);
+  save_p += sizeof levelstarttic;
+  memcpy(&leveltime, save_p, sizeof leveltime);
+  save_p += sizeof leveltime;
+  memcpy(&totalleveltimes, save_p, sizeof totalleveltimes);
+  save_p += sizeof totalleveltimes;
+  memcpy(&totalkills, save_p, sizeof totalkills);
+  save_p += sizeof totalkills;
+  memcpy(&totalitems, save_p, sizeof totalitems);
+  save_p += sizeof totalitems;
+  memcpy(&totalsecret, save_p, sizeof totalsecret);
+  save_p += sizeof totalsecret;
+
+  P_MapStart();
+  P_UnArchivePlayers ();
+  P_UnArchiveWorld ();
+  P_UnArchiveThinkers ();
+  P_UnArchiveSpecials ();
+  P_UnArchiveRNG ();
+  P_UnArchiveMap ();
+  P_UnArchiveLinks ();
+  P_MapEnd();
+  R_ActivateSectorInterpolations();
+  R_SmoothPlaying_Reset(NULL);
+
+  if (musinfo.current_item != -1)
+  {
+    S_ChangeMusInfoMusic(musinfo.current_item, true);
+  }
+
+  RecalculateDrawnSubsectors();
+
+  if (*save_p != 0xe6)
+    I_Error ("G_ReadSnapshot: Bad snapshot");
+
+  save_p = NULL;
+}
+
 static skill_t d_skill;
 static int     d_episode;
 static int     d_map;
@@ -4262,6 +4601,7 @@ void G_DoPlayDemo(void)
 
     demoplayback = true;
     R_SmoothPlaying_Reset(NULL); // e6y
+    G_DemoSeekClear();
   }
   else
   {
@@ -4313,6 +4653,14 @@ dboolean G_CheckDemoStatus (void)
 
       M_SaveDefaults();
 
+#ifdef HEADLESS
+      // a report, not an error, for scripts checking the exit code
+      lprintf(LO_INFO, "Timed %u gametics in %u realtics = %-.1f frames per second\n",
+              (unsigned) gametic,realtics,
+              (unsigned) gametic * (double) TICRATE / realtics);
+      M_ProfileReport(gametic);
+      I_SafeExit(0);
+#endif
       I_Error ("Timed %u gametics in %u realtics = %-.1f frames per second",
                (unsigned) gametic,realtics,
                (unsigned) gametic * (double) TICRATE / realtics);
@@ -54,6 +54,8 @@ void G_DeferedPlayDemo(const char *demo); // CPhipps - const
 void G_LoadGame(int slot, dboolean is_command); // killough 5/15/98
 void G_ForcedLoadGame(void);           // killough 5/15/98: forced loadgames
 void G_DoLoadGame(void);
+byte *G_WriteSnapshot(size_t *length);
+void G_ReadSnapshot(byte *buffer);
 void G_SaveGame(int slot, char *description); // Called by M_Responder.
 void G_BeginRecording(void);
 // CPhipps - const on these string params
@@ -88,6 +90,7 @@ int G_ValidateMapName(const char *mapname, int *pEpi, int *pMap);
 
 //e6y
 extern dboolean democontinue;
+extern const byte *demo_p;
 extern char democontinuename[];
 void G_CheckDemoContinue(void);
 void G_SetSpeed(void);
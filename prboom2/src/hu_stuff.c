@@ -53,6 +53,7 @@
 #include "lprintf.h"
 #include "e6y.h" //e6y
 #include "g_overflow.h"
+#include "m_profile.h"
 
 // global heads up display controls
 
@@ -102,6 +103,10 @@ int hud_num;
 #define HU_TRACERX (2)
 #define HU_TRACERY (hu_font['A'-HU_FONTSTART].height)
 
+// profiler widget, under the coords
+#define HU_PROFILEX (320 - 21*hu_font2['A'-HU_FONTSTART].width)
+#define HU_PROFILEY (3 + 3*hu_font['A'-HU_FONTSTART].height + HU_COORDXYZ_Y)
+
 #define key_alt KEYD_RALT
 #define key_shift KEYD_RSHIFT
 
@@ -159,6 +164,7 @@ static hu_textline_t  w_weapon; //jff 2/16/98 new weapon widget for hud
 static hu_textline_t  w_keys;   //jff 2/16/98 new keys widget for hud
 static hu_textline_t  w_gkeys;  //jff 3/7/98 graphic keys widget for hud
 static hu_textline_t  w_monsec; //jff 2/16/98 new kill/secret widget for hud
+static hu_textline_t  w_profile[PROFHUDLINES]; // -profile timings
 static hu_mtext_t     w_rtext;  //jff 2/26/98 text message refresh widget
 
 static hu_textline_t  w_map_monsters;  //e6y monsters widget for automap
@@ -931,6 +937,19 @@ void HU_Start(void)
     HUlib_drawTextLine(&w_traces[i], false);
   }
 
+  for (i = 0; i < PROFHUDLINES; i++)
+  {
+    HUlib_initTextLine(
+      &w_profile[i],
+      HU_PROFILEX,
+      HU_PROFILEY+i*HU_GAPY,
+      hu_font2,
+      HU_FONTSTART,
+      CR_GRAY,
+      VPT_ALIGN_RIGHT_TOP
+    );
+  }
+
 
   //jff 2/16/98 initialize ammo widget
   strcpy(hud_ammostr,"AMM ");
@@ -2384,6 +2403,29 @@ void HU_draw_crosshair(void)
 //
 // Passed nothing, returns nothing
 //
+//
+// HU_DrawProfile
+//
+// Shows the -profile timings of the last second: ms per tic for the
+// playsim and the thinker functions, ms per frame for the rest.
+//
+static void HU_DrawProfile(void)
+{
+  const char *s;
+  int i;
+
+  for (i = 0; i < PROFHUDLINES && (s = M_ProfileHUDLine(i)); i++)
+  {
+    if (realframe)
+    {
+      HUlib_clearTextLine(&w_profile[i]);
+      while (*s)
+        HUlib_addCharToTextLine(&w_profile[i], *(s++));
+    }
+    HUlib_drawTextLine(&w_profile[i], false);
+  }
+}
+
 void HU_Drawer(void)
 {
   char *s;
@@ -2582,6 +2624,9 @@ void HU_Drawer(void)
   if (hudadd_crosshair)
     HU_draw_crosshair();
 
+  if (profiling)
+    HU_DrawProfile();
+
   //jff 4/21/98 if setup has disabled message list while active, turn it off
   if (hud_msg_lines<=1)
     message_list = false;
@@ -33,6 +33,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "i_sound.h"
 #include "i_video.h"
 #include "lprintf.h"
@@ -62,6 +63,36 @@ static pipeinfo_t soundpipe;
 static pipeinfo_t videopipe;
 static pipeinfo_t muxpipe;
 
+// Frames go from I_CaptureFrame to the sound and video pipes through a
+// small queue per pipe, each emptied by its own writer thread, so the
+// game can go on to the next frame while the encoders read the last one.
+// Grabbing the screen and mixing the sound stay on the main thread: the
+// first needs the renderer, the second has to happen at game time.
+
+#define CAPTURE_QUEUE 4 // frames waiting per pipe
+
+typedef struct
+{
+  pipeinfo_t *pipe;
+  const char *name;
+  unsigned char *buf[CAPTURE_QUEUE];
+  size_t size[CAPTURE_QUEUE];  // bytes to write from each slot
+  size_t alloc[CAPTURE_QUEUE]; // bytes allocated for each slot
+  // the fields below are protected by lock
+  int head;                    // oldest slot not yet written
+  int count;                   // slots waiting to be written
+  int done;                    // no more frames will come
+  int failed;                  // frames the writer could not write
+  int reported;                // failures already warned about
+  SDL_mutex *lock;
+  SDL_cond *notempty;
+  SDL_cond *notfull;
+  SDL_Thread *thread;
+} capqueue_t;
+
+static capqueue_t soundqueue;
+static capqueue_t videoqueue;
+
 
 const char *cap_soundcommand;
 const char *cap_videocommand;
@@ -496,6 +527,125 @@ static int threadstderrproc (void *data)
 }
 
 
+static int threadwriteproc (void *data)
+{ // writes the queued frames of one pipe, in order
+  capqueue_t *q = (capqueue_t *) data;
+
+  while (1)
+  {
+    int slot;
+    int ok;
+
+    SDL_LockMutex (q->lock);
+    while (!q->count && !q->done)
+      SDL_CondWait (q->notempty, q->lock);
+    if (!q->count)
+    {
+      SDL_UnlockMutex (q->lock);
+      break;
+    }
+    slot = q->head;
+    SDL_UnlockMutex (q->lock);
+
+    // the slot is ours until head moves past it
+    ok = fwrite (q->buf[slot], q->size[slot], 1, q->pipe->f_stdin) == 1;
+
+    SDL_LockMutex (q->lock);
+    if (!ok)
+      q->failed++;
+    q->head = (q->head + 1) % CAPTURE_QUEUE;
+    q->count--;
+    SDL_CondSignal (q->notfull);
+    SDL_UnlockMutex (q->lock);
+  }
+  return 1;
+}
+
+// starts the writer thread of a pipe; without one, frames are
+// written straight away as before
+static void I_StartCaptureQueue (capqueue_t *q, pipeinfo_t *p, const char *name)
+{
+  memset (q, 0, sizeof (*q));
+  q->pipe = p;
+  q->name = name;
+  q->lock = SDL_CreateMutex ();
+  q->notempty = SDL_CreateCond ();
+  q->notfull = SDL_CreateCond ();
+  if (q->lock && q->notempty && q->notfull)
+    q->thread = SDL_CreateThread (threadwriteproc, name, q);
+  if (!q->thread)
+    lprintf (LO_WARN, "I_CapturePrep: writing %s on the main thread\n", name);
+}
+
+// hands a frame to the writer thread, waiting while the queue is full
+static void I_QueueCapture (capqueue_t *q, const unsigned char *data, size_t size)
+{
+  int slot;
+  int failed;
+
+  if (!q->thread)
+  {
+    if (fwrite (data, size, 1, q->pipe->f_stdin) != 1)
+      lprintf (LO_WARN, "I_CaptureFrame: error writing %s.\n", q->name);
+    return;
+  }
+
+  SDL_LockMutex (q->lock);
+  while (q->count == CAPTURE_QUEUE)
+    SDL_CondWait (q->notfull, q->lock);
+  slot = (q->head + q->count) % CAPTURE_QUEUE;
+  failed = q->failed - q->reported;
+  q->reported = q->failed;
+  SDL_UnlockMutex (q->lock);
+
+  if (failed)
+    lprintf (LO_WARN, "I_CaptureFrame: error writing %s.\n", q->name);
+
+  // the writer does not look at slots past head + count
+  if (size > q->alloc[slot])
+  {
+    q->alloc[slot] = size;
+    q->buf[slot] = realloc (q->buf[slot], size);
+  }
+  memcpy (q->buf[slot], data, size);
+  q->size[slot] = size;
+
+  SDL_LockMutex (q->lock);
+  q->count++;
+  SDL_CondSignal (q->notempty);
+  SDL_UnlockMutex (q->lock);
+}
+
+// lets the writer thread finish the queued frames, then frees the queue
+static void I_StopCaptureQueue (capqueue_t *q)
+{
+  int i, s;
+
+  if (q->thread)
+  {
+    SDL_LockMutex (q->lock);
+    q->done = 1;
+    SDL_CondSignal (q->notempty);
+    SDL_UnlockMutex (q->lock);
+    SDL_WaitThread (q->thread, &s);
+    q->thread = NULL;
+
+    if (q->failed != q->reported)
+      lprintf (LO_WARN, "I_CaptureFinish: error writing %s.\n", q->name);
+  }
+
+  for (i = 0; i < CAPTURE_QUEUE; i++)
+    free (q->buf[i]);
+  if (q->lock)
+    SDL_DestroyMutex (q->lock);
+  if (q->notempty)
+    SDL_DestroyCond (q->notempty);
+  if (q->notfull)
+    SDL_DestroyCond (q->notfull);
+  memset (q, 0, sizeof (*q));
+}
+
+
 // init and open sound, video pipes
 // fn is filename passed from command line, typically final output file
 void I_CapturePrep (const char *fn)
@@ -550,6 +700,10 @@ void I_CapturePrep (const char *fn)
   videopipe.outthread = SDL_CreateThread (threadstdoutproc, "videopipe.outthread", &videopipe);
   videopipe.errthread = SDL_CreateThread (threadstderrproc, "videopipe.errthread", &videopipe);
 
+  // start writer threads
+  I_StartCaptureQueue (&soundqueue, &soundpipe, "soundpipe");
+  I_StartCaptureQueue (&videoqueue, &videopipe, "videopipe");
+
   I_AtExit (I_CaptureFinish, true);
 }
 
@@ -579,15 +733,13 @@ void I_CaptureFrame (void)
   snd = I_GrabSound (nsampreq);
   if (snd)
   {
-    if (fwrite (snd, nsampreq * 4, 1, soundpipe.f_stdin) != 1)
-      lprintf(LO_WARN, "I_CaptureFrame: error writing soundpipe.\n");
+    I_QueueCapture (&soundqueue, snd, nsampreq * 4);
     //free (snd); // static buffer
   }
   vid = I_GrabScreen ();
   if (vid)
   {
-    if (fwrite (vid, renderW * renderH * 3, 1, videopipe.f_stdin) != 1)
-      lprintf(LO_WARN, "I_CaptureFrame: error writing videopipe.\n");
+    I_QueueCapture (&videoqueue, vid, renderW * renderH * 3);
     //free (vid); // static buffer
   }
 
@@ -608,10 +760,12 @@ void I_CaptureFinish (void)
   // is there a better way to do this?
   
   // (on windows, it doesn't matter what order we do it in)
+  I_StopCaptureQueue (&videoqueue);
   my_pclose3 (&videopipe);
   SDL_WaitThread (videopipe.outthread, &s);
   SDL_WaitThread (videopipe.errthread, &s);
 
+  I_StopCaptureQueue (&soundqueue);
   my_pclose3 (&soundpipe);
   SDL_WaitThread (soundpipe.outthread, &s);
   SDL_WaitThread (soundpipe.errthread, &s);
@@ -57,9 +57,14 @@ void I_WaitForPacket(int ms);
 #ifdef USE_SDL_NET
 UDP_SOCKET I_Socket(Uint16 port);
 int I_ConnectToServer(const char *serv);
-UDP_CHANNEL I_RegisterPlayer(IPaddress *ipaddr);
+UDP_CHANNEL I_RegisterPlayer(IPaddress *ipaddr, int channel);
 void I_UnRegisterPlayer(UDP_CHANNEL channel);
 extern IPaddress sentfrom_addr;
+#ifdef PRBOOM_SERVER
+void I_QueuePacketTo(packet_header_t* packet, size_t len, UDP_CHANNEL *to);
+void I_FlushPackets(void);
+void I_WaitForSockets(UDP_SOCKET *socks, int n, int ms);
+#endif
 #endif
 
 #ifdef AF_INET
@@ -81,6 +81,9 @@ dboolean I_AnySoundStillPlaying(void);
 //  and pitch of a sound channel.
 void I_UpdateSoundParams(int handle, int vol, int sep, int pitch);
 
+// -benchsound: times the game thread side of starting lots of sounds
+void I_BenchmarkSound(void);
+
 // NSM sound capture routines
 // silences sound output, and instead allows sound capture to work
 // call this before sound startup
@@ -139,6 +142,7 @@ extern int mus_fluidsynth_chorus;
 extern int mus_fluidsynth_reverb;
 extern int mus_fluidsynth_gain; // NSM  fine tune fluidsynth output level
 extern int mus_opl_gain; // NSM  fine tune OPL output level
+extern int mus_opl_prerender; // render OPL songs ahead of time on a thread
 extern const char *mus_portmidi_reset_type; // portmidi reset type
 extern int mus_portmidi_reset_delay; // portmidi delay after reset
 extern int mus_portmidi_filter_sysex; // portmidi block sysex from midi files
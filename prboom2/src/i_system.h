@@ -93,6 +93,9 @@ const char* I_FindFile2(const char* wfname, const char* ext);
 
 dboolean I_FileToBuffer(const char *filename, byte **data, int *size);
 
+unsigned int I_GetUptimeMS(void);
+size_t I_GetResidentMemory(void); // in KB, 0 if unknown
+
 /* cph 2001/11/18 - wrapper for read(2) which deals with partial reads */
 void I_Read(int fd, void* buf, size_t sz);
 
@@ -225,6 +225,30 @@ int M_remove(const char *path)
 #endif
 }
 
+// Replaces newpath if it exists, unlike rename() on Windows
+int M_rename(const char *oldpath, const char *newpath)
+{
+#ifdef _WIN32
+    wchar_t *wold = NULL, *wnew = NULL;
+    int ret = -1;
+
+    wold = ConvertUtf8ToWide(oldpath);
+    wnew = ConvertUtf8ToWide(newpath);
+
+    if (wold && wnew)
+    {
+        ret = MoveFileExW(wold, wnew, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+    }
+
+    free(wold);
+    free(wnew);
+
+    return ret;
+#else
+    return rename(oldpath, newpath);
+#endif
+}
+
 int M_stat(const char *path, struct stat *buf)
 {
 #ifdef _WIN32
@@ -22,6 +22,7 @@
 
 FILE *M_fopen(const char *filename, const char *mode);
 int M_remove(const char *path);
+int M_rename(const char *oldpath, const char *newpath);
 int M_stat(const char *path, struct stat *buf);
 int M_open(const char *filename, int oflag);
 int M_access(const char *path, int mode);
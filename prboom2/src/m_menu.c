@@ -66,6 +66,7 @@
 #include "r_demo.h"
 #include "r_fps.h"
 #include "e6y.h"//e6y
+#include "g_demoseek.h"
 #include "m_io.h"
 #ifdef _WIN32
 #include "e6y_launcher.h"
@@ -2607,13 +2608,15 @@ setup_menu_t keys_settings6[] =  // Key Binding screen strings
   {"DEMOS"                ,S_SKIP|S_TITLE,m_null,KB_X,KB_Y+5*8},
   {"START/STOP SKIPPING"  ,S_KEY     ,m_scrn,KB_X,KB_Y+ 6*8,{&key_demo_skip}},
   {"END LEVEL"            ,S_KEY     ,m_scrn,KB_X,KB_Y+ 7*8,{&key_demo_endlevel}},
-  {"CAMERA MODE"          ,S_KEY     ,m_scrn,KB_X,KB_Y+ 8*8,{&key_walkcamera}},
-  {"JOIN"                 ,S_KEY     ,m_scrn,KB_X,KB_Y+ 9*8,{&key_demo_jointogame}},
-  {"MISC"                 ,S_SKIP|S_TITLE,m_null,KB_X,KB_Y+10*8},
-  {"RESTART LEVEL/DEMO"   ,S_KEY     ,m_scrn,KB_X,KB_Y+ 11*8,{&key_level_restart}},
-  {"NEXT LEVEL"           ,S_KEY     ,m_scrn,KB_X,KB_Y+ 12*8,{&key_nextlevel}},
+  {"REWIND"               ,S_KEY     ,m_scrn,KB_X,KB_Y+ 8*8,{&key_demo_rewind}},
+  {"FAST FORWARD"         ,S_KEY     ,m_scrn,KB_X,KB_Y+ 9*8,{&key_demo_fastforward}},
+  {"CAMERA MODE"          ,S_KEY     ,m_scrn,KB_X,KB_Y+10*8,{&key_walkcamera}},
+  {"JOIN"                 ,S_KEY     ,m_scrn,KB_X,KB_Y+11*8,{&key_demo_jointogame}},
+  {"MISC"                 ,S_SKIP|S_TITLE,m_null,KB_X,KB_Y+12*8},
+  {"RESTART LEVEL/DEMO"   ,S_KEY     ,m_scrn,KB_X,KB_Y+ 13*8,{&key_level_restart}},
+  {"NEXT LEVEL"           ,S_KEY     ,m_scrn,KB_X,KB_Y+ 14*8,{&key_nextlevel}},
 #ifdef GL_DOOM
-  {"Show Alive Monsters"  ,S_KEY     ,m_scrn,KB_X,KB_Y+13*8,{&key_showalive}},
+  {"Show Alive Monsters"  ,S_KEY     ,m_scrn,KB_X,KB_Y+15*8,{&key_showalive}},
 #endif
 
   {"<- PREV",S_SKIP|S_PREV,m_null,KB_PREV,KB_Y+20*8, {keys_settings5}},
@@ -3408,6 +3411,7 @@ setup_menu_t gen_settings5[] = { // General Settings screen3
   {"Software Options",               S_SKIP|S_TITLE, m_null, G_X, G_Y+1*8},
   {"Screen Multiple Factor (1-None)", S_NUM,m_null,G_X,G_Y+2*8, {"render_screen_multiply"}, 0, 0, M_ChangeScreenMultipleFactor},
   {"Integer Screen Scaling",    S_YESNO,  m_null, G_X, G_Y+3*8, {"integer_scaling"}, 0, 0, M_ChangeScreenMultipleFactor},
+  {"Render Threads (1-None)",   S_NUM,    m_null, G_X, G_Y+4*8, {"render_threads"}},
 #ifdef GL_DOOM
   {"OpenGL Options",             S_SKIP|S_TITLE,m_null,G_X,G_Y+5*8},
   {"Multisampling (0-None)",    S_NUM|S_PRGWARN|S_CANT_GL_ARB_MULTISAMPLEFACTOR,m_null,G_X,G_Y+6*8, {"render_multisampling"}, 0, 0, M_ChangeMultiSample},
@@ -4993,6 +4997,15 @@ dboolean M_Responder (event_t* ev) {
       }
     }
 
+    if (ch == key_demo_rewind || ch == key_demo_fastforward)
+    {
+      if (demoplayback && singledemo)
+      {
+        G_DemoSeek(ch == key_demo_rewind ? -DEMO_SEEK_STEP : DEMO_SEEK_STEP);
+        return true;
+      }
+    }
+
     if (ch == key_walkcamera)
     {
       if (demoplayback && gamestate == GS_LEVEL)
@@ -78,7 +78,13 @@
 //e6y
 #include "gl_struct.h"
 #include "g_overflow.h"
+#include "g_demoseek.h"
 #include "e6y.h"
+#include "r_threads.h"
+#include "p_mapcache.h"
+#include "p_map.h"
+#include "p_maputl.h"
+#include "p_reject.h"
 #ifdef USE_WINDOWS_LAUNCHER
 #include "e6y_launcher.h"
 #endif
@@ -323,6 +329,14 @@ default_t defaults[] =
    def_hex, ss_none}, // 0, +1 for colours, +2 for non-ascii chars, +4 for skip-last-line
   {"level_precache",{(int*)&precache},{1},0,1,
    def_bool,ss_none}, // precache level data?
+  {"level_cache",{&level_cache},{0},0,1,
+   def_bool,ss_none}, // keep generated blockmaps and inflated nodes on disk
+  {"blockthings_index",{&blockthings_index},{0},0,1,
+   def_bool,ss_none}, // keep blockmap things in arrays for faster collision checks
+  {"reject_build",{&reject_build},{0},0,1,
+   def_bool,ss_none}, // build a REJECT table for levels that come without one
+  {"sight_cache",{&sight_cache},{0},0,1,
+   def_bool,ss_none}, // remember sight checks until a sector moves
   {"demo_smoothturns", {&demo_smoothturns},  {0},0,1,
    def_bool,ss_stat},
   {"demo_smoothturnsfactor", {&demo_smoothturnsfactor},  {6},1,SMOOTH_PLAYING_MAXFACTOR,
@@ -439,7 +453,7 @@ default_t defaults[] =
   {"music_volume",{&snd_MusicVolume},{8},0,15, def_int,ss_none},
   {"mus_pause_opt",{&mus_pause_opt},{1},0,2, // CPhipps - music pausing
    def_int, ss_none}, // 0 = kill music when paused, 1 = pause music, 2 = let music continue
-  {"snd_channels",{&default_numChannels},{MAX_CHANNELS},1,MAX_CHANNELS,
+  {"snd_channels",{&default_numChannels},{32},1,MAX_CHANNELS,
    def_int,ss_none}, // number of audio events simultaneously // killough
 #ifdef _WIN32
   {"snd_midiplayer",{NULL, &snd_midiplayer},{0,"fluidsynth"},UL,UL,def_str,ss_none},
@@ -457,6 +471,7 @@ default_t defaults[] =
   {"mus_fluidsynth_reverb",{&mus_fluidsynth_reverb},{0},0,1,def_bool,ss_none},
   {"mus_fluidsynth_gain",{&mus_fluidsynth_gain},{50},0,1000,def_int,ss_none}, // NSM  fine tune fluidsynth output level
   {"mus_opl_gain",{&mus_opl_gain},{50},0,1000,def_int,ss_none}, // NSM  fine tune opl output level
+  {"mus_opl_prerender",{&mus_opl_prerender},{0},0,1,def_bool,ss_none}, // render opl songs ahead of time on a thread
   {"mus_portmidi_reset_type",{NULL, &mus_portmidi_reset_type},{0,"gm"},UL,UL,def_str,ss_none}, // portmidi reset type (none, gs, gm, gm2, xg)
   {"mus_portmidi_reset_delay",{&mus_portmidi_reset_delay},{0},0,2000,def_int,ss_none}, // portmidi delay after reset (milliseconds)
   {"mus_portmidi_filter_sysex",{&mus_portmidi_filter_sysex},{1},0,1,def_bool,ss_none}, // portmidi block sysex from midi files
@@ -975,6 +990,10 @@ default_t defaults[] =
    0,MAX_KEY,def_key,ss_keys},
   {"key_demo_endlevel", {&key_demo_endlevel}, {KEYD_END},
    0,MAX_KEY,def_key,ss_keys},
+  {"key_demo_rewind", {&key_demo_rewind}, {'['},
+   0,MAX_KEY,def_key,ss_keys},
+  {"key_demo_fastforward", {&key_demo_fastforward}, {']'},
+   0,MAX_KEY,def_key,ss_keys},
   {"key_walkcamera", {&key_walkcamera}, {KEYD_KEYPAD0},
    0,MAX_KEY,def_key,ss_keys},
   {"key_showalive", {&key_showalive}, {KEYD_KEYPADDIVIDE},
@@ -1030,6 +1049,10 @@ default_t defaults[] =
    def_str,ss_none},
   {"demo_overwriteexisting", {&demo_overwriteexisting},  {1},0,1,
    def_bool,ss_stat},
+  {"demo_snapshot_interval", {&demo_snapshot_interval},  {10},0,3600,
+   def_int,ss_stat},
+  {"demo_snapshot_count", {&demo_snapshot_count},  {64},2,4096,
+   def_int,ss_stat},
   {"quickstart_window_ms", {&quickstart_window_ms},  {0},0,1000,
    def_int,ss_stat},
 
@@ -1083,6 +1106,8 @@ default_t defaults[] =
    def_int,ss_stat},
   {"integer_scaling", {&integer_scaling},  {0},0,1,
    def_bool,ss_stat},
+  {"render_threads", {&render_threads},  {1},1,MAX_RENDER_THREADS,
+   def_int,ss_stat}, // threads drawing planes and sprites in software mode
   {"render_aspect", {&render_aspect},  {0},0,4,
    def_int,ss_stat},
   {"render_doom_lightmaps", {&render_doom_lightmaps},  {0},0,1,
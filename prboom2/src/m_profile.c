@@ -0,0 +1,325 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Timing of the main loop by subsystem.
+ *
+ *      Each scope adds up the time between its PROFILE_BEGIN and
+ *      PROFILE_END; scopes may nest, but a scope may not be re-entered.
+ *      Nothing is measured unless profiling is set, so the hooks cost a
+ *      test of a global when it is off.
+ *
+ *      With -proftrace, every scope is also written as a Chrome trace
+ *      event (chrome://tracing, or https://ui.perfetto.dev), and the
+ *      thinker classes of each tic as a counter.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#include "doomtype.h"
+#include "lprintf.h"
+#include "m_argv.h"
+#include "i_system.h"
+#include "m_profile.h"
+
+dboolean profiling;
+
+static const char *prof_names[NUMPROFSCOPES] = {
+  "playsim", " players", " thinkers", " specials",
+  "render", " r_setup", " r_bsp", " r_draw",
+  "automap", "sound", "blit"
+};
+
+static uint_64_t prof_start[NUMPROFSCOPES];
+static uint_64_t prof_total[NUMPROFSCOPES];
+static int prof_calls[NUMPROFSCOPES];
+static uint_64_t prof_begin; // of the run, at the first scope
+static int prof_depth;
+
+static const char *class_names[MAXPROFCLASSES];
+static uint_64_t class_tic[MAXPROFCLASSES];
+static uint_64_t class_total[MAXPROFCLASSES];
+static int class_count_tic[MAXPROFCLASSES];
+static double class_count_total[MAXPROFCLASSES];
+static int numclasses;
+
+// the last second, for the HUD
+static uint_64_t window_begin;
+static uint_64_t window_total[NUMPROFSCOPES];
+static int window_calls[NUMPROFSCOPES];
+static uint_64_t window_class[MAXPROFCLASSES];
+static int window_class_count[MAXPROFCLASSES];
+static char hud_lines[PROFHUDLINES][32];
+static int hud_numlines;
+
+static FILE *tracefile;
+static int trace_events;
+static dboolean prof_reported;
+
+uint_64_t M_ProfileClock(void)
+{
+  return SDL_GetPerformanceCounter();
+}
+
+static double M_ProfileMicroseconds(uint_64_t ticks)
+{
+  return ticks * 1000000.0 / SDL_GetPerformanceFrequency();
+}
+
+static void M_ProfileTraceEvent(const char *fmt, ...)
+{
+  va_list va;
+
+  fputs(trace_events++ ? ",\n" : "", tracefile);
+  va_start(va, fmt);
+  vfprintf(tracefile, fmt, va);
+  va_end(va);
+}
+
+// Sorts class numbers by decreasing time
+static int M_ProfileSortClasses(int *order, const uint_64_t *times)
+{
+  int i, j, n = 0;
+
+  for (i = 0; i < numclasses; i++)
+  {
+    if (!times[i])
+      continue;
+    for (j = n++; j > 0 && times[order[j - 1]] < times[i]; j--)
+      order[j] = order[j - 1];
+    order[j] = i;
+  }
+  return n;
+}
+
+//
+// M_ProfileWindow
+//
+// Builds the HUD lines from the last second: ms per call of each scope
+// (a tic for the playsim, a frame for the rest), then the busiest
+// thinker classes with their thinkers and ms per tic.
+//
+static void M_ProfileWindow(uint_64_t now)
+{
+  double freq = (double)SDL_GetPerformanceFrequency();
+  int order[MAXPROFCLASSES];
+  int tics = window_calls[prof_thinkers];
+  int i, n;
+
+  hud_numlines = 0;
+  for (i = 0; i < NUMPROFSCOPES; i++)
+    if (window_calls[i])
+      doom_snprintf(hud_lines[hud_numlines++], sizeof(hud_lines[0]), "%-9s %6.2f", prof_names[i],
+              window_total[i] * 1000 / freq / window_calls[i]);
+
+  n = M_ProfileSortClasses(order, window_class);
+  for (i = 0; i < n && i < PROFHUDLINES - NUMPROFSCOPES && tics; i++)
+    doom_snprintf(hud_lines[hud_numlines++], sizeof(hud_lines[0]), "%-14.14s %5d %5.2f", class_names[order[i]],
+            window_class_count[order[i]] / tics, window_class[order[i]] * 1000 / freq / tics);
+
+  memset(window_total, 0, sizeof(window_total));
+  memset(window_calls, 0, sizeof(window_calls));
+  memset(window_class, 0, sizeof(window_class));
+  memset(window_class_count, 0, sizeof(window_class_count));
+  window_begin = now;
+}
+
+const char *M_ProfileHUDLine(int line)
+{
+  return line < hud_numlines ? hud_lines[line] : NULL;
+}
+
+void M_ProfileBegin(profscope_t scope)
+{
+  prof_start[scope] = SDL_GetPerformanceCounter();
+  if (!prof_begin)
+    prof_begin = window_begin = prof_start[scope];
+  prof_depth++;
+}
+
+void M_ProfileEnd(profscope_t scope)
+{
+  uint_64_t now = SDL_GetPerformanceCounter();
+  uint_64_t ticks = now - prof_start[scope];
+  int i;
+
+  prof_total[scope] += ticks;
+  prof_calls[scope]++;
+  window_total[scope] += ticks;
+  window_calls[scope]++;
+
+  if (tracefile)
+  {
+    M_ProfileTraceEvent("{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                        "\"pid\":1,\"tid\":1}", prof_names[scope] + (*prof_names[scope] == ' '),
+                        M_ProfileMicroseconds(prof_start[scope] - prof_begin),
+                        M_ProfileMicroseconds(ticks));
+  }
+
+  if (scope == prof_thinkers)
+  {
+    if (tracefile)
+    {
+      M_ProfileTraceEvent("{\"name\":\"thinkers\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{",
+                          M_ProfileMicroseconds(prof_start[scope] - prof_begin));
+      for (i = 0; i < numclasses; i++)
+        fprintf(tracefile, "%s\"%s\":%.3f", i ? "," : "", class_names[i],
+                M_ProfileMicroseconds(class_tic[i]));
+      fputs("}}", tracefile);
+    }
+    for (i = 0; i < numclasses; i++)
+    {
+      class_total[i] += class_tic[i];
+      window_class[i] += class_tic[i];
+      class_count_total[i] += class_count_tic[i];
+      window_class_count[i] += class_count_tic[i];
+      class_tic[i] = 0;
+      class_count_tic[i] = 0;
+    }
+  }
+
+  if (!--prof_depth && now - window_begin >= SDL_GetPerformanceFrequency())
+    M_ProfileWindow(now);
+}
+
+//
+// M_ProfileAddClass
+//
+// Returns a new class to charge thinker time to, or -1 when there are
+// too many.
+//
+int M_ProfileAddClass(const char *name)
+{
+  if (numclasses == MAXPROFCLASSES)
+    return -1;
+  class_names[numclasses] = name;
+  return numclasses++;
+}
+
+void M_ProfileClassTime(int cls, int count, uint_64_t ticks)
+{
+  if (cls >= 0)
+  {
+    class_tic[cls] += ticks;
+    class_count_tic[cls] += count;
+  }
+}
+
+void M_ProfileReport(int tics)
+{
+  double freq = (double)SDL_GetPerformanceFrequency();
+  double wall = prof_begin ? (SDL_GetPerformanceCounter() - prof_begin) / freq : 0;
+  int order[MAXPROFCLASSES];
+  int i, n;
+
+  prof_reported = true;
+  if (tics <= 0 || wall <= 0)
+    return;
+
+  lprintf(LO_INFO, "M_ProfileReport: %d tics in %.3f s, %.1f tics/s\n",
+          tics, wall, tics / wall);
+  for (i = 0; i < NUMPROFSCOPES; i++)
+  {
+    double t = prof_total[i] / freq;
+
+    if (!prof_calls[i])
+      continue;
+    lprintf(LO_INFO, " %-10s %9.1f ms %5.1f%% %8.2f us/tic\n",
+            prof_names[i], t * 1000, 100 * t / wall, t * 1000000 / tics);
+  }
+  {
+    double t = wall - (prof_total[prof_playsim] + prof_total[prof_render] +
+                       prof_total[prof_automap] + prof_total[prof_sound] +
+                       prof_total[prof_blit]) / freq;
+
+    lprintf(LO_INFO, " %-10s %9.1f ms %5.1f%% %8.2f us/tic\n",
+            "other", t * 1000, 100 * t / wall, t * 1000000 / tics);
+  }
+
+  n = M_ProfileSortClasses(order, class_total);
+  if (n)
+    lprintf(LO_INFO, "M_ProfileReport: thinkers by function\n");
+  for (i = 0; i < n; i++)
+  {
+    double t = class_total[order[i]] / freq;
+
+    lprintf(LO_INFO, " %-22s %9.1f ms %5.1f%% %8.2f us/tic %8.1f/tic\n",
+            class_names[order[i]], t * 1000, 100 * t / wall, t * 1000000 / tics,
+            class_count_total[order[i]] / tics);
+  }
+}
+
+static void M_ProfileShutdown(void)
+{
+  if (!prof_reported)
+    M_ProfileReport(prof_calls[prof_playsim]);
+  if (tracefile)
+  {
+    fputs("\n]}\n", tracefile);
+    fclose(tracefile);
+    tracefile = NULL;
+  }
+}
+
+//
+// M_ProfileInit
+//
+// -profile turns the profiler on, -proftrace <file> also writes the trace.
+//
+void M_ProfileInit(void)
+{
+  int p;
+
+  if (M_CheckParm("-profile"))
+    profiling = true;
+
+  if ((p = M_CheckParm("-proftrace")) && p < myargc - 1)
+  {
+    tracefile = fopen(myargv[p + 1], "w");
+    if (!tracefile)
+      lprintf(LO_WARN, "M_ProfileInit: unable to open %s\n", myargv[p + 1]);
+    else
+    {
+      fputs("{\"traceEvents\":[\n", tracefile);
+      profiling = true;
+    }
+  }
+
+  if (profiling)
+    I_AtExit(M_ProfileShutdown, true);
+}
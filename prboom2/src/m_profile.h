@@ -0,0 +1,76 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Timing of the main loop by subsystem.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef __M_PROFILE__
+#define __M_PROFILE__
+
+#include "doomtype.h"
+
+typedef enum {
+  prof_playsim,  // P_Ticker
+  prof_players,  // P_PlayerThink
+  prof_thinkers, // P_RunThinkers
+  prof_specials, // P_UpdateSpecials, P_RespawnSpecials
+  prof_render,   // R_RenderPlayerView
+  prof_r_setup,  // R_SetupFrame and clearing the buffers
+  prof_r_bsp,    // R_RenderBSPNode
+  prof_r_draw,   // planes and masked, or the GL scene
+  prof_automap,  // AM_Drawer
+  prof_sound,    // S_UpdateSounds
+  prof_blit,     // I_FinishUpdate
+  NUMPROFSCOPES
+} profscope_t;
+
+// Classes break the time and count of prof_thinkers down by thinker
+// function
+#define MAXPROFCLASSES 32
+
+extern dboolean profiling;
+
+void M_ProfileInit(void);
+void M_ProfileBegin(profscope_t scope);
+void M_ProfileEnd(profscope_t scope);
+int M_ProfileAddClass(const char *name);
+void M_ProfileClassTime(int cls, int count, uint_64_t ticks);
+uint_64_t M_ProfileClock(void);
+void M_ProfileReport(int tics);
+
+// The HUD widget: one line per call, NULL past the last
+#define PROFHUDLINES (NUMPROFSCOPES + 8)
+const char *M_ProfileHUDLine(int line);
+
+#define PROFILE_BEGIN(scope) do { if (profiling) M_ProfileBegin(scope); } while (0)
+#define PROFILE_END(scope)   do { if (profiling) M_ProfileEnd(scope); } while (0)
+
+#endif
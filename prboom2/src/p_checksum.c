@@ -3,10 +3,15 @@
 #include <errno.h>
 #include <stdlib.h> /* exit(), atexit() */
 #include "i_system.h" /* I_AtExit() */
+#include "i_main.h" /* I_SafeExit() */
 
 #include "p_checksum.h"
 #include "md5.h"
 #include "doomstat.h" /* players{,ingame} */
+#include "r_state.h" /* sectors */
+#include "p_spec.h"
+#include "p_tick.h"
+#include "m_random.h"
 #include "lprintf.h"
 
 #include "m_io.h"
@@ -19,6 +24,292 @@ void checksum_gamestate(int tic);
 static void p_checksum_nop(int tic){} /* do nothing */
 void (*P_Checksum)(int) = p_checksum_nop;
 
+/*
+ * Each tic is hashed per subsystem, so that a mismatch between two
+ * streams tells not only when, but also where the simulation diverged.
+ */
+enum {
+    cs_players,
+    cs_mobjs,
+    cs_sectors,
+    cs_specials,
+    cs_rng,
+    NUMCHECKSUMS
+};
+
+static const char *cs_names[NUMCHECKSUMS] = {
+    "players", "mobjs", "sectors", "specials", "rng"
+};
+
+/*
+ * 32-bit FNV-1a over whole ints. Much cheaper than formatting every field
+ * and running it through MD5, which matters when walking every thinker on
+ * every tic of a long demo.
+ */
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME  16777619u
+
+static unsigned int cs_hash[NUMCHECKSUMS];
+
+static void CS_Add(int cs, int value)
+{
+    unsigned int v = (unsigned int)value;
+    unsigned int h = cs_hash[cs];
+    int i;
+
+    for (i = 0; i < 4; i++, v >>= 8)
+        h = (h ^ (v & 0xff)) * FNV_PRIME;
+    cs_hash[cs] = h;
+}
+
+/* pointers are hashed by what they refer to, never by address */
+static void CS_AddMobjRef(int cs, const mobj_t *mo)
+{
+    if (!mo) {
+        CS_Add(cs, -1);
+        return;
+    }
+    CS_Add(cs, mo->type);
+    CS_Add(cs, mo->x);
+    CS_Add(cs, mo->y);
+}
+
+static void CS_AddSectorRef(int cs, const sector_t *sec)
+{
+    CS_Add(cs, sec ? sec->iSectorID : -1);
+}
+
+static void CS_AddState(int cs, const state_t *st)
+{
+    CS_Add(cs, st ? (int)(st - states) : -1);
+}
+
+static void checksum_players(void)
+{
+    int i, j;
+
+    for (i=0 ; i<MAXPLAYERS ; i++) {
+        const player_t *p = &players[i];
+
+        if (!playeringame[i]) continue;
+
+        CS_Add(cs_players, i);
+        CS_Add(cs_players, p->playerstate);
+        CS_Add(cs_players, p->health);
+        CS_Add(cs_players, p->armorpoints);
+        CS_Add(cs_players, p->armortype);
+        CS_Add(cs_players, p->viewz);
+        CS_Add(cs_players, p->viewheight);
+        CS_Add(cs_players, p->deltaviewheight);
+        CS_Add(cs_players, p->bob);
+        CS_Add(cs_players, p->momx);
+        CS_Add(cs_players, p->momy);
+        for (j=0; j<NUMPOWERS; j++)
+            CS_Add(cs_players, p->powers[j]);
+        for (j=0; j<NUMCARDS; j++)
+            CS_Add(cs_players, p->cards[j]);
+        CS_Add(cs_players, p->backpack);
+        CS_Add(cs_players, p->readyweapon);
+        CS_Add(cs_players, p->pendingweapon);
+        for (j=0; j<NUMWEAPONS; j++)
+            CS_Add(cs_players, p->weaponowned[j]);
+        for (j=0; j<NUMAMMO; j++) {
+            CS_Add(cs_players, p->ammo[j]);
+            CS_Add(cs_players, p->maxammo[j]);
+        }
+        CS_Add(cs_players, p->attackdown);
+        CS_Add(cs_players, p->usedown);
+        CS_Add(cs_players, p->refire);
+        CS_Add(cs_players, p->killcount);
+        CS_Add(cs_players, p->itemcount);
+        CS_Add(cs_players, p->secretcount);
+        CS_Add(cs_players, p->damagecount);
+        CS_Add(cs_players, p->bonuscount);
+        CS_Add(cs_players, p->extralight);
+        CS_AddMobjRef(cs_players, p->attacker);
+        for (j=0; j<NUMPSPRITES; j++) {
+            CS_AddState(cs_players, p->psprites[j].state);
+            CS_Add(cs_players, p->psprites[j].tics);
+            CS_Add(cs_players, p->psprites[j].sx);
+            CS_Add(cs_players, p->psprites[j].sy);
+        }
+    }
+}
+
+static void checksum_mobj(const mobj_t *mo)
+{
+    CS_Add(cs_mobjs, mo->type);
+    CS_Add(cs_mobjs, mo->x);
+    CS_Add(cs_mobjs, mo->y);
+    CS_Add(cs_mobjs, mo->z);
+    CS_Add(cs_mobjs, mo->momx);
+    CS_Add(cs_mobjs, mo->momy);
+    CS_Add(cs_mobjs, mo->momz);
+    CS_Add(cs_mobjs, mo->angle);
+    CS_Add(cs_mobjs, mo->floorz);
+    CS_Add(cs_mobjs, mo->ceilingz);
+    CS_Add(cs_mobjs, mo->dropoffz);
+    CS_Add(cs_mobjs, mo->radius);
+    CS_Add(cs_mobjs, mo->height);
+    CS_AddState(cs_mobjs, mo->state);
+    CS_Add(cs_mobjs, mo->tics);
+    CS_Add(cs_mobjs, (int)mo->flags);
+    CS_Add(cs_mobjs, (int)(mo->flags >> 32));
+    CS_Add(cs_mobjs, mo->intflags);
+    CS_Add(cs_mobjs, mo->health);
+    CS_Add(cs_mobjs, mo->movedir);
+    CS_Add(cs_mobjs, mo->movecount);
+    CS_Add(cs_mobjs, mo->strafecount);
+    CS_Add(cs_mobjs, mo->reactiontime);
+    CS_Add(cs_mobjs, mo->threshold);
+    CS_Add(cs_mobjs, mo->pursuecount);
+    CS_Add(cs_mobjs, mo->gear);
+    CS_Add(cs_mobjs, mo->lastlook);
+    CS_Add(cs_mobjs, mo->friction);
+    CS_Add(cs_mobjs, mo->movefactor);
+    CS_AddMobjRef(cs_mobjs, mo->target);
+    CS_AddMobjRef(cs_mobjs, mo->tracer);
+    CS_AddMobjRef(cs_mobjs, mo->lastenemy);
+}
+
+static void checksum_special(const thinker_t *th)
+{
+    /* thinkers are identified by function, so the hash covers both which
+     * specials exist, in which order, and what state they are in */
+    if (th->function == T_MoveFloor) {
+        const floormove_t *f = (const floormove_t *)th;
+        CS_Add(cs_specials, 1);
+        CS_AddSectorRef(cs_specials, f->sector);
+        CS_Add(cs_specials, f->type);
+        CS_Add(cs_specials, f->direction);
+        CS_Add(cs_specials, f->floordestheight);
+        CS_Add(cs_specials, f->speed);
+    } else if (th->function == T_MoveCeiling) {
+        const ceiling_t *c = (const ceiling_t *)th;
+        CS_Add(cs_specials, 2);
+        CS_AddSectorRef(cs_specials, c->sector);
+        CS_Add(cs_specials, c->type);
+        CS_Add(cs_specials, c->direction);
+        CS_Add(cs_specials, c->bottomheight);
+        CS_Add(cs_specials, c->topheight);
+        CS_Add(cs_specials, c->speed);
+    } else if (th->function == T_VerticalDoor) {
+        const vldoor_t *d = (const vldoor_t *)th;
+        CS_Add(cs_specials, 3);
+        CS_AddSectorRef(cs_specials, d->sector);
+        CS_Add(cs_specials, d->type);
+        CS_Add(cs_specials, d->direction);
+        CS_Add(cs_specials, d->topheight);
+        CS_Add(cs_specials, d->speed);
+        CS_Add(cs_specials, d->topcountdown);
+    } else if (th->function == T_PlatRaise) {
+        const plat_t *p = (const plat_t *)th;
+        CS_Add(cs_specials, 4);
+        CS_AddSectorRef(cs_specials, p->sector);
+        CS_Add(cs_specials, p->type);
+        CS_Add(cs_specials, p->status);
+        CS_Add(cs_specials, p->low);
+        CS_Add(cs_specials, p->high);
+        CS_Add(cs_specials, p->speed);
+        CS_Add(cs_specials, p->count);
+    } else if (th->function == T_MoveElevator) {
+        const elevator_t *e = (const elevator_t *)th;
+        CS_Add(cs_specials, 5);
+        CS_AddSectorRef(cs_specials, e->sector);
+        CS_Add(cs_specials, e->direction);
+        CS_Add(cs_specials, e->floordestheight);
+        CS_Add(cs_specials, e->ceilingdestheight);
+    } else if (th->function == T_LightFlash) {
+        const lightflash_t *l = (const lightflash_t *)th;
+        CS_Add(cs_specials, 6);
+        CS_AddSectorRef(cs_specials, l->sector);
+        CS_Add(cs_specials, l->count);
+    } else if (th->function == T_StrobeFlash) {
+        const strobe_t *s = (const strobe_t *)th;
+        CS_Add(cs_specials, 7);
+        CS_AddSectorRef(cs_specials, s->sector);
+        CS_Add(cs_specials, s->count);
+    } else if (th->function == T_Glow) {
+        const glow_t *g = (const glow_t *)th;
+        CS_Add(cs_specials, 8);
+        CS_AddSectorRef(cs_specials, g->sector);
+        CS_Add(cs_specials, g->direction);
+    } else if (th->function == T_FireFlicker) {
+        const fireflicker_t *f = (const fireflicker_t *)th;
+        CS_Add(cs_specials, 9);
+        CS_AddSectorRef(cs_specials, f->sector);
+        CS_Add(cs_specials, f->count);
+    } else if (th->function == T_Scroll) {
+        const scroll_t *s = (const scroll_t *)th;
+        CS_Add(cs_specials, 10);
+        CS_Add(cs_specials, s->type);
+        CS_Add(cs_specials, s->affectee);
+        CS_Add(cs_specials, s->last_height);
+        CS_Add(cs_specials, s->vdx);
+        CS_Add(cs_specials, s->vdy);
+    } else if (th->function == T_Pusher) {
+        const pusher_t *p = (const pusher_t *)th;
+        CS_Add(cs_specials, 11);
+        CS_Add(cs_specials, p->type);
+        CS_Add(cs_specials, p->affectee);
+        CS_Add(cs_specials, p->x_mag);
+        CS_Add(cs_specials, p->y_mag);
+    } else if (th->function == T_Friction) {
+        const friction_t *f = (const friction_t *)th;
+        CS_Add(cs_specials, 12);
+        CS_Add(cs_specials, f->affectee);
+        CS_Add(cs_specials, f->friction);
+    } else {
+        /* unknown or pending deletion: only its position in the list counts */
+        CS_Add(cs_specials, 0);
+    }
+}
+
+static void checksum_thinkers(void)
+{
+    thinker_t *th;
+
+    for (th = thinkercap.next; th != &thinkercap; th = th->next) {
+        if (th->function == P_MobjThinker)
+            checksum_mobj((const mobj_t *)th);
+        else
+            checksum_special(th);
+    }
+}
+
+static void checksum_sectors(void)
+{
+    int i;
+
+    for (i=0; i<numsectors; i++) {
+        const sector_t *sec = &sectors[i];
+
+        CS_Add(cs_sectors, sec->floorheight);
+        CS_Add(cs_sectors, sec->ceilingheight);
+        CS_Add(cs_sectors, sec->lightlevel);
+        CS_Add(cs_sectors, sec->special);
+        CS_Add(cs_sectors, sec->tag);
+        CS_Add(cs_sectors, sec->floorpic);
+        CS_Add(cs_sectors, sec->ceilingpic);
+        CS_Add(cs_sectors, sec->soundtraversed);
+        CS_Add(cs_sectors, sec->floordata != NULL);
+        CS_Add(cs_sectors, sec->ceilingdata != NULL);
+        CS_Add(cs_sectors, sec->lightingdata != NULL);
+    }
+}
+
+static void checksum_rng(void)
+{
+    int i;
+
+    /* pr_misc and its compatibility index are also driven by the menu and
+     * the status bar, so they are left out */
+    for (i=0; i<NUMPRCLASS; i++)
+        if (i != pr_misc)
+            CS_Add(cs_rng, rng.seed[i]);
+    CS_Add(cs_rng, rng.rndindex);
+}
+
 /*
  * P_RecordChecksum
  * sets up the file and function pointers to write out checksum data
@@ -58,7 +349,7 @@ void P_ChecksumFinal(void) {
     MD5Final(digest, &md5global);
     fprintf(outfile, "final: ");
     for (i=0; i<16; i++)
-        fprintf(outfile,"%x", digest[i]);
+        fprintf(outfile,"%02x", digest[i]);
     fprintf(outfile, "\n");
     MD5Init(&md5global);
 }
@@ -70,30 +361,110 @@ static void p_checksum_cleanup(void) {
 
 /*
  * runs on each tic when recording checksums
+ *
+ * Line format:
+ *   tic, total players=xxxxxxxx mobjs=xxxxxxxx sectors=xxxxxxxx ...
  */
 void checksum_gamestate(int tic) {
     int i;
-    struct MD5Context md5ctx;
-    unsigned char digest[16];
-    char buffer[2048];
+    unsigned int total = FNV_OFFSET;
 
-    fprintf(outfile,"%6d, ", tic);
+    for (i=0; i<NUMCHECKSUMS; i++)
+        cs_hash[i] = FNV_OFFSET;
 
-    /* based on "ArchivePlayers" */
-    MD5Init(&md5ctx);
-    for (i=0 ; i<MAXPLAYERS ; i++) {
-        if (!playeringame[i]) continue;
+    if (gamestate == GS_LEVEL) {
+        checksum_players();
+        checksum_thinkers();
+        checksum_sectors();
+        checksum_rng();
+    }
+
+    for (i=0; i<NUMCHECKSUMS; i++)
+        total = (total ^ cs_hash[i]) * FNV_PRIME;
+
+    fprintf(outfile,"%6d, %08x", tic, total);
+    for (i=0; i<NUMCHECKSUMS; i++)
+        fprintf(outfile," %s=%08x", cs_names[i], cs_hash[i]);
+    fprintf(outfile,"\n");
 
-        doom_snprintf (buffer, sizeof(buffer), "%d", players[i].health);
-        buffer[sizeof(buffer)-1] = 0;
+    MD5Update(&md5global, (md5byte const *)cs_hash, sizeof(cs_hash));
+}
+
+/*
+ * P_CompareChecksums
+ * compares two streams written by -checksum and reports the first tic
+ * and the subsystems at which they differ. Does not return.
+ */
+typedef struct {
+    int tic;
+    unsigned int total;
+    unsigned int hash[NUMCHECKSUMS];
+} cs_line_t;
+
+static dboolean CS_ReadLine(FILE *f, cs_line_t *line, int *lineno)
+{
+    char buffer[512];
 
-        MD5Update(&md5ctx, (md5byte const *)&buffer, strlen(buffer));
+    while (fgets(buffer, sizeof(buffer), f)) {
+        const char *p;
+        int i;
+
+        (*lineno)++;
+        if (sscanf(buffer, "%d, %x", &line->tic, &line->total) != 2)
+            continue; /* "final:" and anything unrecognised */
+
+        for (i=0; i<NUMCHECKSUMS; i++) {
+            line->hash[i] = 0;
+            if ((p = strstr(buffer, cs_names[i])) != NULL)
+                sscanf(p + strlen(cs_names[i]), "=%x", &line->hash[i]);
+        }
+        return true;
     }
-    MD5Final(digest, &md5ctx);
-    for (i=0; i<16; i++) {
-        MD5Update(&md5global, (md5byte const *)&digest[i], sizeof(digest[i]));
-        fprintf(outfile,"%x", digest[i]);
+    return false;
+}
+
+void P_CompareChecksums(const char *file1, const char *file2) {
+    FILE *f1, *f2;
+    cs_line_t l1, l2;
+    int n1 = 0, n2 = 0;
+    int rc = 0;
+    int i;
+
+    if (!(f1 = M_fopen(file1, "rb")))
+        I_Error("cannot open %s for reading checksum:\n%s\n", file1, strerror(errno));
+    if (!(f2 = M_fopen(file2, "rb")))
+        I_Error("cannot open %s for reading checksum:\n%s\n", file2, strerror(errno));
+
+    for (;;) {
+        dboolean more1 = CS_ReadLine(f1, &l1, &n1);
+        dboolean more2 = CS_ReadLine(f2, &l2, &n2);
+
+        if (!more1 || !more2) {
+            if (more1 != more2) {
+                lprintf(LO_INFO, "P_CompareChecksums: %s ends first at line %d\n",
+                        more1 ? file2 : file1, more1 ? n2 : n1);
+                rc = 1;
+            }
+            else
+                lprintf(LO_INFO, "P_CompareChecksums: no difference\n");
+            break;
+        }
+
+        if (l1.tic != l2.tic || l1.total != l2.total) {
+            lprintf(LO_INFO, "P_CompareChecksums: first difference at tic %d "
+                    "(lines %d/%d):", l1.tic, n1, n2);
+            if (l1.tic != l2.tic)
+                lprintf(LO_INFO, " tic (%d)", l2.tic);
+            for (i=0; i<NUMCHECKSUMS; i++)
+                if (l1.hash[i] != l2.hash[i])
+                    lprintf(LO_INFO, " %s", cs_names[i]);
+            lprintf(LO_INFO, "\n");
+            rc = 1;
+            break;
+        }
     }
 
-    fprintf(outfile,"\n");
+    fclose(f1);
+    fclose(f2);
+    I_SafeExit(rc);
 }
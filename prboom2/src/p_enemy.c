@@ -86,41 +86,100 @@ void P_ZBumpCheck(mobj_t *);                                        // phares
 // sound blocking lines cut off traversal.
 //
 // killough 5/5/98: reformatted, cleaned up
+//
+// Walks sec->soundlines with an explicit stack instead of recursing, so
+// huge maps can't overflow the C stack. Sectors are flooded in the same
+// order as before. A sector is only entered again with fewer sound
+// blocks, so it is on the stack at most twice.
+
+typedef struct {
+  sector_t *sec;
+  int soundblocks;
+  int next;          // next of sec->soundlines to follow
+} soundframe_t;
+
+static soundframe_t *soundstack;
+static int soundstackmax;
 
 static void P_RecursiveSound(sector_t *sec, int soundblocks,
            mobj_t *soundtarget)
 {
-  int i;
+  int depth;
+  const line_t *opened = NULL, *checked = NULL;
 
   // wake up all monsters in this sector
   if (sec->validcount == validcount && sec->soundtraversed <= soundblocks+1)
     return;             // already flooded
 
+  if (soundstackmax < 2*numsectors)
+  {
+    soundstackmax = 2*numsectors;
+    soundstack = realloc(soundstack, soundstackmax*sizeof(*soundstack));
+  }
+
   sec->validcount = validcount;
   sec->soundtraversed = soundblocks+1;
   P_SetTarget(&sec->soundtarget, soundtarget);
 
-  for (i=0; i<sec->linecount; i++)
+  depth = 0;
+  soundstack[0].sec = sec;
+  soundstack[0].soundblocks = soundblocks;
+  soundstack[0].next = 0;
+
+  while (depth >= 0)
+  {
+    soundframe_t *sp = &soundstack[depth];
+    const soundline_t *check;
+    const sector_t *front, *back;
+    sector_t *other;
+
+    if (sp->next == sp->sec->soundlinecount)
     {
-      sector_t *other;
-      line_t *check = sec->lines[i];
+      depth--;
+      continue;
+    }
 
-      if (!(check->flags & ML_TWOSIDED))
-        continue;
+    check = &sp->sec->soundlines[sp->next++];
+    checked = check->line;
 
-      P_LineOpening(check);
+    if (!check->other)
+      continue;         // no back side, P_LineOpening says closed
 
-      if (openrange <= 0)
-        continue;       // closed door
+    opened = check->line;
+    front = opened->frontsector;
+    back = opened->backsector;
 
-      other=sides[check->sidenum[sides[check->sidenum[0]].sector==sec]].sector;
+    if (MIN(front->ceilingheight, back->ceilingheight) -
+        MAX(front->floorheight, back->floorheight) <= 0)
+      continue;         // closed door
 
-      if (!(check->flags & ML_SOUNDBLOCK))
-        P_RecursiveSound(other, soundblocks, soundtarget);
+    if (!check->soundblock)
+      soundblocks = sp->soundblocks;
+    else
+      if (!sp->soundblocks)
+        soundblocks = 1;
       else
-        if (!soundblocks)
-          P_RecursiveSound(other, 1, soundtarget);
-    }
+        continue;
+
+    other = check->other;
+    if (other->validcount == validcount && other->soundtraversed <= soundblocks+1)
+      continue;         // already flooded
+
+    other->validcount = validcount;
+    other->soundtraversed = soundblocks+1;
+    P_SetTarget(&other->soundtarget, soundtarget);
+
+    sp = &soundstack[++depth];
+    sp->sec = other;
+    sp->soundblocks = soundblocks;
+    sp->next = 0;
+  }
+
+  // leave the P_LineOpening globals as the recursive walk did
+  if (opened)
+    P_LineOpening(opened);
+  if (checked != opened)
+    P_LineOpening(checked);
 }
 
 //
@@ -364,6 +423,7 @@ static dboolean P_Move(mobj_t *actor, dboolean dropoff) /* killough 9/12/98 */
       //         restores floorz, ceilingz and dropoffz values as well
       actor->x = origx;
       actor->y = origy;
+      P_TouchBlockThing(actor);
       movefactor *= FRACUNIT / ORIG_FRICTION_FACTOR / 4;
       actor->momx += FixedMul(deltax, movefactor);
       actor->momy += FixedMul(deltay, movefactor);
@@ -1488,6 +1548,7 @@ void A_SkelMissile(mobj_t *actor)
 
   mo->x += mo->momx;
   mo->y += mo->momy;
+  P_TouchBlockThing(mo);
   P_SetTarget(&mo->tracer, actor->target);
 }
 
@@ -1653,10 +1714,12 @@ static dboolean PIT_VileCheck(mobj_t *thing)
         radius = corpsehit->radius; // save temporarily
         corpsehit->height = corpsehit->info->height;
         corpsehit->radius = corpsehit->info->radius;
+        P_TouchBlockThing(corpsehit);
         corpsehit->flags |= MF_SOLID;
         check = P_CheckPosition(corpsehit,corpsehit->x,corpsehit->y);
         corpsehit->height = height; // restore
         corpsehit->radius = radius; // restore                      //   ^
+        P_TouchBlockThing(corpsehit);
         corpsehit->flags &= ~MF_SOLID;
       }                                                             //   |
                                                                     // phares
@@ -1719,6 +1782,7 @@ void A_VileChase(mobj_t* actor)
                     {
                       corpsehit->height = info->height; // fix Ghost bug
                       corpsehit->radius = info->radius; // fix Ghost bug
+                      P_TouchBlockThing(corpsehit);
                     }                                               // phares
 
       /* killough 7/18/98:
@@ -1857,6 +1921,7 @@ void A_VileAttack(mobj_t *actor)
   // move the fire between the vile and the player
   fire->x = actor->target->x - FixedMul (24*FRACUNIT, finecosine[an]);
   fire->y = actor->target->y - FixedMul (24*FRACUNIT, finesine[an]);
+  P_TouchBlockThing(fire);
   P_RadiusAttack(fire, actor, 70);
 }
 
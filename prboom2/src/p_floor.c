@@ -88,6 +88,8 @@ result_e T_MovePlane
   }
 #endif
 
+  P_SightSectorMoved(sector);
+
   switch(floorOrCeiling)
   {
     case 0:
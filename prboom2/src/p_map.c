@@ -517,6 +517,15 @@ dboolean PIT_CheckLine (line_t* ld)
 // PIT_CheckThing
 //
 
+// The position test of PIT_CheckThing, for the blockmap thing index
+
+static dboolean PIT_CheckThingSkip(const blockthing_t *bt)
+{
+  fixed_t blockdist = bt->radius + tmthing->radius;
+
+  return D_abs(bt->x - tmx) >= blockdist || D_abs(bt->y - tmy) >= blockdist;
+}
+
 static dboolean PIT_CheckThing(mobj_t *thing) // killough 3/26/98: make static
 {
   fixed_t blockdist;
@@ -815,7 +824,7 @@ dboolean P_CheckPosition (mobj_t* thing,fixed_t x,fixed_t y)
 
   for (bx=xl ; bx<=xh ; bx++)
     for (by=yl ; by<=yh ; by++)
-      if (!P_BlockThingsIterator(bx,by,PIT_CheckThing))
+      if (!P_BlockThingsIteratorSkip(bx,by,PIT_CheckThing,PIT_CheckThingSkip))
         return false;
 
   // check lines
@@ -1871,6 +1880,22 @@ int bombdamage;
 // that caused the explosion at "bombspot".
 //
 
+// The range test of PIT_RadiusAttack, for the blockmap thing index
+
+static dboolean PIT_RadiusAttackSkip(const blockthing_t *bt)
+{
+  fixed_t dx = D_abs(bt->x - bombspot->x);
+  fixed_t dy = D_abs(bt->y - bombspot->y);
+  fixed_t dist = dx>dy ? dx : dy;
+
+  dist = (dist - bt->radius) >> FRACBITS;
+
+  if (dist < 0)
+    dist = 0;
+
+  return dist >= bombdamage;
+}
+
 dboolean PIT_RadiusAttack (mobj_t* thing)
 {
   fixed_t dx;
@@ -1944,7 +1969,7 @@ void P_RadiusAttack(mobj_t* spot,mobj_t* source,int damage)
 
   for (y=yl ; y<=yh ; y++)
     for (x=xl ; x<=xh ; x++)
-      P_BlockThingsIterator (x, y, PIT_RadiusAttack );
+      P_BlockThingsIteratorSkip (x, y, PIT_RadiusAttack, PIT_RadiusAttackSkip);
 }
 
 
@@ -1971,6 +1996,7 @@ dboolean PIT_ChangeSector (mobj_t* thing)
     }
     thing->height = 0;
     thing->radius = 0;
+    P_TouchBlockThing(thing);
     if (colored_blood)
     {
       thing->flags |= MF_COLOREDBLOOD;
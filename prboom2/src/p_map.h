@@ -52,6 +52,10 @@ dboolean P_TryMove(mobj_t *thing, fixed_t x, fixed_t y, dboolean dropoff);
 dboolean P_TeleportMove(mobj_t *thing, fixed_t x, fixed_t y,dboolean boss);
 void    P_SlideMove(mobj_t *mo);
 dboolean P_CheckSight(mobj_t *t1, mobj_t *t2);
+extern int sight_cache;
+void    P_InitSightCache(void);
+void    P_ClearSightCache(void);
+void    P_SightSectorMoved(sector_t *sector);
 void    P_UseLines(player_t *player);
 
 typedef dboolean (*CrossSubsectorFunc)(int num);
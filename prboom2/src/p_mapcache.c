@@ -0,0 +1,224 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Persistent cache of derived level data.
+ *
+ *      Some level data is expensive to derive from the wad lumps on huge
+ *      maps. Three kinds are cached: the generated blockmap, inflated
+ *      ZDoom nodes and a REJECT built for a map that lacks one. They are
+ *      pointer free, so they can be written to disk once and read back on
+ *      the next run, keyed by the MD5 of the lumps they were built from.
+ *      Each entry is a small header followed by the raw data in native
+ *      byte order, read with fread into a buffer the caller owns.
+ *
+ *      Segs, subsectors and the sector line lists are not cached: they are
+ *      arrays of pointers into the level just loaded, and rebuilding them
+ *      is a linear pass that costs about as much as fixing up cached
+ *      indices would.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <string.h>
+
+#include "doomtype.h"
+#include "m_argv.h"
+#include "m_io.h"
+#include "i_system.h"
+#include "w_wad.h"
+#include "md5.h"
+#include "lprintf.h"
+#include "p_mapcache.h"
+
+int level_cache;
+
+#define MAPCACHE_MAGIC   "PRBMCACH"
+#define MAPCACHE_VERSION 1
+
+typedef struct
+{
+  char magic[8];
+  int version;
+  int intsize;    // rejects entries from another word size or byte order
+  int byteorder;
+  int size;
+} mapcache_header_t;
+
+static void P_MapCacheHeader(mapcache_header_t *header, size_t size)
+{
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, MAPCACHE_MAGIC, sizeof(header->magic));
+  header->version = MAPCACHE_VERSION;
+  header->intsize = sizeof(int);
+  header->byteorder = 0x01020304;
+  header->size = (int)size;
+}
+
+static char *P_MapCacheDir(void)
+{
+  static char *dir = NULL;
+
+  if (!dir)
+  {
+    const char *exedir = I_DoomExeDir();
+    int len = doom_snprintf(NULL, 0, "%s/levelcache", exedir);
+
+    dir = malloc(len + 1);
+    doom_snprintf(dir, len + 1, "%s/levelcache", exedir);
+  }
+
+  return dir;
+}
+
+static char *P_MapCacheFileName(const char *kind, const unsigned char key[16])
+{
+  static char name[PATH_MAX + 1];
+  char hex[33];
+  int i;
+
+  for (i = 0; i < 16; i++)
+    sprintf(hex + i * 2, "%02x", key[i]);
+
+  doom_snprintf(name, sizeof(name), "%s/%s-%s.bin", P_MapCacheDir(), kind, hex);
+
+  return name;
+}
+
+dboolean P_MapCacheEnabled(void)
+{
+  return level_cache || M_CheckParm("-levelcache");
+}
+
+//
+// P_MapCacheKey
+// MD5 over the length and contents of each of the given lumps
+//
+void P_MapCacheKey(unsigned char key[16], const int *lumps, int numlumps)
+{
+  struct MD5Context md5;
+  int i;
+
+  MD5Init(&md5);
+  for (i = 0; i < numlumps; i++)
+  {
+    int len = W_LumpLength(lumps[i]);
+    unsigned char lenbytes[4];
+
+    lenbytes[0] = len & 0xff;
+    lenbytes[1] = (len >> 8) & 0xff;
+    lenbytes[2] = (len >> 16) & 0xff;
+    lenbytes[3] = (len >> 24) & 0xff;
+    MD5Update(&md5, lenbytes, 4);
+
+    if (len > 0)
+    {
+      MD5Update(&md5, W_CacheLumpNum(lumps[i]), len);
+      W_UnlockLumpNum(lumps[i]);
+    }
+  }
+  MD5Final(key, &md5);
+}
+
+//
+// P_MapCacheLoad
+// Returns a malloc'ed copy of the cached data, or NULL if there is no
+// valid entry for this key.
+//
+void *P_MapCacheLoad(const char *kind, const unsigned char key[16], size_t *size)
+{
+  mapcache_header_t expected, header;
+  const char *filename;
+  void *data = NULL;
+  FILE *f;
+
+  filename = P_MapCacheFileName(kind, key);
+  if (!(f = M_fopen(filename, "rb")))
+    return NULL;
+
+  if (fread(&header, sizeof(header), 1, f) == 1)
+  {
+    P_MapCacheHeader(&expected, header.size);
+    if (header.size > 0 && !memcmp(&header, &expected, sizeof(header)))
+    {
+      data = malloc(header.size);
+      if (fread(data, header.size, 1, f) == 1)
+      {
+        *size = header.size;
+      }
+      else
+      {
+        free(data);
+        data = NULL;
+      }
+    }
+  }
+  fclose(f);
+
+  if (!data)
+    lprintf(LO_WARN, "P_MapCacheLoad: ignoring invalid cache file %s\n", filename);
+
+  return data;
+}
+
+//
+// P_MapCacheStore
+//
+void P_MapCacheStore(const char *kind, const unsigned char key[16], const void *data, size_t size)
+{
+  mapcache_header_t header;
+  const char *filename;
+  dboolean ok;
+  FILE *f;
+
+  M_mkdir(P_MapCacheDir());
+
+  filename = P_MapCacheFileName(kind, key);
+  if (!(f = M_fopen(filename, "wb")))
+  {
+    lprintf(LO_WARN, "P_MapCacheStore: unable to create %s\n", filename);
+    return;
+  }
+
+  P_MapCacheHeader(&header, size);
+  ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+       fwrite(data, size, 1, f) == 1;
+  ok = (fclose(f) == 0) && ok;
+
+  // a truncated entry would be rejected on load anyway, but don't leave
+  // it lying around
+  if (!ok)
+  {
+    lprintf(LO_WARN, "P_MapCacheStore: error writing %s\n", filename);
+    M_remove(filename);
+  }
+}
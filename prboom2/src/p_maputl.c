@@ -34,8 +34,11 @@
  *
  *-----------------------------------------------------------------------------*/
 
+#include <stddef.h>
+
 #include "doomstat.h"
 #include "doomtype.h"
+#include "m_argv.h"
 #include "m_bbox.h"
 #include "r_main.h"
 #include "p_maputl.h"
@@ -46,6 +49,20 @@
 #include "g_overflow.h"
 #include "e6y.h"//e6y
 
+// blockmap thing index, see P_BlockThingsIteratorSkip
+
+typedef struct
+{
+  dboolean dirty;       // the list changed since the array was built
+  unsigned int builds;  // times the array was built, for nested searches
+  int count, size;
+  blockthing_t *things;
+} blockcell_t;
+
+int blockthings_index;
+static blockcell_t *blockcells;
+static int numblockcells;
+
 //
 // P_AproxDistance
 // Gives an estimation of distance (not exact)
@@ -273,8 +290,13 @@ void P_UnsetThingPosition (mobj_t *thing)
        */
 
       mobj_t *bnext, **bprev = thing->bprev;
+
+      if (blockcells && bprev)
+        P_TouchBlockThing(thing);
+
       if (bprev && (*bprev = bnext = thing->bnext))  // unlink from block map
         bnext->bprev = bprev;
+      thing->blockcell = -1;
     }
 }
 
@@ -338,9 +360,13 @@ void P_SetThingPosition(mobj_t *thing)
           bnext->bprev = &thing->bnext;
         thing->bprev = link;
         *link = thing;
+
+        thing->blockcell = blocky*bmapwidth+blockx;
+        if (blockcells)
+          blockcells[thing->blockcell].dirty = true;
       }
       else        // thing is off the map
-        thing->bnext = NULL, thing->bprev = NULL;
+        thing->bnext = NULL, thing->bprev = NULL, thing->blockcell = -1;
     }
 }
 
@@ -412,6 +438,130 @@ dboolean P_BlockThingsIterator(int x, int y, dboolean func(mobj_t*))
   return true;
 }
 
+//
+// Blockmap thing index
+//
+// Optional copy of each blockmap cell's thing list as an array of
+// (mobj, x, y, radius), built when a cell is first searched after it
+// changed. P_BlockThingsIteratorSkip uses it to pass over things that
+// a PIT function would reject on position alone without loading the
+// mobj at all.
+//
+// A cell is marked dirty whenever a thing is linked into or unlinked
+// from it, and whenever a thing in it gets a new x, y or radius
+// without being relinked (P_TouchBlockThing). The first search of a
+// dirty cell rebuilds its array and clears the mark.
+//
+
+void P_InitBlockThings(void)
+{
+  int i;
+
+  for (i = 0; i < numblockcells; i++)
+    free(blockcells[i].things);
+  free(blockcells);
+  blockcells = NULL;
+  numblockcells = 0;
+
+  if (!blockthings_index && !M_CheckParm("-blockthings"))
+    return;
+
+  numblockcells = bmapwidth * bmapheight;
+  blockcells = calloc(numblockcells, sizeof(*blockcells));
+  for (i = 0; i < numblockcells; i++)
+    blockcells[i].dirty = true;
+}
+
+//
+// P_TouchBlockThing
+// Must be called when the x, y or radius of a thing that may be in the
+// blockmap changes without P_UnsetThingPosition/P_SetThingPosition.
+//
+
+void P_TouchBlockThing(mobj_t *thing)
+{
+  if (blockcells && thing->bprev && thing->blockcell >= 0)
+    blockcells[thing->blockcell].dirty = true;
+}
+
+static blockcell_t *P_GetBlockCell(int cell)
+{
+  blockcell_t *bc = &blockcells[cell];
+
+  if (bc->dirty)
+  {
+    mobj_t *mobj;
+
+    bc->count = 0;
+    for (mobj = blocklinks[cell]; mobj; mobj = mobj->bnext)
+    {
+      blockthing_t *bt;
+
+      if (bc->count == bc->size)
+      {
+        bc->size = bc->size ? bc->size * 2 : 8;
+        bc->things = realloc(bc->things, bc->size * sizeof(*bc->things));
+      }
+      bt = &bc->things[bc->count++];
+      bt->mo = mobj;
+      bt->x = mobj->x;
+      bt->y = mobj->y;
+      bt->radius = mobj->radius;
+    }
+    bc->dirty = false;
+    bc->builds++;
+  }
+  return bc;
+}
+
+//
+// P_BlockThingsIteratorSkip
+// Same as P_BlockThingsIterator, but does not call func for things
+// that skip returns true for. skip must only return true where func
+// would return true with no side effects. If func changes the cell,
+// the rest of it is walked as P_BlockThingsIterator would.
+//
+
+dboolean P_BlockThingsIteratorSkip(int x, int y, dboolean func(mobj_t*),
+                                   dboolean skip(const blockthing_t*))
+{
+  blockcell_t *bc;
+  unsigned int builds;
+  int cell, i;
+
+  if (!blockcells)
+    return P_BlockThingsIterator(x, y, func);
+
+  if (x<0 || y<0 || x>=bmapwidth || y>=bmapheight)
+    return true;
+
+  cell = y*bmapwidth+x;
+  bc = P_GetBlockCell(cell);
+  builds = bc->builds;
+
+  for (i = 0; i < bc->count; i++)
+  {
+    mobj_t *mobj;
+
+    if (skip(&bc->things[i]))
+      continue;
+
+    mobj = bc->things[i].mo;
+    if (!func(mobj))
+      return false;
+
+    if (bc->dirty || bc->builds != builds)
+    {
+      // the array is out of date, carry on the way the list does
+      for (mobj = mobj->bnext; mobj; mobj = mobj->bnext)
+        if (!func(mobj))
+          return false;
+      return true;
+    }
+  }
+  return true;
+}
+
 //
 // INTERCEPT ROUTINES
 //
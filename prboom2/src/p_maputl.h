@@ -65,6 +65,12 @@ typedef struct {
 
 typedef dboolean (*traverser_t)(intercept_t *in);
 
+/* what the blockmap thing index keeps of each thing */
+typedef struct {
+  mobj_t      *mo;
+  fixed_t     x, y, radius;
+} blockthing_t;
+
 fixed_t CONSTFUNC P_AproxDistance (fixed_t dx, fixed_t dy);
 int     PUREFUNC  P_PointOnLineSide (fixed_t x, fixed_t y, const line_t *line);
 int     PUREFUNC  P_BoxOnLineSide (const fixed_t *tmbox, const line_t *ld);
@@ -82,6 +88,12 @@ void    P_UnsetThingPosition(mobj_t *thing);
 void    P_SetThingPosition(mobj_t *thing);
 dboolean P_BlockLinesIterator (int x, int y, dboolean func(line_t *));
 dboolean P_BlockThingsIterator(int x, int y, dboolean func(mobj_t *));
+dboolean P_BlockThingsIteratorSkip(int x, int y, dboolean func(mobj_t *),
+                                   dboolean skip(const blockthing_t *));
+
+extern int blockthings_index;
+void P_InitBlockThings(void);
+void P_TouchBlockThing(mobj_t *thing);
 dboolean P_PathTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
                        int flags, dboolean trav(intercept_t *));
 
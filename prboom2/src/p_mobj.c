@@ -1552,6 +1552,7 @@ void P_CheckMissileSpawn (mobj_t* th)
   th->x += (th->momx>>1);
   th->y += (th->momy>>1);
   th->z += (th->momz>>1);
+  P_TouchBlockThing(th);
 
   // killough 8/12/98: for non-missile objects (e.g. grenades)
   if (!(th->flags & MF_MISSILE) && mbf_features)
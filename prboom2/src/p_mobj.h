@@ -374,6 +374,10 @@ typedef struct mobj_s
 
     fixed_t             bloodcolor; // [FG] renamed from "pad", now used to track the thing's blood color
 
+    // blocklinks index the thing is linked into, or -1; not saved, and
+    // last so the raw mobj_t of older savegames still loads
+    int                 blockcell;
+
     // SEE WARNING ABOVE ABOUT POINTER FIELDS!!!
 } mobj_t;
 
@@ -0,0 +1,681 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Building a REJECT table for maps that come without one.
+ *
+ *      Many maps are built without a REJECT table, or with one that is
+ *      all zeros, so every P_CheckSight walks the BSP. This builds the
+ *      table from the map: a pair of sectors is only rejected when no
+ *      straight line can get from one to the other through the two sided
+ *      lines, whatever the heights of the sectors. The sight code would
+ *      find such a line of sight blocked anyway, so the game plays the
+ *      same, only the checks end early.
+ *
+ *      For each source sector, the lines of sight leaving it through each
+ *      of its two sided lines (portals) are followed from sector to
+ *      sector. The window of a portal a line of sight can pass is clipped
+ *      to the far sides of the source portal and the portal it came
+ *      through, and to the separating lines between those two, as in a
+ *      potentially visible set. Portals are made a little longer and the
+ *      clipping a little looser than exact, to cover the rounding of the
+ *      fixed point sight code.
+ *
+ *      Sectors that are not closed, or that contain self referencing
+ *      lines or subsectors of other sectors, may be seen from anywhere:
+ *      their subsectors need not lie where their lines say. Sources that
+ *      take too long to follow are also left all visible.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+#include "SDL_thread.h"
+
+#include "doomstat.h"
+#include "m_argv.h"
+#include "r_state.h"
+#include "p_mapcache.h"
+#include "i_system.h"
+#include "z_zone.h"
+#include "md5.h"
+#include "lprintf.h"
+#include "p_reject.h"
+
+int reject_build;
+dboolean reject_built;
+const byte *rejectwad;
+rejectstats_t rejectstats;
+dboolean reject_verify;
+
+// Slack for the rounding of the sight code, in map units: portals are
+// longer by REJECT_MARGIN at both ends, and clipping keeps everything
+// within REJECT_EPSILON of the kept side.
+#define REJECT_MARGIN  4.0
+#define REJECT_EPSILON 2.0
+
+// windows followed from one source sector before it is given up
+#define REJECT_BUDGET 200000
+
+#define MAX_REJECT_THREADS 16
+
+typedef struct
+{
+  double x1, y1, x2, y2; // the line, longer by REJECT_MARGIN at both ends
+  double nx, ny, d;      // unit normal, nx*x + ny*y > d beyond the portal
+  double pad;            // REJECT_EPSILON as a fraction of the length
+  int to;                // the sector beyond
+  int back;              // the same line the other way
+} rportal_t;
+
+typedef struct
+{
+  int portal;
+  double t0, t1;         // the part of it a line of sight may pass
+} rwindow_t;
+
+typedef struct
+{
+  byte *reached;         // sectors reached from the source
+  unsigned int *stamp;   // per portal, the source portal memo belongs to
+  double *memo;          // per portal, the window followed so far
+  unsigned int curstamp;
+  rwindow_t *stack;
+  int stacksize, stackmax;
+} rworker_t;
+
+static rportal_t *portals;
+static int numportals;
+static int *sectorportals; // numsectors + 1, first portal out of each
+static byte *badsector;
+static byte *visible;      // numsectors rows of rowbytes, by source
+static int rowbytes;
+static SDL_atomic_t nextsector;
+static SDL_atomic_t givenup;
+
+static void P_RejectInitPortal(rportal_t *p, const line_t *li, int to, int dir)
+{
+  double x1 = li->v1->x / 65536.0, y1 = li->v1->y / 65536.0;
+  double x2 = li->v2->x / 65536.0, y2 = li->v2->y / 65536.0;
+  double len = sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
+  double ux = (x2 - x1) / len, uy = (y2 - y1) / len;
+
+  p->x1 = x1 - ux * REJECT_MARGIN;
+  p->y1 = y1 - uy * REJECT_MARGIN;
+  p->x2 = x2 + ux * REJECT_MARGIN;
+  p->y2 = y2 + uy * REJECT_MARGIN;
+  // the back side of a line is on its left
+  p->nx = -uy * dir;
+  p->ny = ux * dir;
+  p->d = p->nx * x1 + p->ny * y1;
+  p->pad = REJECT_EPSILON / (len + 2 * REJECT_MARGIN);
+  p->to = to;
+}
+
+static dboolean P_RejectIsPortal(const line_t *li)
+{
+  return (li->flags & ML_TWOSIDED) && li->backsector &&
+         li->frontsector != li->backsector && (li->dx || li->dy);
+}
+
+//
+// P_RejectPortals
+// Two portals for each two sided line, grouped by the sector they lead
+// out of.
+//
+static void P_RejectPortals(void)
+{
+  int *fill;
+  int i;
+
+  sectorportals = calloc(numsectors + 1, sizeof(*sectorportals));
+  for (i = 0; i < numlines; i++)
+    if (P_RejectIsPortal(&lines[i]))
+    {
+      sectorportals[lines[i].frontsector->iSectorID + 1]++;
+      sectorportals[lines[i].backsector->iSectorID + 1]++;
+    }
+  for (i = 0; i < numsectors; i++)
+    sectorportals[i + 1] += sectorportals[i];
+  numportals = sectorportals[numsectors];
+
+  portals = malloc(numportals * sizeof(*portals));
+  fill = malloc(numsectors * sizeof(*fill));
+  memcpy(fill, sectorportals, numsectors * sizeof(*fill));
+  for (i = 0; i < numlines; i++)
+    if (P_RejectIsPortal(&lines[i]))
+    {
+      const line_t *li = &lines[i];
+      int front = fill[li->frontsector->iSectorID]++;
+      int back = fill[li->backsector->iSectorID]++;
+
+      P_RejectInitPortal(&portals[front], li, li->backsector->iSectorID, 1);
+      P_RejectInitPortal(&portals[back], li, li->frontsector->iSectorID, -1);
+      portals[front].back = back;
+      portals[back].back = front;
+    }
+  free(fill);
+}
+
+//
+// P_RejectBadSectors
+// Marks the sectors whose subsectors may lie outside their lines: those
+// with self referencing lines, two sided lines without a back, lines that
+// do not close, and those sharing a subsector with another sector.
+// Returns how many there are.
+//
+static int P_RejectBadSectors(void)
+{
+  byte *parity = calloc(numvertexes, 1);
+  int i, j, count = 0;
+
+  badsector = calloc(numsectors, 1);
+
+  for (i = 0; i < numlines; i++)
+  {
+    const line_t *li = &lines[i];
+
+    if (li->frontsector == li->backsector ||
+        ((li->flags & ML_TWOSIDED) && !li->backsector))
+      badsector[li->frontsector->iSectorID] = 1;
+  }
+
+  // every vertex of a closed sector has an even number of its lines
+  for (i = 0; i < numsectors; i++)
+  {
+    const sector_t *sec = &sectors[i];
+
+    for (j = 0; j < sec->linecount; j++)
+    {
+      const line_t *li = sec->lines[j];
+
+      if (li->frontsector == li->backsector)
+        continue;
+      parity[li->v1 - vertexes] ^= 1;
+      parity[li->v2 - vertexes] ^= 1;
+    }
+    for (j = 0; j < sec->linecount; j++)
+    {
+      const line_t *li = sec->lines[j];
+
+      if (parity[li->v1 - vertexes] || parity[li->v2 - vertexes])
+        badsector[i] = 1;
+    }
+    for (j = 0; j < sec->linecount; j++)
+    {
+      parity[sec->lines[j]->v1 - vertexes] = 0;
+      parity[sec->lines[j]->v2 - vertexes] = 0;
+    }
+  }
+
+  for (i = 0; i < numsubsectors; i++)
+  {
+    const subsector_t *ss = &subsectors[i];
+
+    for (j = 0; j < ss->numlines; j++)
+    {
+      const seg_t *seg = &segs[ss->firstline + j];
+
+      if (seg->linedef && seg->frontsector != ss->sector)
+      {
+        badsector[ss->sector->iSectorID] = 1;
+        badsector[seg->frontsector->iSectorID] = 1;
+      }
+    }
+  }
+
+  for (i = 0; i < numsectors; i++)
+    count += badsector[i];
+
+  free(parity);
+  return count;
+}
+
+//
+// P_RejectClip
+// Narrows [*t0, *t1] of portal q to where a*x + b*y >= c, give or take
+// REJECT_EPSILON. Returns false if nothing is left.
+//
+static dboolean P_RejectClip(const rportal_t *q, double a, double b, double c,
+                             double *t0, double *t1)
+{
+  double len = sqrt(a * a + b * b);
+  double d1, d2, t;
+
+  if (len == 0)
+    return true;
+
+  d1 = (a * q->x1 + b * q->y1 - c) / len + REJECT_EPSILON;
+  d2 = (a * q->x2 + b * q->y2 - c) / len + REJECT_EPSILON;
+  if (d1 >= 0 && d2 >= 0)
+    return true;
+  if (d1 < 0 && d2 < 0)
+    return false;
+
+  t = d1 / (d1 - d2);
+  if (d1 < 0)
+  {
+    if (t > *t0)
+      *t0 = t;
+  }
+  else if (t < *t1)
+    *t1 = t;
+
+  return *t0 <= *t1;
+}
+
+static void P_RejectPush(rworker_t *w, int portal, double t0, double t1)
+{
+  rwindow_t *win;
+
+  // nothing new if a wider window was followed already
+  if (w->stamp[portal] == w->curstamp &&
+      w->memo[portal * 2] <= t0 && t1 <= w->memo[portal * 2 + 1])
+    return;
+
+  if (w->stacksize == w->stackmax)
+  {
+    // not the zone, this runs on the worker threads
+    w->stackmax = w->stackmax ? w->stackmax * 2 : 256;
+    w->stack = (realloc)(w->stack, w->stackmax * sizeof(*w->stack));
+  }
+  win = &w->stack[w->stacksize++];
+  win->portal = portal;
+  win->t0 = t0;
+  win->t1 = t1;
+}
+
+//
+// P_RejectFlow
+// Follows the lines of sight that left the source through portal s and
+// pass the given window, into the sector beyond it and on to the portals
+// out of that sector.
+//
+static void P_RejectFlow(rworker_t *w, const rportal_t *s, const rwindow_t *win)
+{
+  const rportal_t *p = &portals[win->portal];
+  double *memo = &w->memo[win->portal * 2];
+  double t0 = win->t0, t1 = win->t1;
+  double sep[2][3];
+  int numseps = 0;
+  int q;
+
+  // follow the union of everything that got here, so that each portal is
+  // followed again only when its window grows by REJECT_EPSILON
+  if (w->stamp[win->portal] == w->curstamp)
+  {
+    if (memo[0] <= t0 && t1 <= memo[1])
+      return;
+    t0 = MIN(t0, memo[0]);
+    t1 = MAX(t1, memo[1]);
+  }
+  t0 = MAX(0, t0 - p->pad);
+  t1 = MIN(1, t1 + p->pad);
+  w->stamp[win->portal] = w->curstamp;
+  memo[0] = t0;
+  memo[1] = t1;
+
+  w->reached[p->to] = 1;
+
+  // Lines of sight through s and the window lie between the separating
+  // lines through an end of each, that have s and the window on opposite
+  // sides. That only holds while s is wholly behind the window.
+  if (s != p &&
+      p->nx * s->x1 + p->ny * s->y1 - p->d < -REJECT_EPSILON &&
+      p->nx * s->x2 + p->ny * s->y2 - p->d < -REJECT_EPSILON)
+  {
+    double px[2], py[2], sx[2], sy[2];
+    int i, j;
+
+    px[0] = p->x1 + t0 * (p->x2 - p->x1);
+    py[0] = p->y1 + t0 * (p->y2 - p->y1);
+    px[1] = p->x1 + t1 * (p->x2 - p->x1);
+    py[1] = p->y1 + t1 * (p->y2 - p->y1);
+    sx[0] = s->x1; sy[0] = s->y1;
+    sx[1] = s->x2; sy[1] = s->y2;
+
+    for (i = 0; i < 2; i++)
+      for (j = 0; j < 2; j++)
+      {
+        double a = sy[i] - py[j], b = px[j] - sx[i];
+        double len = sqrt(a * a + b * b);
+        double os = a * (sx[!i] - sx[i]) + b * (sy[!i] - sy[i]);
+        double op = a * (px[!j] - sx[i]) + b * (py[!j] - sy[i]);
+
+        // undecided near the line: leave it out, which only keeps more
+        if (len == 0 || fabs(os) <= REJECT_EPSILON * len ||
+            fabs(op) <= REJECT_EPSILON * len || (os < 0) == (op < 0) ||
+            numseps == 2)
+          continue;
+        if (op < 0)
+          a = -a, b = -b;
+        sep[numseps][0] = a;
+        sep[numseps][1] = b;
+        sep[numseps][2] = a * sx[i] + b * sy[i];
+        numseps++;
+      }
+  }
+
+  for (q = sectorportals[p->to]; q < sectorportals[p->to + 1]; q++)
+  {
+    const rportal_t *r = &portals[q];
+    double r0 = 0, r1 = 1;
+    int i;
+
+    if (q == p->back)
+      continue;
+    if (!P_RejectClip(r, p->nx, p->ny, p->d, &r0, &r1) ||
+        !P_RejectClip(r, s->nx, s->ny, s->d, &r0, &r1))
+      continue;
+    for (i = 0; i < numseps; i++)
+      if (!P_RejectClip(r, sep[i][0], sep[i][1], sep[i][2], &r0, &r1))
+        break;
+    if (i == numseps)
+      P_RejectPush(w, q, r0, r1);
+  }
+}
+
+//
+// P_RejectFlowSector
+// Fills the row of sectors that may be seen from the source.
+//
+static void P_RejectFlowSector(rworker_t *w, int source)
+{
+  byte *row = visible + source * rowbytes;
+  int budget = REJECT_BUDGET;
+  int s, i;
+
+  if (badsector[source])
+  {
+    memset(row, 0xff, rowbytes);
+    return;
+  }
+
+  memset(w->reached, 0, numsectors);
+  w->reached[source] = 1;
+
+  for (s = sectorportals[source]; s < sectorportals[source + 1]; s++)
+  {
+    w->curstamp++;
+    w->stacksize = 0;
+    P_RejectPush(w, s, 0, 1);
+
+    while (w->stacksize)
+    {
+      rwindow_t win = w->stack[--w->stacksize];
+
+      // lines of sight may go anywhere from a bad sector
+      if (--budget < 0 || badsector[portals[win.portal].to])
+      {
+        memset(row, 0xff, rowbytes);
+        if (budget < 0)
+          SDL_AtomicAdd(&givenup, 1);
+        return;
+      }
+      P_RejectFlow(w, &portals[s], &win);
+    }
+  }
+
+  for (i = 0; i < numsectors; i++)
+    if (w->reached[i])
+      row[i >> 3] |= 1 << (i & 7);
+}
+
+static int P_RejectWorker(void *arg)
+{
+  rworker_t *w = arg;
+  int i;
+
+  while ((i = SDL_AtomicAdd(&nextsector, 1)) < numsectors)
+    P_RejectFlowSector(w, i);
+
+  return 0;
+}
+
+//
+// P_RejectCompute
+// Fills reject with the sector pairs that cannot see each other either
+// way, following the sources on as many threads as there are CPUs.
+//
+static void P_RejectCompute(byte *reject)
+{
+  rworker_t workers[MAX_REJECT_THREADS];
+  SDL_Thread *threads[MAX_REJECT_THREADS];
+  int count = MIN(SDL_GetCPUCount(), MAX_REJECT_THREADS);
+  int i, j;
+
+  if (count < 1 || numsectors < 256)
+    count = 1;
+
+  rowbytes = (numsectors + 7) / 8;
+  visible = calloc(numsectors, rowbytes);
+  SDL_AtomicSet(&nextsector, 0);
+  SDL_AtomicSet(&givenup, 0);
+
+  memset(workers, 0, sizeof(workers));
+  for (i = 0; i < count; i++)
+  {
+    workers[i].reached = malloc(numsectors);
+    workers[i].stamp = calloc(numportals + 1, sizeof(*workers[i].stamp));
+    workers[i].memo = malloc((numportals + 1) * 2 * sizeof(*workers[i].memo));
+  }
+
+  // the main thread is worker 0
+  for (i = 1; i < count; i++)
+    threads[i] = SDL_CreateThread(P_RejectWorker, "reject_worker", &workers[i]);
+  P_RejectWorker(&workers[0]);
+  for (i = 1; i < count; i++)
+    if (threads[i])
+      SDL_WaitThread(threads[i], NULL);
+
+  for (i = 0; i < count; i++)
+  {
+    free(workers[i].reached);
+    free(workers[i].stamp);
+    free(workers[i].memo);
+    (free)(workers[i].stack);
+  }
+
+  memset(reject, 0, (numsectors * numsectors + 7) / 8);
+  for (i = 0; i < numsectors; i++)
+  {
+    const byte *rowi = visible + i * rowbytes;
+
+    for (j = i + 1; j < numsectors; j++)
+    {
+      const byte *rowj = visible + j * rowbytes;
+
+      if (!(rowi[j >> 3] & (1 << (j & 7))) && !(rowj[i >> 3] & (1 << (i & 7))))
+      {
+        int pnum = i * numsectors + j;
+
+        reject[pnum >> 3] |= 1 << (pnum & 7);
+        pnum = j * numsectors + i;
+        reject[pnum >> 3] |= 1 << (pnum & 7);
+      }
+    }
+  }
+
+  free(visible);
+  visible = NULL;
+}
+
+//
+// P_BuildReject
+// Returns a REJECT with built entries added to the level's own, for
+// levels whose REJECT is short or empty and when -buildreject or
+// reject_build ask for it, else NULL. The result is PU_LEVEL.
+//
+const byte *P_BuildReject(int lumpnum, const byte *reject, int length)
+{
+  static dboolean atexit_set;
+  int required = (numsectors * numsectors + 7) / 8;
+  unsigned int start = SDL_GetTicks();
+  int i, bad, pairs = 0, wadpairs = 0;
+  dboolean usecache = P_MapCacheEnabled();
+  unsigned char key[16];
+  byte *built;
+  size_t size;
+  void *cached = NULL;
+
+  reject_built = false;
+  rejectwad = NULL;
+  memset(&rejectstats, 0, sizeof(rejectstats));
+
+  if (!reject_build && !M_CheckParm("-buildreject"))
+    return NULL;
+
+  // the v1.2 sight code goes by the blockmap, which may miss lines
+  if (compatibility_level == doom_12_compatibility || numsectors < 2)
+    return NULL;
+
+  // leave real REJECT tables alone
+  if (length >= required)
+  {
+    for (i = 0; i < required && !reject[i]; i++)
+      ;
+    if (i < required)
+      return NULL;
+  }
+
+  bad = P_RejectBadSectors();
+
+  if (usecache)
+  {
+    int lumps[4];
+    struct MD5Context md5;
+
+    lumps[0] = lumpnum + ML_VERTEXES;
+    lumps[1] = lumpnum + ML_LINEDEFS;
+    lumps[2] = lumpnum + ML_SIDEDEFS;
+    lumps[3] = lumpnum + ML_SECTORS;
+    P_MapCacheKey(key, lumps, 4);
+
+    // the nodes decide which sectors are bad
+    MD5Init(&md5);
+    MD5Update(&md5, key, 16);
+    MD5Update(&md5, badsector, numsectors);
+    MD5Final(key, &md5);
+
+    cached = P_MapCacheLoad("reject", key, &size);
+    if (cached && size != (size_t)required)
+    {
+      free(cached);
+      cached = NULL;
+    }
+  }
+
+  built = Z_Malloc(required, PU_LEVEL, NULL);
+  if (cached)
+  {
+    memcpy(built, cached, required);
+    free(cached);
+  }
+  else
+  {
+    P_RejectPortals();
+    P_RejectCompute(built);
+    if (usecache)
+      P_MapCacheStore("reject", key, built, required);
+    free(portals);
+    free(sectorportals);
+    portals = NULL;
+    sectorportals = NULL;
+  }
+  free(badsector);
+  badsector = NULL;
+
+  for (i = 0; i < numsectors * numsectors; i++)
+  {
+    if (built[i >> 3] & (1 << (i & 7)))
+      pairs++;
+    if (reject[i >> 3] & (1 << (i & 7)))
+      wadpairs++;
+  }
+  for (i = 0; i < required; i++)
+    built[i] |= reject[i];
+
+  lprintf(LO_INFO, "P_BuildReject: %d of %d sector pairs rejected "
+          "(%d by the level's REJECT), %d sectors left visible, "
+          "%d sources given up, %u ms%s\n",
+          pairs, numsectors * numsectors, wadpairs, bad,
+          cached ? 0 : SDL_AtomicGet(&givenup), SDL_GetTicks() - start,
+          cached ? " (cached)" : "");
+
+  rejectwad = reject;
+  reject_built = true;
+  reject_verify = M_CheckParm("-rejectverify");
+  if (!atexit_set)
+  {
+    I_AtExit(P_RejectReport, false);
+    atexit_set = true;
+  }
+
+  return built;
+}
+
+//
+// P_RejectReport
+// Prints how the built REJECT did on the level, see P_CheckSight.
+//
+void P_RejectReport(void)
+{
+  double ms = 1000.0 / SDL_GetPerformanceFrequency();
+  double saved;
+
+  if (!reject_built || !rejectstats.checks)
+    return;
+
+  if (reject_verify)
+    saved = rejectstats.verifytime * ms;
+  else if (rejectstats.blocked)
+    saved = (double)rejectstats.hits * rejectstats.blockedtime / rejectstats.blocked * ms;
+  else
+    saved = 0;
+
+  lprintf(LO_INFO, "P_RejectReport: %d sight checks, %.1f%% rejected by the "
+          "built REJECT, %.1f%% by the level's own\n", rejectstats.checks,
+          100.0 * rejectstats.hits / rejectstats.checks,
+          100.0 * rejectstats.wadhits / rejectstats.checks);
+  lprintf(LO_INFO, " %d traced in %.1f ms, %.1f ms of tracing saved%s\n",
+          rejectstats.traced, rejectstats.tracetime * ms, saved,
+          reject_verify ? "" : " (estimated from the blocked traces)");
+  if (reject_verify)
+    lprintf(rejectstats.errors ? LO_WARN : LO_INFO,
+            " -rejectverify: %d rejected lines of sight were clear\n",
+            rejectstats.errors);
+
+  memset(&rejectstats, 0, sizeof(rejectstats));
+}
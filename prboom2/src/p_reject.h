@@ -0,0 +1,65 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Building a REJECT table for maps that come without one.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef __P_REJECT__
+#define __P_REJECT__
+
+#include "doomtype.h"
+
+extern int reject_build;        // config: build missing REJECT tables
+
+// set while the level's REJECT has built entries, see P_CheckSight
+extern dboolean reject_built;
+extern const byte *rejectwad;   // the level's own REJECT
+
+typedef struct
+{
+  int checks;           // sight checks
+  int wadhits;          // rejected by the level's own REJECT
+  int hits;             // rejected by the built entries
+  int traced;           // lines of sight traced
+  int blocked;          // of those, found blocked
+  int errors;           // -rejectverify: built entries that were visible
+  uint_64_t tracetime;  // in M_ProfileClock ticks
+  uint_64_t blockedtime;
+  uint_64_t verifytime;
+} rejectstats_t;
+
+extern rejectstats_t rejectstats;
+extern dboolean reject_verify;
+
+const byte *P_BuildReject(int lumpnum, const byte *reject, int length);
+void P_RejectReport(void);
+
+#endif
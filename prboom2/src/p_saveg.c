@@ -31,11 +31,14 @@
  *
  *-----------------------------------------------------------------------------*/
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "doomstat.h"
 #include "r_main.h"
+#include "p_map.h"
 #include "p_maputl.h"
+#include "p_setup.h"
 #include "p_spec.h"
 #include "p_tick.h"
 #include "p_saveg.h"
@@ -202,6 +205,8 @@ void P_UnArchiveWorld (void)
 
   PADSAVEP();                // killough 3/22/98
 
+  P_ClearSightCache();
+
   get = (short *) save_p;
 
   // do sectors
@@ -262,7 +267,8 @@ void P_UnArchiveWorld (void)
 
 typedef enum {
   tc_end,
-  tc_mobj
+  tc_mobj,      // raw mobj_t, written by older versions
+  tc_mobjfields // count, then field-wise mobj records
 } thinkerclass_t;
 
 // phares 9/13/98: Moved this code outside of P_ArchiveThinkers so the
@@ -298,95 +304,354 @@ void P_IndexToThinker(void)
 }
 
 //
-// P_ArchiveThinkers
+// Mobjs are saved field by field rather than as raw mobj_t structs, so
+// the format depends on neither the struct layout nor the pointer size,
+// and only the fields that differ from what the thing had when it was
+// spawned are stored. Each record is the type and a bit mask of stored
+// fields (both as varints), then those fields in little-endian order.
+// The section starts with the number of mobjs so it loads in one pass.
 //
-// 2/14/98 killough: substantially modified to fix savegame bugs
 
-void P_ArchiveThinkers (void)
+typedef enum {
+  mf_value,   // plain integer of the field's own size
+  mf_state,   // state_t pointer, stored as an index into states[]
+  mf_mobj,    // mobj_t pointer, stored as a thinker index, 0 for NULL
+  mf_player   // player_t pointer, stored as player number + 1
+} mobjfieldkind_t;
+
+typedef struct {
+  size_t offset;
+  int size;
+  mobjfieldkind_t kind;
+  dboolean derived;   // default depends on fields stored before it
+} mobjfield_t;
+
+#define MOBJFIELD(field, kind, derived) \
+  { offsetof(mobj_t, field), sizeof(((mobj_t *)0)->field), kind, derived }
+
+static const mobjfield_t mobjfields[] = {
+  MOBJFIELD(spawnpoint.x,       mf_value,  false),
+  MOBJFIELD(spawnpoint.y,       mf_value,  false),
+  MOBJFIELD(spawnpoint.angle,   mf_value,  false),
+  MOBJFIELD(spawnpoint.type,    mf_value,  false),
+  MOBJFIELD(spawnpoint.options, mf_value,  false),
+  MOBJFIELD(x,                  mf_value,  true),
+  MOBJFIELD(y,                  mf_value,  true),
+  MOBJFIELD(z,                  mf_value,  false),
+  MOBJFIELD(angle,              mf_value,  true),
+  MOBJFIELD(floorz,             mf_value,  true),
+  MOBJFIELD(ceilingz,           mf_value,  false),
+  MOBJFIELD(dropoffz,           mf_value,  true),
+  MOBJFIELD(radius,             mf_value,  false),
+  MOBJFIELD(height,             mf_value,  false),
+  MOBJFIELD(momx,               mf_value,  false),
+  MOBJFIELD(momy,               mf_value,  false),
+  MOBJFIELD(momz,               mf_value,  false),
+  MOBJFIELD(validcount,         mf_value,  false),
+  MOBJFIELD(tics,               mf_value,  false),
+  MOBJFIELD(state,              mf_state,  false),
+  MOBJFIELD(sprite,             mf_value,  true),
+  MOBJFIELD(frame,              mf_value,  true),
+  MOBJFIELD(flags,              mf_value,  false),
+  MOBJFIELD(intflags,           mf_value,  false),
+  MOBJFIELD(health,             mf_value,  false),
+  MOBJFIELD(movedir,            mf_value,  false),
+  MOBJFIELD(movecount,          mf_value,  false),
+  MOBJFIELD(strafecount,        mf_value,  false),
+  MOBJFIELD(target,             mf_mobj,   false),
+  MOBJFIELD(reactiontime,       mf_value,  false),
+  MOBJFIELD(threshold,          mf_value,  false),
+  MOBJFIELD(pursuecount,        mf_value,  false),
+  MOBJFIELD(gear,               mf_value,  false),
+  MOBJFIELD(player,             mf_player, false),
+  MOBJFIELD(lastlook,           mf_value,  false),
+  MOBJFIELD(tracer,             mf_mobj,   false),
+  MOBJFIELD(lastenemy,          mf_mobj,   false),
+  MOBJFIELD(friction,           mf_value,  false),
+  MOBJFIELD(movefactor,         mf_value,  false),
+  MOBJFIELD(PrevX,              mf_value,  true),
+  MOBJFIELD(PrevY,              mf_value,  true),
+  MOBJFIELD(PrevZ,              mf_value,  true),
+  MOBJFIELD(pitch,              mf_value,  false),
+  MOBJFIELD(index,              mf_value,  false),
+  MOBJFIELD(patch_width,        mf_value,  false),
+  MOBJFIELD(iden_nums,          mf_value,  false),
+  MOBJFIELD(bloodcolor,         mf_value,  false),
+};
+
+#define NUMMOBJFIELDS (sizeof(mobjfields)/sizeof(*mobjfields))
+
+// worst case size of one record: two varints plus every field
+#define MOBJRECORDSIZE (2*10 + sizeof(mobj_t))
+
+static void P_WriteVarint(uint_64_t value)
 {
-  thinker_t *th;
+  while (value >= 0x80)
+  {
+    *save_p++ = (byte)(value | 0x80);
+    value >>= 7;
+  }
+  *save_p++ = (byte)value;
+}
 
-  CheckSaveGame(sizeof brain);      // killough 3/26/98: Save boss brain state
-  memcpy(save_p, &brain, sizeof brain);
-  save_p += sizeof brain;
+static uint_64_t P_ReadVarint(void)
+{
+  uint_64_t value = 0;
+  int shift = 0;
+  byte b;
 
-  /* check that enough room is available in savegame buffer
-   * - killough 2/14/98
-   * cph - use number_of_thinkers saved by P_ThinkerToIndex above
-   * size per object is sizeof(mobj_t) - 2*sizeof(void*) - 4*sizeof(fixed_t) plus
-   * padded type (4) plus 5*sizeof(void*), i.e. sizeof(mobj_t) + 4 +
-   * 3*sizeof(void*)
-   * cph - +1 for the tc_end
-   */
-  CheckSaveGame(number_of_thinkers*(sizeof(mobj_t)-3*sizeof(fixed_t)+4+3*sizeof(void*)) +1);
+  do
+  {
+    b = *save_p++;
+    value |= (uint_64_t)(b & 0x7f) << shift;
+    shift += 7;
+  } while ((b & 0x80) && shift < 64);
 
-  // save off the current thinkers
-  for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
-    if (th->function == P_MobjThinker)
-      {
-        mobj_t *mobj;
+  return value;
+}
 
-        *save_p++ = tc_mobj;
-        PADSAVEP();
-        mobj = (mobj_t *)save_p;
+static void P_WriteLE(uint_64_t value, int size)
+{
+  while (size--)
+  {
+    *save_p++ = (byte)value;
+    value >>= 8;
+  }
+}
+
+static uint_64_t P_ReadLE(int size)
+{
+  uint_64_t value = 0;
+  int i;
 
-        //e6y
-        memcpy (mobj, th, sizeof(*mobj));
-        save_p += sizeof(*mobj);
+  for (i = 0; i < size; i++)
+    value |= (uint_64_t)*save_p++ << (8 * i);
 
-        mobj->state = (state_t *)(mobj->state - states);
+  return value;
+}
 
-        // killough 2/14/98: convert pointers into indices.
-        // Fixes many savegame problems, by properly saving
-        // target and tracer fields. Note: we store NULL if
-        // the thinker pointed to by these fields is not a
-        // mobj thinker.
+static int P_MobjFieldSize(const mobjfield_t *f)
+{
+  switch (f->kind)
+  {
+    case mf_state:
+    case mf_mobj:
+      return 4;
+    case mf_player:
+      return 1;
+    default:
+      return f->size;
+  }
+}
 
-        if (mobj->target)
-          mobj->target = mobj->target->thinker.function ==
-            P_MobjThinker ?
-            (mobj_t *) mobj->target->thinker.prev : NULL;
+// Returns a field as it is stored. Mobj references must be indices set by
+// P_ThinkerToIndex, or already swizzled into indices when loading.
+static uint_64_t P_GetMobjField(const mobj_t *mobj, const mobjfield_t *f)
+{
+  const byte *p = (const byte *)mobj + f->offset;
 
-        if (mobj->tracer)
-          mobj->tracer = mobj->tracer->thinker.function ==
-            P_MobjThinker ?
-            (mobj_t *) mobj->tracer->thinker.prev : NULL;
+  switch (f->kind)
+  {
+    case mf_state:
+      return mobj->state ? (uint_64_t)(mobj->state - states) : 0;
 
-        // killough 2/14/98: new field: save last known enemy. Prevents
-        // monsters from going to sleep after killing monsters and not
-        // seeing player anymore.
+    case mf_mobj:
+      {
+        const mobj_t *mo;
+        memcpy(&mo, p, sizeof mo);
+        if (!mo || mo->thinker.function != P_MobjThinker)
+          return 0;
+        return (intptr_t)mo->thinker.prev;
+      }
 
-        if (mobj->lastenemy)
-          mobj->lastenemy = mobj->lastenemy->thinker.function ==
-            P_MobjThinker ?
-            (mobj_t *) mobj->lastenemy->thinker.prev : NULL;
+    case mf_player:
+      return mobj->player ? (uint_64_t)(mobj->player - players) + 1 : 0;
 
+    default:
+      switch (f->size)
+      {
+        case 1: { byte v; memcpy(&v, p, 1); return v; }
+        case 2: { unsigned short v; memcpy(&v, p, 2); return v; }
+        case 4: { unsigned int v; memcpy(&v, p, 4); return v; }
+        default: { uint_64_t v; memcpy(&v, p, 8); return v; }
+      }
+  }
+}
 
-        // killough 2/14/98: end changes
+static void P_SetMobjField(mobj_t *mobj, const mobjfield_t *f, uint_64_t value)
+{
+  byte *p = (byte *)mobj + f->offset;
 
-        if (mobj->player)
-          mobj->player = (player_t *)((mobj->player-players) + 1);
+  switch (f->kind)
+  {
+    case mf_state:
+      if (value >= NUMSTATES)
+        I_Error("P_UnArchiveThinkers: Bad state %u in savegame", (unsigned)value);
+      mobj->state = &states[value];
+      break;
+
+    case mf_mobj:
+      {
+        // swizzled by P_UnArchiveThinkers once every mobj is loaded
+        mobj_t *mo = (mobj_t *)(intptr_t)value;
+        memcpy(p, &mo, sizeof mo);
       }
+      break;
 
-  // add a terminating marker
-  *save_p++ = tc_end;
+    case mf_player:
+      if (value > MAXPLAYERS)
+        I_Error("P_UnArchiveThinkers: Bad player %u in savegame", (unsigned)value);
+      mobj->player = value ? &players[value - 1] : NULL;
+      break;
+
+    default:
+      switch (f->size)
+      {
+        case 1: { byte v = (byte)value; memcpy(p, &v, 1); break; }
+        case 2: { unsigned short v = (unsigned short)value; memcpy(p, &v, 2); break; }
+        case 4: { unsigned int v = (unsigned int)value; memcpy(p, &v, 4); break; }
+        default: memcpy(p, &value, 8); break;
+      }
+  }
+}
+
+// What P_SpawnMobj gives a thing of this type
+static void P_MobjDefaults(mobj_t *def, mobjtype_t type)
+{
+  const mobjinfo_t *info = &mobjinfo[type];
+  state_t *st = &states[info->spawnstate];
+
+  memset(def, 0, sizeof(*def));
+  def->type = type;
+  def->radius = info->radius;
+  def->height = info->height;
+  def->flags = info->flags;
+  if (!mbf_features)
+    def->flags &= ~(MF_BOUNCES | MF_FRIEND | MF_TOUCHY);
+  else if (type == MT_PLAYER)
+    def->flags |= MF_FRIEND;
+  def->health = info->spawnhealth;
+  if (gameskill != sk_nightmare)
+    def->reactiontime = info->reactiontime;
+  def->state = st;
+  def->tics = st->tics;
+  def->friction = ORIG_FRICTION;
+  def->index = -1;
+}
+
+// Defaults that follow from fields already stored: a thing that has not
+// moved is still at its spawn spot, standing on the floor, and so on
+static void P_MobjDerivedDefaults(mobj_t *def, const mobj_t *mobj)
+{
+  def->x = mobj->spawnpoint.x * FRACUNIT;
+  def->y = mobj->spawnpoint.y * FRACUNIT;
+  def->angle = (angle_t)ANG45 * (mobj->spawnpoint.angle / 45);
+  def->floorz = mobj->z;
+  def->dropoffz = mobj->floorz;
+  if (mobj->state)
+  {
+    def->sprite = mobj->state->sprite;
+    def->frame = mobj->state->frame;
+  }
+  def->PrevX = mobj->x;
+  def->PrevY = mobj->y;
+  def->PrevZ = mobj->z;
+}
+
+static void P_ArchiveMobj(const mobj_t *mobj)
+{
+  uint_64_t values[NUMMOBJFIELDS];
+  uint_64_t mask = 0;
+  mobj_t def;
+  size_t i;
+
+  P_MobjDefaults(&def, mobj->type);
+
+  for (i = 0; i < NUMMOBJFIELDS; i++)
+  {
+    const mobjfield_t *f = &mobjfields[i];
+
+    if (f->derived)
+      P_MobjDerivedDefaults(&def, mobj);
+    values[i] = P_GetMobjField(mobj, f);
+    if (values[i] != P_GetMobjField(&def, f))
+      mask |= (uint_64_t)1 << i;
+  }
+
+  P_WriteVarint(mobj->type);
+  P_WriteVarint(mask);
+  for (i = 0; i < NUMMOBJFIELDS; i++)
+    if (mask & ((uint_64_t)1 << i))
+      P_WriteLE(values[i], P_MobjFieldSize(&mobjfields[i]));
+}
+
+static mobj_t *P_UnArchiveMobj(void)
+{
+  mobj_t *mobj = Z_Malloc(sizeof(mobj_t), PU_LEVEL, NULL);
+  uint_64_t type, mask;
+  mobj_t def;
+  size_t i;
+
+  type = P_ReadVarint();
+  if (type >= NUMMOBJTYPES)
+    I_Error("P_UnArchiveThinkers: Bad mobj type %u in savegame", (unsigned)type);
+
+  memset(mobj, 0, sizeof(*mobj));
+  mobj->type = (mobjtype_t)type;
+  P_MobjDefaults(&def, mobj->type);
+
+  mask = P_ReadVarint();
+  for (i = 0; i < NUMMOBJFIELDS; i++)
+  {
+    const mobjfield_t *f = &mobjfields[i];
+
+    if (f->derived)
+      P_MobjDerivedDefaults(&def, mobj);
+    if (mask & ((uint_64_t)1 << i))
+      P_SetMobjField(mobj, f, P_ReadLE(P_MobjFieldSize(f)));
+    else
+      P_SetMobjField(mobj, f, P_GetMobjField(&def, f));
+  }
+
+  return mobj;
+}
+
+//
+// P_ArchiveThinkers
+//
+// 2/14/98 killough: substantially modified to fix savegame bugs
+
+void P_ArchiveThinkers (void)
+{
+  thinker_t *th;
+  int i;
+
+  CheckSaveGame(sizeof brain + 1 + 4);      // killough 3/26/98: Save boss brain state
+  memcpy(save_p, &brain, sizeof brain);
+  save_p += sizeof brain;
+
+  // cph - use number_of_thinkers saved by P_ThinkerToIndex above
+  *save_p++ = tc_mobjfields;
+  P_WriteLE(number_of_thinkers, 4);
+
+  // save off the current thinkers; CheckSaveGame for each one, so that
+  // a streamed savegame never holds more than a chunk of them at once
+  for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    if (th->function == P_MobjThinker)
+      {
+        CheckSaveGame(MOBJRECORDSIZE);
+        P_ArchiveMobj((mobj_t *) th);
+      }
 
   // killough 9/14/98: save soundtargets
+  CheckSaveGame(numsectors * 4);
+  for (i = 0; i < numsectors; i++)
   {
-    int i;
-    CheckSaveGame(numsectors * sizeof(mobj_t *));       // killough 9/14/98
-    for (i = 0; i < numsectors; i++)
-    {
-      mobj_t *target = sectors[i].soundtarget;
-      // Fix crash on reload when a soundtarget points to a removed corpse
-      // (prboom bug #1590350)
-      if (target && target->thinker.function == P_MobjThinker)
-        target = (mobj_t *) target->thinker.prev;
-      else
-        target = NULL;
-      memcpy(save_p, &target, sizeof target);
-      save_p += sizeof target;
-    }
+    mobj_t *target = sectors[i].soundtarget;
+    // Fix crash on reload when a soundtarget points to a removed corpse
+    // (prboom bug #1590350)
+    P_WriteLE(target && target->thinker.function == P_MobjThinker ?
+              (intptr_t) target->thinker.prev : 0, 4);
   }
 }
 
@@ -404,47 +669,53 @@ static void P_SetNewTarget(mobj_t **mop, mobj_t *targ)
   P_SetTarget(mop, targ);
 }
 
-//
-// P_UnArchiveThinkers
-//
-// 2/14/98 killough: substantially modified to fix savegame bugs
-//
-
-// savegame file stores ints in the corresponding * field; this function
-// safely casts them back to int.
-static int P_GetMobj(mobj_t* mi, size_t s)
+// Reads the mobjs written by P_ArchiveThinkers into the table that maps
+// saved indices to the new mobjs; size is set to the table's size
+static mobj_t **P_UnArchiveFieldMobjs(size_t *size)
 {
-  size_t i = (size_t)mi;
-  if (i >= s)
-    I_Error("Corrupt savegame");
-  return i;
-}
+  mobj_t **mobj_p;
+  size_t count, i;
 
-void P_UnArchiveThinkers (void)
-{
-  thinker_t *th;
-  mobj_t    **mobj_p;    // killough 2/14/98: Translation table
-  size_t    size;        // killough 2/14/98: size of or index into table
+  save_p++;
+  count = (size_t)P_ReadLE(4);
 
-  totallive = 0;
-  // killough 3/26/98: Load boss brain state
-  memcpy(&brain, save_p, sizeof brain);
-  save_p += sizeof brain;
+  // first table entry special: 0 maps to NULL
+  *(mobj_p = malloc((count + 1) * sizeof *mobj_p)) = 0;
 
-  // remove all the current thinkers
-  for (th = thinkercap.next; th != &thinkercap; )
+  for (i = 1; i <= count; i++)
     {
-      thinker_t *next = th->next;
-      if (th->function == P_MobjThinker)
-      {
-        P_RemoveMobj ((mobj_t *) th);
-        P_RemoveThinkerDelayed(th); // fix mobj leak
-      }
-      else
-        Z_Free (th);
-      th = next;
+      mobj_t *mobj = P_UnArchiveMobj();
+
+      mobj_p[i] = mobj;
+
+      if (mobj->player)
+        mobj->player->mo = mobj;
+
+      P_SetThingPosition (mobj);
+      mobj->info = &mobjinfo[mobj->type];
+
+      mobj->thinker.function = P_MobjThinker;
+      P_AddThinker (&mobj->thinker);
+
+      if (!((mobj->flags ^ MF_COUNTKILL) & (MF_FRIEND | MF_COUNTKILL | MF_CORPSE)))
+        totallive++;
     }
-  P_InitThinkers ();
+
+  *size = count + 1;
+  return mobj_p;
+}
+
+// The raw mobj_t of older versions ended before blockcell
+typedef struct { char c; mobj_t mobj; } mobjalign_t;
+#define MOBJALIGN offsetof(mobjalign_t, mobj)
+#define RAWMOBJSIZE \
+  ((offsetof(mobj_t, blockcell) + MOBJALIGN - 1) / MOBJALIGN * MOBJALIGN)
+
+// Same for the raw mobj_t structs of savegames from older versions
+static mobj_t **P_UnArchiveRawMobjs(size_t *size_p)
+{
+  mobj_t    **mobj_p;    // killough 2/14/98: Translation table
+  size_t    size;        // killough 2/14/98: size of or index into table
 
   // killough 2/14/98: count number of thinkers by skipping through them
   {
@@ -452,7 +723,7 @@ void P_UnArchiveThinkers (void)
     for (size = 1; *save_p++ == tc_mobj; size++)  // killough 2/14/98
       {                     // skip all entries, adding up count
         PADSAVEP();
-        save_p += sizeof(mobj_t);//e6y
+        save_p += RAWMOBJSIZE;//e6y
       }
 
     if (*--save_p != tc_end)
@@ -473,8 +744,13 @@ void P_UnArchiveThinkers (void)
 
       PADSAVEP();
 
-      memcpy (mobj, save_p, sizeof(mobj_t));
-      save_p += sizeof(mobj_t);
+      memcpy (mobj, save_p, RAWMOBJSIZE);
+      save_p += RAWMOBJSIZE;
+
+      // the saved block links are stale pointers
+      mobj->bnext = NULL;
+      mobj->bprev = NULL;
+      mobj->blockcell = -1;
 
       mobj->state = states + (intptr_t) mobj->state;
 
@@ -496,6 +772,59 @@ void P_UnArchiveThinkers (void)
         totallive++;
     }
 
+  *size_p = size;
+  return mobj_p;
+}
+
+//
+// P_UnArchiveThinkers
+//
+// 2/14/98 killough: substantially modified to fix savegame bugs
+//
+
+// savegame file stores ints in the corresponding * field; this function
+// safely casts them back to int.
+static int P_GetMobj(mobj_t* mi, size_t s)
+{
+  size_t i = (size_t)mi;
+  if (i >= s)
+    I_Error("Corrupt savegame");
+  return i;
+}
+
+void P_UnArchiveThinkers (void)
+{
+  thinker_t *th;
+  mobj_t    **mobj_p;    // killough 2/14/98: Translation table
+  size_t    size;        // killough 2/14/98: size of or index into table
+  dboolean  fieldwise;
+
+  totallive = 0;
+  // killough 3/26/98: Load boss brain state
+  memcpy(&brain, save_p, sizeof brain);
+  save_p += sizeof brain;
+
+  // remove all the current thinkers
+  for (th = thinkercap.next; th != &thinkercap; )
+    {
+      thinker_t *next = th->next;
+      if (th->function == P_MobjThinker)
+      {
+        P_RemoveMobj ((mobj_t *) th);
+        P_RemoveThinkerDelayed(th); // fix mobj leak
+      }
+      else
+        Z_Free (th);
+      th = next;
+    }
+  P_InitThinkers ();
+
+  fieldwise = *save_p == tc_mobjfields;
+  if (fieldwise)
+    mobj_p = P_UnArchiveFieldMobjs(&size);
+  else
+    mobj_p = P_UnArchiveRawMobjs(&size);
+
   // killough 2/14/98: adjust target and tracer fields, plus
   // lastenemy field, to correctly point to mobj thinkers.
   // NULL entries automatically handled by first table entry.
@@ -519,8 +848,13 @@ void P_UnArchiveThinkers (void)
     for (i = 0; i < numsectors; i++)
     {
       mobj_t *target;
-      memcpy(&target, save_p, sizeof target);
-      save_p += sizeof target;
+      if (fieldwise)
+        target = (mobj_t *)(intptr_t)P_ReadLE(4);
+      else
+      {
+        memcpy(&target, save_p, sizeof target);
+        save_p += sizeof target;
+      }
       // Must verify soundtarget. See P_ArchiveThinkers.
       P_SetNewTarget(&sectors[i].soundtarget, mobj_p[P_GetMobj(target,size)]);
     }
@@ -1053,3 +1387,360 @@ void P_UnArchiveMap(void)
     }
 }
 
+
+//
+// Link order
+//
+// Loading a level links every mobj into the blockmap, its sector and the
+// sectors it touches in thinker order, files it into the friend or enemy
+// thread in thinker order, and adds the specials after all the mobjs.
+// While playing, all of these lists are built up in whatever order the
+// things moved, died or spawned. Iterators walk them, so a demo rewound
+// to a snapshot would go out of sync. Snapshots keep that order
+// (P_ArchiveLinks), and loading them puts it back (P_UnArchiveLinks).
+// Must come after everything else, since it uses its own thinker indices.
+//
+
+// same test as P_ArchiveSpecials for what it saves
+static dboolean P_IsArchivedSpecial(thinker_t *th)
+{
+  if (!th->function)
+  {
+    platlist_t *pl;
+    ceilinglist_t *cl;
+
+    for (pl=activeplats; pl; pl=pl->next)
+      if (pl->plat == (plat_t *) th)
+        return true;
+    for (cl=activeceilings; cl; cl=cl->next)
+      if (cl->ceiling == (ceiling_t *) th)
+        return true;
+    return false;
+  }
+
+  return
+    th->function == T_MoveCeiling  ||
+    th->function == T_VerticalDoor ||
+    th->function == T_MoveFloor    ||
+    th->function == T_PlatRaise    ||
+    th->function == T_LightFlash   ||
+    th->function == T_StrobeFlash  ||
+    th->function == T_Glow         ||
+    th->function == T_FireFlicker  ||
+    th->function == T_MoveElevator ||
+    th->function == T_Scroll       ||
+    th->function == T_Pusher       ||
+    th->function == T_Friction;
+}
+
+// index set by P_ThinkerToIndex, 0 for things that are not saved
+static int P_MobjLinkIndex(const mobj_t *mo)
+{
+  return mo->thinker.function == P_MobjThinker ?
+    (int)(intptr_t) mo->thinker.prev : 0;
+}
+
+static void P_ArchiveThingList(mobj_t *list, int bnext)
+{
+  mobj_t *mo;
+  int count = 0;
+
+  for (mo = list; mo; mo = bnext ? mo->bnext : mo->snext)
+    if (P_MobjLinkIndex(mo))
+      count++;
+
+  CheckSaveGame(10 * (count + 1));
+  P_WriteVarint(count);
+  for (mo = list; mo; mo = bnext ? mo->bnext : mo->snext)
+    if (P_MobjLinkIndex(mo))
+      P_WriteVarint(P_MobjLinkIndex(mo));
+}
+
+void P_ArchiveLinks(void)
+{
+  thinker_t *th;
+  msecnode_t *node;
+  int i, count;
+
+  P_ThinkerToIndex();
+
+  CheckSaveGame(10);
+  P_WriteVarint(number_of_thinkers);
+
+  // for each special, how many mobjs come before it
+  count = 0;
+  for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    if (th->function != P_MobjThinker && P_IsArchivedSpecial(th))
+      count++;
+  CheckSaveGame(10);
+  P_WriteVarint(count);
+
+  count = 0;
+  for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+  {
+    if (th->function == P_MobjThinker)
+      count++;
+    else if (P_IsArchivedSpecial(th))
+    {
+      CheckSaveGame(10);
+      P_WriteVarint(count);
+    }
+  }
+
+  // friend and enemy threads
+  for (i = th_friends; i <= th_enemies; i++)
+  {
+    count = 0;
+    for (th = thinkerclasscap[i].cnext ; th != &thinkerclasscap[i] ; th=th->cnext)
+      if (P_MobjLinkIndex((mobj_t *) th))
+        count++;
+
+    CheckSaveGame(10 * (count + 1));
+    P_WriteVarint(count);
+    for (th = thinkerclasscap[i].cnext ; th != &thinkerclasscap[i] ; th=th->cnext)
+      if (P_MobjLinkIndex((mobj_t *) th))
+        P_WriteVarint(P_MobjLinkIndex((mobj_t *) th));
+  }
+
+  for (i = 0; i < bmapwidth*bmapheight; i++)
+    P_ArchiveThingList(blocklinks[i], true);
+
+  for (i = 0; i < numsectors; i++)
+  {
+    P_ArchiveThingList(sectors[i].thinglist, false);
+
+    count = 0;
+    for (node = sectors[i].touching_thinglist; node; node = node->m_snext)
+      count++;
+
+    CheckSaveGame(10 * (count + 1));
+    P_WriteVarint(count);
+    for (node = sectors[i].touching_thinglist; node; node = node->m_snext)
+      P_WriteVarint(P_MobjLinkIndex(node->m_thing));
+  }
+
+  for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    if (th->function == P_MobjThinker)
+    {
+      count = 0;
+      for (node = ((mobj_t *) th)->touching_sectorlist; node; node = node->m_tnext)
+        count++;
+
+      CheckSaveGame(10 * (count + 1));
+      P_WriteVarint(count);
+      for (node = ((mobj_t *) th)->touching_sectorlist; node; node = node->m_tnext)
+        P_WriteVarint(node->m_sector - sectors);
+    }
+
+  P_IndexToThinker();
+}
+
+static mobj_t **link_mobjs;
+static int num_link_mobjs;
+
+// moves th to the end of thread cl, like P_UpdateThinker
+static void P_MoveToThread(thinker_t *th, int cl)
+{
+  thinker_t *cap = &thinkerclasscap[cl];
+
+  (th->cnext->cprev = th->cprev)->cnext = th->cnext;
+
+  cap->cprev->cnext = th;
+  th->cnext = cap;
+  th->cprev = cap->cprev;
+  cap->cprev = th;
+}
+
+static mobj_t *P_ReadLinkMobj(void)
+{
+  uint_64_t i = P_ReadVarint();
+
+  if (i < 1 || i > (uint_64_t)num_link_mobjs)
+    I_Error("P_UnArchiveLinks: Bad mobj index %u", (unsigned)i);
+  return link_mobjs[i];
+}
+
+static void P_UnArchiveThingList(mobj_t **list, int cell)
+{
+  mobj_t *mo, **link;
+  int count = 0;
+  uint_64_t i, n;
+
+  for (mo = *list; mo; mo = cell >= 0 ? mo->bnext : mo->snext)
+    count++;
+
+  n = P_ReadVarint();
+  if (n != (uint_64_t)count)
+    I_Error("P_UnArchiveLinks: Thing list size mismatch");
+
+  link = list;
+  for (i = 0; i < n; i++)
+  {
+    mo = P_ReadLinkMobj();
+    *link = mo;
+    if (cell >= 0)
+    {
+      mo->bprev = link;
+      mo->blockcell = cell;
+      P_TouchBlockThing(mo);
+      link = &mo->bnext;
+    }
+    else
+    {
+      mo->sprev = link;
+      link = &mo->snext;
+    }
+  }
+  *link = NULL;
+}
+
+void P_UnArchiveLinks(void)
+{
+  thinker_t *th, *prev, **specials = NULL;
+  msecnode_t *node, **nodes = NULL;
+  int i, j, count, numspecials = 0, maxnodes = 0;
+
+  num_link_mobjs = (int)P_ReadVarint();
+  link_mobjs = malloc((num_link_mobjs + 1) * sizeof *link_mobjs);
+  link_mobjs[0] = NULL;
+
+  // after loading, the mobjs come first and the specials after them
+  count = 0;
+  for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+  {
+    if (th->function == P_MobjThinker)
+    {
+      if (numspecials || count == num_link_mobjs)
+        I_Error("P_UnArchiveLinks: Unexpected thinker order");
+      link_mobjs[++count] = (mobj_t *) th;
+    }
+    else
+    {
+      specials = realloc(specials, (numspecials + 1) * sizeof *specials);
+      specials[numspecials++] = th;
+    }
+  }
+  if (count != num_link_mobjs || P_ReadVarint() != (uint_64_t)numspecials)
+    I_Error("P_UnArchiveLinks: Thinker count mismatch");
+
+  // put the specials back between the mobjs
+  prev = &thinkercap;
+  j = 1;
+  for (i = 0; i < numspecials; i++)
+  {
+    int before = (int)P_ReadVarint();
+
+    if (before < j - 1 || before > num_link_mobjs)
+      I_Error("P_UnArchiveLinks: Bad special position");
+    for (; j <= before; j++)
+    {
+      prev->next = &link_mobjs[j]->thinker;
+      link_mobjs[j]->thinker.prev = prev;
+      prev = prev->next;
+    }
+    prev->next = specials[i];
+    specials[i]->prev = prev;
+    prev = specials[i];
+  }
+  for (; j <= num_link_mobjs; j++)
+  {
+    prev->next = &link_mobjs[j]->thinker;
+    link_mobjs[j]->thinker.prev = prev;
+    prev = prev->next;
+  }
+  prev->next = &thinkercap;
+  thinkercap.prev = prev;
+  free(specials);
+
+  // friend and enemy threads as they were, anything else goes to th_misc
+  for (i = th_friends; i <= th_enemies; i++)
+    while (thinkerclasscap[i].cnext != &thinkerclasscap[i])
+      P_MoveToThread(thinkerclasscap[i].cnext, th_misc);
+  for (i = th_friends; i <= th_enemies; i++)
+  {
+    count = (int)P_ReadVarint();
+    for (j = 0; j < count; j++)
+      P_MoveToThread(&P_ReadLinkMobj()->thinker, i);
+  }
+
+  for (i = 0; i < bmapwidth*bmapheight; i++)
+    P_UnArchiveThingList(&blocklinks[i], i);
+
+  for (i = 0; i < numsectors; i++)
+  {
+    sector_t *sec = &sectors[i];
+    msecnode_t *last = NULL;
+
+    P_UnArchiveThingList(&sec->thinglist, -1);
+
+    count = 0;
+    for (node = sec->touching_thinglist; node; node = node->m_snext)
+      count++;
+    if (P_ReadVarint() != (uint_64_t)count)
+      I_Error("P_UnArchiveLinks: Sector node count mismatch");
+
+    // each node is found through its thing, whose list is still intact
+    for (j = 0; j < count; j++)
+    {
+      mobj_t *mo = P_ReadLinkMobj();
+
+      for (node = mo->touching_sectorlist; node; node = node->m_tnext)
+        if (node->m_sector == sec)
+          break;
+      if (!node)
+        I_Error("P_UnArchiveLinks: Missing sector node");
+
+      node->m_sprev = last;
+      if (last)
+        last->m_snext = node;
+      else
+        sec->touching_thinglist = node;
+      last = node;
+    }
+    if (last)
+      last->m_snext = NULL;
+  }
+
+  for (i = 1; i <= num_link_mobjs; i++)
+  {
+    mobj_t *mo = link_mobjs[i];
+    msecnode_t *last = NULL;
+
+    count = 0;
+    for (node = mo->touching_sectorlist; node; node = node->m_tnext)
+    {
+      if (count == maxnodes)
+        nodes = realloc(nodes, (maxnodes = maxnodes ? maxnodes * 2 : 16) * sizeof *nodes);
+      nodes[count++] = node;
+    }
+    if (P_ReadVarint() != (uint_64_t)count)
+      I_Error("P_UnArchiveLinks: Thing node count mismatch");
+
+    for (j = 0; j < count; j++)
+    {
+      uint_64_t s = P_ReadVarint();
+      int k;
+
+      for (k = 0; k < count; k++)
+        if (nodes[k] && nodes[k]->m_sector - sectors == (ptrdiff_t)s)
+          break;
+      if (k == count)
+        I_Error("P_UnArchiveLinks: Missing thing node");
+
+      node = nodes[k];
+      nodes[k] = NULL;
+      node->m_tprev = last;
+      if (last)
+        last->m_tnext = node;
+      else
+        mo->touching_sectorlist = node;
+      last = node;
+    }
+    if (last)
+      last->m_tnext = NULL;
+  }
+
+  free(nodes);
+  free(link_mobjs);
+  link_mobjs = NULL;
+}
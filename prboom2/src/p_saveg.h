@@ -59,6 +59,10 @@ void P_UnArchiveRNG(void);
 void P_ArchiveMap(void);
 void P_UnArchiveMap(void);
 
+/* order of the thing lists, for demo seeking snapshots only */
+void P_ArchiveLinks(void);
+void P_UnArchiveLinks(void);
+
 extern byte *save_p;
 void CheckSaveGame(size_t,const char*, int);              /* killough */
 #define CheckSaveGame(a) (CheckSaveGame)(a, __FILE__, __LINE__)
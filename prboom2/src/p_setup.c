@@ -41,6 +41,7 @@
 #include "w_wad.h"
 #include "r_main.h"
 #include "r_things.h"
+#include "r_bsp.h"
 #include "p_maputl.h"
 #include "p_map.h"
 #include "p_setup.h"
@@ -57,6 +58,8 @@
 #include "g_overflow.h"
 #include "am_map.h"
 #include "e6y.h"//e6y
+#include "p_mapcache.h"
+#include "p_reject.h"
 
 #include "config.h"
 #ifdef HAVE_LIBZ
@@ -1131,27 +1134,10 @@ static void P_LoadZSegs (const byte *data)
 
 // MB 2020-03-01: Fix endianess for 32-bit ZDoom nodes
 // https://zdoom.org/wiki/Node#ZDoom_extended_nodes
-static void P_LoadZNodes(int lump, int glnodes, int compressed)
-{
-  byte *data;
-  unsigned int i;
-  int len;
-
-  unsigned int orgVerts, newVerts;
-  unsigned int numSubs, currSeg;
-  unsigned int numSegs;
-  unsigned int numNodes;
-  vertex_t *newvertarray = NULL;
-#ifdef HAVE_LIBZ
-  byte *output;
-#endif
-
-  data = W_CacheLumpNum(lump);
-  len =  W_LumpLength(lump);
-
-  if (compressed == ZDOOM_ZNOD_NODES)
-  {
 #ifdef HAVE_LIBZ
+static byte *P_InflateZNodes(const byte *data, int len, size_t *outsize)
+{
+	byte *output;
 	int outlen, err;
 	z_stream *zstream;
 
@@ -1163,7 +1149,7 @@ static void P_LoadZNodes(int lump, int glnodes, int compressed)
 	// initialize stream state for decompression
 	zstream = malloc(sizeof(*zstream));
 	memset(zstream, 0, sizeof(*zstream));
-	zstream->next_in = data + 4;
+	zstream->next_in = (byte *)data + 4;
 	zstream->avail_in = len - 4;
 	zstream->next_out = output;
 	zstream->avail_out = outlen;
@@ -1187,15 +1173,63 @@ static void P_LoadZNodes(int lump, int glnodes, int compressed)
 	lprintf(LO_INFO, "P_LoadZNodes: ZDoom nodes compression ratio %.3f\n",
 	        (float)zstream->total_out/zstream->total_in);
 
-	data = output;
-	len = zstream->total_out;
+	*outsize = zstream->total_out;
 
 	if (inflateEnd(zstream) != Z_OK)
 	    I_Error("P_LoadZNodes: Error during ZDoom nodes decompression shut-down!");
 
+	free(zstream);
+
+	return output;
+}
+#endif
+
+static void P_LoadZNodes(int lump, int glnodes, int compressed)
+{
+  byte *data;
+  unsigned int i;
+  int len;
+
+  unsigned int orgVerts, newVerts;
+  unsigned int numSubs, currSeg;
+  unsigned int numSegs;
+  unsigned int numNodes;
+  vertex_t *newvertarray = NULL;
+#ifdef HAVE_LIBZ
+  byte *output;
+#endif
+
+  data = W_CacheLumpNum(lump);
+  len =  W_LumpLength(lump);
+
+  if (compressed == ZDOOM_ZNOD_NODES)
+  {
+#ifdef HAVE_LIBZ
+	unsigned char key[16];
+	size_t outlen = 0;
+	dboolean usecache = P_MapCacheEnabled();
+
+	// inflating the nodes of a huge map takes a while, so the level
+	// cache keeps the result keyed by the compressed lump
+	output = NULL;
+	if (usecache)
+	{
+	    P_MapCacheKey(key, &lump, 1);
+	    output = P_MapCacheLoad("znodes", key, &outlen);
+	}
+
+	if (!output)
+	{
+	    output = P_InflateZNodes(data, len, &outlen);
+	    if (usecache)
+	        P_MapCacheStore("znodes", key, output, outlen);
+	}
+
+	data = output;
+	len = outlen;
+
 	// release the original data lump
 	W_UnlockLumpNum(lump);
-	free(zstream);
 #else
 	I_Error("P_LoadZNodes: Compressed ZDoom nodes are not supported!");
 #endif
@@ -1741,7 +1775,7 @@ static void AddBlockLine
 // adds the line to all block lists touching the intersection.
 //
 
-static void P_CreateBlockMap(void)
+static long P_CreateBlockMap(void)
 {
   int xorg,yorg;                 // blockmap origin (lower left)
   int nrows,ncols;               // blockmap dimensions
@@ -1997,6 +2031,8 @@ static void P_CreateBlockMap(void)
   free (blocklists);
   free (blockcount);
   free (blockdone);
+
+  return 4 + NBlocks + linetotal;
 }
 
 // jff 10/6/98
@@ -2069,6 +2105,59 @@ static dboolean P_VerifyBlockMap(int count)
   return true;
 }
 
+//
+// P_CreateBlockMapCached
+//
+// The generated blockmap depends only on VERTEXES and LINEDEFS, so with
+// the level cache enabled it is built once per map and read back from
+// disk afterwards.
+//
+static void P_CreateBlockMapCached(int lump)
+{
+  unsigned char key[16];
+  int lumps[2];
+  int *cached;
+  size_t size;
+  long count;
+
+  if (!P_MapCacheEnabled())
+  {
+    P_CreateBlockMap();
+    return;
+  }
+
+  lumps[0] = lump - ML_BLOCKMAP + ML_VERTEXES;
+  lumps[1] = lump - ML_BLOCKMAP + ML_LINEDEFS;
+  P_MapCacheKey(key, lumps, 2);
+
+  cached = P_MapCacheLoad("blockmap", key, &size);
+  if (cached && size >= 4 * sizeof(*cached))
+  {
+    if (samelevel && blockmaplump)
+      free(blockmaplump);
+    blockmaplump = cached;
+
+    bmaporgx = blockmaplump[0];
+    bmaporgy = blockmaplump[1];
+    bmapwidth = blockmaplump[2];
+    bmapheight = blockmaplump[3];
+
+    if (P_VerifyBlockMap(size / sizeof(*cached)))
+      return;
+
+    // stale or damaged entry - rebuild and overwrite it
+    free(blockmaplump);
+    blockmaplump = NULL;
+  }
+  else if (cached)
+  {
+    free(cached);
+  }
+
+  count = P_CreateBlockMap();
+  P_MapCacheStore("blockmap", key, blockmaplump, count * sizeof(*blockmaplump));
+}
+
 //
 // P_LoadBlockMap
 //
@@ -2085,7 +2174,7 @@ static void P_LoadBlockMap (int lump)
 
   if (M_CheckParm("-blockmap") || W_LumpLength(lump)<8 || (count = W_LumpLength(lump)/2) >= 0x10000) //e6y
     // COMPAT: MBF uses a different algorithm in P_CreateBlockMap()
-    P_CreateBlockMap();
+    P_CreateBlockMapCached(lump);
   else
     {
       long i;
@@ -2150,6 +2239,11 @@ static void P_LoadBlockMap (int lump)
 
 static void P_LoadReject(int lumpnum, int totallines)
 {
+  const byte *built;
+
+  // how the last level's built REJECT did
+  P_RejectReport();
+
   // dump any old cached reject lump, then cache the new one
   if (rejectlump != -1)
     W_UnlockLumpNum(rejectlump);
@@ -2158,6 +2252,11 @@ static void P_LoadReject(int lumpnum, int totallines)
 
   //e6y: check for overflow
   RejectOverrun(rejectlump, &rejectmatrix, totallines);
+
+  // fill in a missing REJECT, keeping the level's own entries
+  built = P_BuildReject(lumpnum, rejectmatrix, W_LumpLength(lumpnum + ML_REJECT));
+  if (built)
+    rejectmatrix = built;
 }
 
 //
@@ -2238,6 +2337,37 @@ static int P_GroupLines (void)
       P_AddLineToSector(li, li->backsector);
   }
 
+  {  // sound propagation links, see P_RecursiveSound
+    soundline_t *soundlines;
+    int count = 0;
+
+    for (i=0, sector = sectors; i<numsectors; i++, sector++)
+      for (j=0; j<sector->linecount; j++)
+        if (sector->lines[j]->flags & ML_TWOSIDED)
+          count++;
+
+    soundlines = Z_Malloc(count*sizeof(*soundlines), PU_LEVEL, 0);
+
+    for (i=0, sector = sectors; i<numsectors; i++, sector++)
+    {
+      sector->soundlines = soundlines;
+      sector->soundlinecount = 0;
+      for (j=0; j<sector->linecount; j++)
+      {
+        li = sector->lines[j];
+        if (!(li->flags & ML_TWOSIDED))
+          continue;
+
+        soundlines->line = li;
+        soundlines->other = li->sidenum[1] == NO_INDEX ? NULL :
+          sides[li->sidenum[sides[li->sidenum[0]].sector == sector]].sector;
+        soundlines->soundblock = (li->flags & ML_SOUNDBLOCK) != 0;
+        soundlines++;
+        sector->soundlinecount++;
+      }
+    }
+  }
+
   for (i=0, sector = sectors; i<numsectors; i++, sector++)
   {
     fixed_t *bbox = (void*)sector->blockbox; // cph - For convenience, so
@@ -2658,6 +2788,13 @@ void P_SetupLevel(int episode, int map, int playermask, skill_t skill)
   // Avoid segfaults on levels without nodes.
   P_CheckLevelWadStructure(lumpname);
 
+  // start reading in the map lumps while the previous level is torn down
+  for (i = ML_THINGS; i <= ML_BLOCKMAP && lumpnum + i < numlumps; i++)
+    W_PrefetchLumpNum(lumpnum + i);
+  if (gl_lumpnum > lumpnum)
+    for (i = ML_GL_VERTS; i <= ML_GL_NODES && gl_lumpnum + i < numlumps; i++)
+      W_PrefetchLumpNum(gl_lumpnum + i);
+
   leveltime = 0; totallive = 0;
 
   // note: most of this ordering is important
@@ -2730,6 +2867,8 @@ void P_SetupLevel(int episode, int map, int playermask, skill_t skill)
   {
     memset(blocklinks, 0, bmapwidth*bmapheight*sizeof(*blocklinks));
   }
+  P_InitBlockThings();
+  P_InitSightCache();
 
   if (nodesVersion > 0)
   {
@@ -2775,6 +2914,8 @@ void P_SetupLevel(int episode, int map, int playermask, skill_t skill)
   // should be after P_RemoveSlimeTrails, because it changes vertexes
   R_CalcSegsLength();
 
+  R_InitBSPNodes();
+
   // Note: you don't need to clear player queue slots --
   // a much simpler fix is in g_game.c -- killough 10/98
 
@@ -2854,6 +2995,8 @@ void P_SetupLevel(int episode, int map, int playermask, skill_t skill)
   //e6y
   P_SyncWalkcam(true, true);
   R_SmoothPlaying_Reset(NULL);
+
+  W_ReportStats("P_SetupLevel");
 }
 
 //
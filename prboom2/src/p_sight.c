@@ -39,8 +39,12 @@
 #include "p_setup.h"
 #include "m_bbox.h"
 #include "lprintf.h"
+#include "m_argv.h"
+#include "i_system.h"
 #include "g_overflow.h"
 #include "e6y.h" //e6y
+#include "m_profile.h"
+#include "p_reject.h"
 
 
 /*
@@ -58,6 +62,9 @@ int sightcounts[3];
 
 CrossSubsectorFunc P_CrossSubsector;
 
+// notes the sectors a trace reads the heights of, see the sight cache
+static void P_SightReadSector(const sector_t *sec);
+
 /*
 ==============
 =
@@ -538,6 +545,8 @@ dboolean P_CrossSubsector_PrBoom(int num)
       // crosses a two sided line
       front = ssline->seg->frontsector;
       back = ssline->seg->backsector;
+      P_SightReadSector(front);
+      P_SightReadSector(back);
 
       // no wall to block sight with?
       if (front->floorheight == back->floorheight
@@ -646,6 +655,8 @@ dboolean P_CrossSubsector_Doom(int num)
     {
       back = GetSectorAtNullAddress();
     }
+    P_SightReadSector(front);
+    P_SightReadSector(back);
 
     // no wall to block sight with?
     if (front->floorheight == back->floorheight
@@ -744,6 +755,8 @@ dboolean P_CrossSubsector_Boom(int num)
     // crosses a two sided line
     front = ssline->seg->frontsector;
     back = ssline->seg->backsector;
+    P_SightReadSector(front);
+    P_SightReadSector(back);
 
     // no wall to block sight with?
     if (front->floorheight == back->floorheight
@@ -845,34 +858,19 @@ static dboolean P_CrossBSPNode(int bspnum)
 }
 
 //
-// P_CheckSight
-// Returns true
-//  if a straight line between t1 and t2 is unobstructed.
-// Uses REJECT.
+// P_CheckSightLOS
+// The part of P_CheckSight after the REJECT table
 //
-// killough 4/20/98: cleaned up, made to use new LOS struct
 
-dboolean P_CheckSight(mobj_t *t1, mobj_t *t2)
+static dboolean P_CheckSightLOS(mobj_t *t1, mobj_t *t2)
 {
-  const sector_t *s1, *s2;
-  int pnum;
-
-  if (compatibility_level == doom_12_compatibility)
-  {
-    return P_CheckSight_12(t1, t2);
-  }
+  const sector_t *s1 = t1->subsector->sector;
+  const sector_t *s2 = t2->subsector->sector;
 
-  s1 = t1->subsector->sector;
-  s2 = t2->subsector->sector;
-  pnum = (s1->iSectorID)*numsectors + (s2->iSectorID);
-
-  // First check for trivial rejection.
-  // Determine subsector entries in REJECT table.
-  //
-  // Check in REJECT table.
-
-  if (rejectmatrix[pnum>>3] & (1 << (pnum&7)))   // can't possibly be connected
-    return false;
+  if (s1->heightsec != -1)
+    P_SightReadSector(&sectors[s1->heightsec]);
+  if (s2->heightsec != -1)
+    P_SightReadSector(&sectors[s2->heightsec]);
 
   // killough 4/19/98: make fake floors and ceilings block monster view
 
@@ -938,3 +936,312 @@ dboolean P_CheckSight(mobj_t *t1, mobj_t *t2)
   // the head node is the last node output
   return P_CrossBSPNode(numnodes-1);
 }
+
+//
+// Sight cache
+//
+// Optional memo of P_CheckSightLOS answers, keyed on everything the
+// trace reads from the two things: their subsectors, positions, z and
+// heights. The only other input is the height of the sectors whose lines
+// the trace looked at, which each entry lists. An entry goes stale when
+// one of those sectors moves a plane (T_MovePlane calls
+// P_SightSectorMoved), or all at once when the world is reloaded.
+// Moves are stamped by tic, and an entry made in the tic a sector moved
+// is stale, since it may have come before or after the move.
+// Entries outlive the tic they were made in; monsters standing still
+// and attacking a player who stands still keep hitting them.
+//
+
+#define SIGHTCACHESIZE 4096 // power of two
+#define SIGHTSECTORS   8    // more than this and any move stales the entry
+
+typedef struct {
+  const subsector_t *ss1, *ss2;
+  fixed_t x1, y1, z1, h1;
+  fixed_t x2, y2, z2, h2;
+  unsigned int stamp;
+  int made;                   // leveltime+1 of the trace
+  int numsecs;                // -1 if more than SIGHTSECTORS
+  int secs[SIGHTSECTORS];
+  dboolean seen;
+} sightcache_t;
+
+int sight_cache;
+
+static sightcache_t *sightcache;
+static unsigned int sightcachestamp;
+static int sightlastmove;     // leveltime+1 of the last move anywhere
+static dboolean sightverify;
+static int sightlookups, sighthits, sighterrors;
+
+// sectors the current trace read the heights of
+static int sightsecs[SIGHTSECTORS], numsightsecs;
+
+static void P_SightReadSector(const sector_t *sec)
+{
+  int i, id;
+
+  if (!sightcache || numsightsecs < 0)
+    return;
+
+  // GetSectorAtNullAddress gives one outside the array, which never moves
+  if (sec < sectors || sec >= sectors + numsectors)
+    return;
+
+  id = sec - sectors;
+  for (i = 0; i < numsightsecs; i++)
+    if (sightsecs[i] == id)
+      return;
+
+  if (numsightsecs == SIGHTSECTORS)
+    numsightsecs = -1;
+  else
+    sightsecs[numsightsecs++] = id;
+}
+
+//
+// P_SightCacheReport
+// Prints the hit rate of the sight cache on the level just played
+//
+
+static void P_SightCacheReport(void)
+{
+  if (!sightlookups)
+    return;
+
+  lprintf(LO_INFO, "P_SightCacheReport: %d of %d traced sight checks "
+          "(%.1f%%) answered from the cache\n", sighthits, sightlookups,
+          100.0 * sighthits / sightlookups);
+  if (sightverify)
+    lprintf(sighterrors ? LO_WARN : LO_INFO,
+            " -sightverify: %d cached answers differed from a new trace\n",
+            sighterrors);
+
+  sightlookups = sighthits = sighterrors = 0;
+}
+
+//
+// P_InitSightCache
+// Called at level start; sets the cache up if sight_cache or -sightcache
+// asks for it.
+//
+
+void P_InitSightCache(void)
+{
+  static dboolean atexit_set;
+
+  P_SightCacheReport();
+
+  if (!sight_cache && !M_CheckParm("-sightcache"))
+  {
+    free(sightcache);
+    sightcache = NULL;
+    return;
+  }
+
+  if (!sightcache)
+    sightcache = calloc(SIGHTCACHESIZE, sizeof(*sightcache));
+  sightverify = M_CheckParm("-sightverify");
+  P_ClearSightCache();
+
+  if (!atexit_set)
+  {
+    I_AtExit(P_SightCacheReport, false);
+    atexit_set = true;
+  }
+}
+
+//
+// P_ClearSightCache
+// Forgets every cached answer
+//
+
+void P_ClearSightCache(void)
+{
+  int i;
+
+  if (!sightcache)
+    return;
+
+  if (!++sightcachestamp)
+  {
+    memset(sightcache, 0, SIGHTCACHESIZE * sizeof(*sightcache));
+    sightcachestamp = 1;
+  }
+
+  // leveltime may have gone back
+  for (i = 0; i < numsectors; i++)
+    sectors[i].sightmoved = 0;
+  sightlastmove = 0;
+}
+
+//
+// P_SightSectorMoved
+// Stales the cached answers that depend on the heights of sector
+//
+
+void P_SightSectorMoved(sector_t *sector)
+{
+  sector->sightmoved = sightlastmove = leveltime + 1;
+}
+
+//
+// P_SightCacheValid
+// False if a sector the entry's trace looked at has moved since
+//
+
+static dboolean P_SightCacheValid(const sightcache_t *sc)
+{
+  int i;
+
+  if (sc->stamp != sightcachestamp)
+    return false;
+
+  if (sc->numsecs < 0)
+    return sightlastmove < sc->made;
+
+  for (i = 0; i < sc->numsecs; i++)
+    if (sectors[sc->secs[i]].sightmoved >= sc->made)
+      return false;
+  return true;
+}
+
+//
+// P_CheckSightCached
+// P_CheckSightLOS through the sight cache
+//
+
+static dboolean P_CheckSightCached(mobj_t *t1, mobj_t *t2)
+{
+  sightcache_t *sc;
+  unsigned int hash;
+
+  if (!sightcache)
+    return P_CheckSightLOS(t1, t2);
+
+  hash = ((unsigned int)t1->x >> FRACBITS) * 73856093u ^
+         ((unsigned int)t1->y >> FRACBITS) * 19349663u ^
+         ((unsigned int)t2->x >> FRACBITS) * 83492791u ^
+         ((unsigned int)t2->y >> FRACBITS) * 50331653u ^
+         ((unsigned int)(t1->z ^ t2->z) >> FRACBITS);
+  sc = &sightcache[(hash ^ (hash >> 12)) & (SIGHTCACHESIZE - 1)];
+
+  sightlookups++;
+
+  if (sc->ss1 == t1->subsector && sc->ss2 == t2->subsector &&
+      sc->x1 == t1->x && sc->y1 == t1->y &&
+      sc->z1 == t1->z && sc->h1 == t1->height &&
+      sc->x2 == t2->x && sc->y2 == t2->y &&
+      sc->z2 == t2->z && sc->h2 == t2->height &&
+      P_SightCacheValid(sc))
+  {
+    sighthits++;
+    if (sightverify && P_CheckSightLOS(t1, t2) != sc->seen)
+    {
+      sighterrors++;
+      lprintf(LO_WARN, "P_CheckSight: cached sight from sector %d to %d "
+              "is wrong\n", t1->subsector->sector->iSectorID,
+              t2->subsector->sector->iSectorID);
+    }
+    return sc->seen;
+  }
+
+  sc->ss1 = t1->subsector; sc->ss2 = t2->subsector;
+  sc->x1 = t1->x; sc->y1 = t1->y; sc->z1 = t1->z; sc->h1 = t1->height;
+  sc->x2 = t2->x; sc->y2 = t2->y; sc->z2 = t2->z; sc->h2 = t2->height;
+  sc->stamp = sightcachestamp;
+  sc->made = leveltime + 1;
+
+  numsightsecs = 0;
+  sc->seen = P_CheckSightLOS(t1, t2);
+  sc->numsecs = numsightsecs;
+  if (numsightsecs > 0)
+    memcpy(sc->secs, sightsecs, numsightsecs * sizeof(sightsecs[0]));
+  return sc->seen;
+}
+
+//
+// P_CheckSightBuilt
+// P_CheckSight for levels with a built REJECT: counts and times the
+// checks for P_RejectReport, and with -rejectverify also traces the lines
+// of sight that only the built entries rejected.
+//
+
+static dboolean P_CheckSightBuilt(mobj_t *t1, mobj_t *t2, int pnum)
+{
+  uint_64_t start;
+  dboolean seen;
+
+  rejectstats.checks++;
+
+  if (rejectwad[pnum>>3] & (1 << (pnum&7)))
+  {
+    rejectstats.wadhits++;
+    return false;
+  }
+
+  if (rejectmatrix[pnum>>3] & (1 << (pnum&7)))
+  {
+    rejectstats.hits++;
+    if (reject_verify)
+    {
+      start = M_ProfileClock();
+      if (P_CheckSightLOS(t1, t2))
+      {
+        rejectstats.errors++;
+        lprintf(LO_WARN, "P_CheckSight: built REJECT hides sector %d from %d\n",
+                t2->subsector->sector->iSectorID, t1->subsector->sector->iSectorID);
+      }
+      rejectstats.verifytime += M_ProfileClock() - start;
+    }
+    return false;
+  }
+
+  start = M_ProfileClock();
+  seen = P_CheckSightCached(t1, t2);
+  start = M_ProfileClock() - start;
+  rejectstats.traced++;
+  rejectstats.tracetime += start;
+  if (!seen)
+  {
+    rejectstats.blocked++;
+    rejectstats.blockedtime += start;
+  }
+  return seen;
+}
+
+//
+// P_CheckSight
+// Returns true
+//  if a straight line between t1 and t2 is unobstructed.
+// Uses REJECT.
+//
+// killough 4/20/98: cleaned up, made to use new LOS struct
+
+dboolean P_CheckSight(mobj_t *t1, mobj_t *t2)
+{
+  const sector_t *s1, *s2;
+  int pnum;
+
+  if (compatibility_level == doom_12_compatibility)
+  {
+    return P_CheckSight_12(t1, t2);
+  }
+
+  s1 = t1->subsector->sector;
+  s2 = t2->subsector->sector;
+  pnum = (s1->iSectorID)*numsectors + (s2->iSectorID);
+
+  if (reject_built)
+    return P_CheckSightBuilt(t1, t2, pnum);
+
+  // First check for trivial rejection.
+  // Determine subsector entries in REJECT table.
+  //
+  // Check in REJECT table.
+
+  if (rejectmatrix[pnum>>3] & (1 << (pnum&7)))   // can't possibly be connected
+    return false;
+
+  return P_CheckSightCached(t1, t2);
+}
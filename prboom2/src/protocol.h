@@ -49,8 +49,14 @@ enum packet_type_e {
   PKT_DOWN,    // Server downed
   PKT_WAD,     // Wad file request
   PKT_BACKOFF, // Request for client back-off
+  PKT_DTICC,   // delta encoded tics from client, with acknowledgement
+  PKT_DTICS,   // delta encoded tics from server, with acknowledgement
 };
 
+/* Flags the server appends to PKT_SETUP after the wad names; older
+ * clients ignore them, older servers send none. */
+#define NETFLAG_DELTATICS 1 // server understands PKT_DTICC
+
 typedef struct {
   byte checksum;       // Simple checksum of the entire packet
   byte type;           /* Type of packet */
@@ -98,4 +104,99 @@ inline static void TicToRaw(void* dst, const ticcmd_t* src)
   memcpy(dst,&tmp,sizeof tmp);
 }
 
+/* Delta encoded ticcmds, as used by PKT_DTICC and PKT_DTICS: a byte of
+ * TD_ flags for the fields that differ from the previous ticcmd of the
+ * same player in the packet (an empty one for the first), followed by
+ * those fields in order, shorts low byte first like the rest of the
+ * protocol.
+ *
+ * PKT_DTICC: player, 4 byte next tic wanted from the server, number of
+ *            tics, then one delta per tic, starting at the header tic.
+ * PKT_DTICS: 4 byte next tic wanted from the client, number of tics,
+ *            then per tic a byte with a bit per player in the tic and a
+ *            delta for each of them.
+ *
+ * Each side resends everything the other has not acknowledged in every
+ * packet, so a lost packet costs no round trip.
+ */
+#define TD_FORWARD  0x01
+#define TD_SIDE     0x02
+#define TD_ANGLE    0x04
+#define TD_CONSIST  0x08
+#define TD_CHAT     0x10
+#define TD_BUTTONS  0x20
+#define TD_MAXSIZE  (1 + 1 + 1 + 2 + 2 + 1 + 1)
+
+inline static byte* WriteTicDelta(byte* p, const ticcmd_t* prev, const ticcmd_t* cmd)
+{
+  byte* flags = p++;
+
+  *flags = 0;
+  if (cmd->forwardmove != prev->forwardmove) {
+    *flags |= TD_FORWARD; *p++ = (byte)cmd->forwardmove;
+  }
+  if (cmd->sidemove != prev->sidemove) {
+    *flags |= TD_SIDE; *p++ = (byte)cmd->sidemove;
+  }
+  if (cmd->angleturn != prev->angleturn) {
+    *flags |= TD_ANGLE;
+    *p++ = (byte)cmd->angleturn; *p++ = (byte)((unsigned short)cmd->angleturn >> 8);
+  }
+  if (cmd->consistancy != prev->consistancy) {
+    *flags |= TD_CONSIST;
+    *p++ = (byte)cmd->consistancy; *p++ = (byte)((unsigned short)cmd->consistancy >> 8);
+  }
+  if (cmd->chatchar != prev->chatchar) {
+    *flags |= TD_CHAT; *p++ = cmd->chatchar;
+  }
+  if (cmd->buttons != prev->buttons) {
+    *flags |= TD_BUTTONS; *p++ = cmd->buttons;
+  }
+  return p;
+}
+
+/* cmd holds the previous ticcmd of the player on entry. Returns NULL if
+ * the delta runs past end (the packet is untrusted). */
+inline static const byte* ReadTicDelta(const byte* p, const byte* end, ticcmd_t* cmd)
+{
+  byte flags;
+  int size = 1;
+
+  if (p >= end) return NULL;
+  flags = *p;
+  if (flags & TD_FORWARD) size += 1;
+  if (flags & TD_SIDE)    size += 1;
+  if (flags & TD_ANGLE)   size += 2;
+  if (flags & TD_CONSIST) size += 2;
+  if (flags & TD_CHAT)    size += 1;
+  if (flags & TD_BUTTONS) size += 1;
+  if (end - p < size) return NULL;
+
+  p++;
+  if (flags & TD_FORWARD) cmd->forwardmove = (signed char)*p++;
+  if (flags & TD_SIDE)    cmd->sidemove = (signed char)*p++;
+  if (flags & TD_ANGLE) {
+    cmd->angleturn = (short)(p[0] | (p[1] << 8)); p += 2;
+  }
+  if (flags & TD_CONSIST) {
+    cmd->consistancy = (short)(p[0] | (p[1] << 8)); p += 2;
+  }
+  if (flags & TD_CHAT)    cmd->chatchar = *p++;
+  if (flags & TD_BUTTONS) cmd->buttons = *p++;
+  return p;
+}
+
+/* 4 byte tic numbers in the packet bodies, low byte first */
+inline static byte* WriteTicNum(byte* p, int tic)
+{
+  *p++ = (byte)tic; *p++ = (byte)(tic >> 8);
+  *p++ = (byte)(tic >> 16); *p++ = (byte)(tic >> 24);
+  return p;
+}
+
+inline static int ReadTicNum(const byte* p)
+{
+  return (int)(p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24));
+}
+
 #endif // __PROTOCOL__
@@ -43,11 +43,11 @@
 
 int currentsubsectornum;
 
-seg_t     *curline;
+THREADLOCAL seg_t *curline;     // per thread, see R_RenderMaskedSegRange
 side_t    *sidedef;
 line_t    *linedef;
-sector_t  *frontsector;
-sector_t  *backsector;
+THREADLOCAL sector_t *frontsector;
+THREADLOCAL sector_t *backsector;
 drawseg_t *ds_p;
 
 // killough 4/7/98: indicates doors closed wrt automap bugfix:
@@ -785,32 +785,140 @@ static void R_Subsector(int num)
   }
 }
 
+//
+// R_InitBSPNodes
+// Makes the renderer's copy of the BSP tree, with the nodes laid out
+// depth first so that a subtree is one contiguous run of memory.
+// Called once the level's nodes are loaded.
+//
+
+static node_t *bspnodes;      // nodes[] in depth first order, or NULL
+static int *bspnode_index;    // nodes[] index -> bspnodes[] index
+static int *bspstack;         // pending back sides, node << 1 | side
+static int bspstack_size;
+
+void R_InitBSPNodes(void)
+{
+  int i, j, count, sp;
+
+  free(bspnodes);
+  free(bspnode_index);
+  free(bspstack);
+  bspnodes = NULL;
+  bspnode_index = NULL;
+
+  bspstack_size = MAX(numnodes, 1);
+  bspstack = malloc(bspstack_size * sizeof(*bspstack));
+
+  if (numnodes <= 0)
+    return;
+
+  for (i = 0; i < numnodes; i++)
+    for (j = 0; j < 2; j++)
+      if (!(nodes[i].children[j] & NF_SUBSECTOR) &&
+          nodes[i].children[j] >= numnodes)
+        return; // broken tree, draw it from nodes[] as it is
+
+  bspnodes = malloc(numnodes * sizeof(*bspnodes));
+  bspnode_index = malloc(numnodes * sizeof(*bspnode_index));
+  for (i = 0; i < numnodes; i++)
+    bspnode_index[i] = -1;
+
+  // preorder, children[0] first; bspstack holds nodes[] indices here,
+  // -2 marks nodes that are already on it
+  count = 0;
+  sp = 0;
+  bspstack[sp++] = numnodes - 1;
+  bspnode_index[numnodes - 1] = -2;
+  while (sp)
+  {
+    const int n = bspstack[--sp];
+
+    bspnode_index[n] = count;
+    bspnodes[count++] = nodes[n];
+    for (j = 1; j >= 0; j--)
+    {
+      int child = nodes[n].children[j];
+
+      if (!(child & NF_SUBSECTOR) && bspnode_index[child] == -1)
+      {
+        bspnode_index[child] = -2;
+        bspstack[sp++] = child;
+      }
+    }
+  }
+  // nodes not reachable from the root go at the end
+  for (i = 0; i < numnodes; i++)
+    if (bspnode_index[i] == -1)
+    {
+      bspnode_index[i] = count++;
+      bspnodes[bspnode_index[i]] = nodes[i];
+    }
+
+  for (i = 0; i < numnodes; i++)
+    for (j = 0; j < 2; j++)
+      if (!(bspnodes[i].children[j] & NF_SUBSECTOR))
+        bspnodes[i].children[j] = bspnode_index[bspnodes[i].children[j]];
+}
+
 //
 // RenderBSPNode
 // Renders all subsectors below a given node,
-//  traversing subtree recursively.
+//  front to back.
 // Just call with BSP root.
 //
 // killough 5/2/98: reformatted, removed tail recursion
+// The recursion on the front side is replaced by a stack of the
+// nodes whose back side is still to be checked.
 
 void R_RenderBSPNode(int bspnum)
 {
-  while (!(bspnum & NF_SUBSECTOR))  // Found a subsector?
+  const node_t *tree = nodes;
+  int sp = 0;
+
+  if (bspnodes)
+  {
+    tree = bspnodes;
+    if (!(bspnum & NF_SUBSECTOR))
+      bspnum = bspnode_index[bspnum];
+  }
+
+  while (true)
+  {
+    while (!(bspnum & NF_SUBSECTOR))  // Found a subsector?
     {
-      const node_t *bsp = &nodes[bspnum];
+      const node_t *bsp = &tree[bspnum];
 
       // Decide which side the view point is on.
       int side = R_PointOnSide(viewx, viewy, bsp);
-      // Recursively divide front space.
-      R_RenderBSPNode(bsp->children[side]);
 
-      // Possibly divide back space.
+      if (sp == bspstack_size)
+        I_Error("R_RenderBSPNode: BSP tree has a loop");
+
+      // Divide front space, back space later.
+      bspstack[sp++] = (bspnum << 1) | side;
+      bspnum = bsp->children[side];
+    }
+    // e6y: support for extended nodes
+    R_Subsector(bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR);
+
+    // Possibly divide back space of the nearest node that has one left.
+    while (true)
+    {
+      const node_t *bsp;
+      int side;
 
-      if (!R_CheckBBox(bsp->bbox[side^1]))
+      if (!sp)
         return;
 
-      bspnum = bsp->children[side^1];
+      bsp = &tree[bspstack[--sp] >> 1];
+      side = bspstack[sp] & 1;
+
+      if (R_CheckBBox(bsp->bbox[side^1]))
+      {
+        bspnum = bsp->children[side^1];
+        break;
+      }
     }
-  // e6y: support for extended nodes
-  R_Subsector(bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR);
+  }
 }
@@ -38,11 +38,11 @@
 #pragma interface
 #endif
 
-extern seg_t    *curline;
+extern THREADLOCAL seg_t *curline;
 extern side_t   *sidedef;
 extern line_t   *linedef;
-extern sector_t *frontsector;
-extern sector_t *backsector;
+extern THREADLOCAL sector_t *frontsector;
+extern THREADLOCAL sector_t *backsector;
 
 /* old code -- killough:
  * extern drawseg_t drawsegs[MAXDRAWSEGS];
@@ -57,6 +57,7 @@ extern drawseg_t *ds_p;
 
 void R_ClearClipSegs(void);
 void R_ClearDrawSegs(void);
+void R_InitBSPNodes(void);
 void R_RenderBSPNode(int bspnum);
 
 /* killough 4/13/98: fake floors/ceilings for deep water / fake ceilings: */
@@ -642,7 +642,7 @@ int PUREFUNC R_SafeTextureNumForName(const char *name, int snum)
 
 static inline void precache_lump(int l)
 {
-  W_CacheLumpNum(l); W_UnlockLumpNum(l);
+  W_PrefetchLumpNum(l);
 }
 
 void R_PrecacheLevel(void)
@@ -99,7 +99,8 @@ int PUREFUNC R_CheckTextureNumForName (const char *name);
 void R_InitTranMap(int);      // killough 3/6/98: translucency initialization
 int R_ColormapNumForName(const char *name);      // killough 4/4/98
 
-extern const byte *main_tranmap, *tranmap;
+extern const byte *main_tranmap;
+extern THREADLOCAL const byte *tranmap;
 
 /* Proff - Added for OpenGL - cph - const char* param */
 void R_SetPatchNum(patchnum_t *patchnum, const char *name);
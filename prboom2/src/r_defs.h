@@ -145,6 +145,10 @@ typedef struct
   int linecount;
   struct line_s **lines;
 
+  // P_GroupLines: the two-sided lines of lines[], in the same order
+  int soundlinecount;
+  struct soundline_s *soundlines;
+
   // killough 10/98: support skies coming from sidedefs. Allows scrolling
   // skies and other effects. No "level info" kind of lump is needed,
   // because you can use an arbitrary number of skies per level with this
@@ -172,6 +176,9 @@ typedef struct
   int cachedheight;
   int scaleindex;
 
+  // leveltime+1 of the last tic a plane of it moved, see p_sight.c
+  int sightmoved;
+
   //e6y
   int INTERP_SectorFloor;
   int INTERP_SectorCeiling;
@@ -250,6 +257,18 @@ typedef struct line_s
   degenmobj_t soundorg;  // sound origin for switches/buttons
 } line_t;
 
+//
+// Sound propagation link from a sector across one of its two-sided
+// lines, see P_RecursiveSound.
+//
+
+typedef struct soundline_s
+{
+  line_t *line;
+  sector_t *other;       // sector on the far side, NULL if no back side
+  dboolean soundblock;   // line has ML_SOUNDBLOCK
+} soundline_t;
+
 // phares 3/14/98
 //
 // Sector list node showing all sectors an object appears in.
@@ -463,11 +482,11 @@ typedef struct visplane
   fixed_t height;
   fixed_t xoffs, yoffs;         // killough 2/28/98: Support scrolling flats
   // e6y: resolution limitation is removed
-  // bottom and top arrays are dynamically
-  // allocated immediately after the visplane
+  // viewwidth sized top and bottom arrays, carved out of the
+  // visplane arena together with the plane. Only [minx, maxx]
+  // is valid; NULL in OpenGL mode.
+  unsigned short *top;
   unsigned short *bottom;
-  unsigned short pad1;          // leave pads for [minx-1]/[maxx+1]
-  unsigned short top[3];
 } visplane_t;
 
 #endif
@@ -45,6 +45,9 @@
 #include "g_game.h"
 #include "am_map.h"
 #include "lprintf.h"
+#include "m_argv.h"
+#include "r_drawsimd.h"
+#include "SDL.h"
 
 //
 // All drawing to the view buffer is accomplished in this file.
@@ -68,7 +71,7 @@ int  viewwindowy;
 //
 
 // CPhipps - made const*'s
-const byte *tranmap;          // translucency filter maps 256x256   // phares
+THREADLOCAL const byte *tranmap; // translucency filter maps 256x256   // phares
 const byte *main_tranmap;     // killough 4/11/98
 
 //
@@ -87,20 +90,22 @@ typedef enum
    COL_FLEXADD
 } columntype_e;
 
-static int    temp_x = 0;
-static int    tempyl[4], tempyh[4];
+// The column buffer is per thread, so that slices of the view can be
+// drawn in parallel (see r_threads.c)
+static THREADLOCAL int    temp_x = 0;
+static THREADLOCAL int    tempyl[4], tempyh[4];
 
 // e6y: resolution limitation is removed
-static byte           *byte_tempbuf;
-static unsigned short *short_tempbuf;
-static unsigned int   *int_tempbuf;
-
-static int    startx = 0;
-static int    temptype = COL_NONE;
-static int    commontop, commonbot;
-static const byte *temptranmap = NULL;
+static THREADLOCAL byte           *byte_tempbuf;
+static THREADLOCAL unsigned short *short_tempbuf;
+static THREADLOCAL unsigned int   *int_tempbuf;
+
+static THREADLOCAL int    startx = 0;
+static THREADLOCAL int    temptype = COL_NONE;
+static THREADLOCAL int    commontop, commonbot;
+static THREADLOCAL const byte *temptranmap = NULL;
 // SoM 7-28-04: Fix the fuzz problem.
-static const byte   *tempfuzzmap;
+static THREADLOCAL const byte   *tempfuzzmap;
 
 //
 // Spectre/Invisibility.
@@ -123,7 +128,7 @@ static const int fuzzoffset_org[FUZZTABLE] = {
 
 static int fuzzoffset[FUZZTABLE];
 
-static int fuzzpos = 0;
+static THREADLOCAL int fuzzpos = 0;
 
 // render pipelines
 #define RDC_STANDARD      1
@@ -178,9 +183,9 @@ static void R_QuadFlushError(void)
    I_Error("R_FlushQuadColumn called without being initialized.\n");
 }
 
-static void (*R_FlushWholeColumns)(void) = R_FlushWholeError;
-static void (*R_FlushHTColumns)(void)    = R_FlushHTError;
-static void (*R_FlushQuadColumn)(void) = R_QuadFlushError;
+static THREADLOCAL void (*R_FlushWholeColumns)(void) = R_FlushWholeError;
+static THREADLOCAL void (*R_FlushHTColumns)(void)    = R_FlushHTError;
+static THREADLOCAL void (*R_FlushQuadColumn)(void) = R_QuadFlushError;
 
 static void R_FlushColumns(void)
 {
@@ -990,16 +995,185 @@ void R_DrawSpan(draw_span_vars_t *dsvars) {
   R_GetDrawSpanFunc(drawvars.filterfloor, drawvars.filterz)(dsvars);
 }
 
+//
+// R_InitDrawers
+// Replaces the truecolor span drawers with SSE2 versions when the
+// CPU has them. They produce the same pixels, so this is safe for
+// demos and screenshots; -nosimd keeps the plain C ones.
+//
+
+void R_InitDrawers(void)
+{
+#ifdef RDRAW_SSE2
+  if (M_CheckParm("-nosimd") || !SDL_HasSSE2())
+    return;
+
+  drawspanfuncs[VID_MODE32][RDRAW_FILTER_POINT][RDRAW_FILTER_POINT] =
+    R_DrawSpan32_PointUV_PointZ_SSE2;
+  drawspanfuncs[VID_MODE32][RDRAW_FILTER_POINT][RDRAW_FILTER_LINEAR] =
+    R_DrawSpan32_LinearUV_PointZ_SSE2;
+
+  lprintf(LO_INFO, "R_InitDrawers: using SSE2 span drawers\n");
+#endif
+}
+
+//
+// R_BenchmarkDrawers
+// -benchdrawers: draws random spans with the plain C and the SIMD
+// drawers into a private buffer, checks that both give the same
+// pixels and prints the fill rate of each.
+//
+
+#define BENCH_WIDTH  1024
+#define BENCH_SPANS  4096
+#define BENCH_ROUNDS 64
+
+typedef struct
+{
+  const char *name;
+  R_DrawSpan_f scalar;
+  R_DrawSpan_f simd;
+  fixed_t maxstep;
+} drawer_bench_t;
+
+// rand() may give as few as 15 bits; shifted as unsigned, since moving
+// a bit into the sign of an int is undefined
+static unsigned int R_BenchmarkRand(void)
+{
+  return ((unsigned int)rand() << 16) ^ (unsigned int)rand();
+}
+
+static unsigned int R_BenchmarkSpans(R_DrawSpan_f func, draw_span_vars_t *spans,
+                                     int rounds)
+{
+  unsigned int start = SDL_GetTicks();
+  int i, j;
+
+  for (i = 0; i < rounds; i++)
+    for (j = 0; j < BENCH_SPANS; j++)
+      func(&spans[j]);
+
+  return SDL_GetTicks() - start;
+}
+
+void R_BenchmarkDrawers(void)
+{
+#ifdef RDRAW_SSE2
+  drawer_bench_t benches[] = {
+    { "span32 point",  R_DrawSpan32_PointUV_PointZ,  R_DrawSpan32_PointUV_PointZ_SSE2,  4 * FRACUNIT },
+    { "span32 linear", R_DrawSpan32_LinearUV_PointZ, R_DrawSpan32_LinearUV_PointZ_SSE2, FRACUNIT / 2 },
+  };
+  unsigned int *saved_palette = V_Palette32;
+  unsigned int *saved_topleft = drawvars.int_topleft;
+  int saved_pitch = drawvars.int_pitch;
+  enum draw_filter_type_e saved_filterz = drawvars.filterz;
+  draw_span_vars_t *spans;
+  unsigned int *palette, *scalar_out, *simd_out;
+  byte *flat, *colormap;
+  size_t outsize = BENCH_SPANS * BENCH_WIDTH * sizeof(*scalar_out);
+  int i, b;
+
+  if (!SDL_HasSSE2())
+  {
+    lprintf(LO_WARN, "R_BenchmarkDrawers: no SSE2 on this CPU\n");
+    return;
+  }
+
+  palette = malloc(256 * VID_NUMCOLORWEIGHTS * sizeof(*palette));
+  flat = malloc(64 * 64);
+  colormap = malloc(256);
+  spans = malloc(BENCH_SPANS * sizeof(*spans));
+  scalar_out = malloc(outsize);
+  simd_out = malloc(outsize);
+
+  srand(1);
+  for (i = 0; i < 256 * VID_NUMCOLORWEIGHTS; i++)
+    palette[i] = R_BenchmarkRand();
+  for (i = 0; i < 64 * 64; i++)
+    flat[i] = rand() & 255;
+  for (i = 0; i < 256; i++)
+    colormap[i] = rand() & 255;
+
+  V_Palette32 = palette;
+  drawvars.int_pitch = BENCH_WIDTH;
+  drawvars.filterz = RDRAW_FILTER_POINT;
+
+  // the linear steps stay below mag_threshold, so neither linear
+  // drawer drops back to point filtering through drawspanfuncs
+  for (b = 0; b < (int)(sizeof(benches) / sizeof(benches[0])); b++)
+  {
+    drawer_bench_t *bench = &benches[b];
+    unsigned int scalar_ms, simd_ms;
+    double mpixels = 0;
+
+    for (i = 0; i < BENCH_SPANS; i++)
+    {
+      draw_span_vars_t *span = &spans[i];
+
+      memset(span, 0, sizeof(*span));
+      span->y = i;
+      span->x1 = rand() % BENCH_WIDTH;
+      span->x2 = span->x1 + rand() % (BENCH_WIDTH - span->x1);
+      span->xfrac = R_BenchmarkRand();
+      span->yfrac = R_BenchmarkRand();
+      span->xstep = R_BenchmarkRand() % bench->maxstep;
+      span->ystep = R_BenchmarkRand() % bench->maxstep;
+      span->source = flat;
+      span->colormap = colormap;
+      span->nextcolormap = colormap;
+      mpixels += span->x2 - span->x1 + 1;
+    }
+    mpixels = mpixels * BENCH_ROUNDS / 1000000.0;
+
+    memset(scalar_out, 0, outsize);
+    memset(simd_out, 0, outsize);
+
+    drawvars.int_topleft = scalar_out;
+    scalar_ms = R_BenchmarkSpans(bench->scalar, spans, BENCH_ROUNDS);
+
+    drawvars.int_topleft = simd_out;
+    simd_ms = R_BenchmarkSpans(bench->simd, spans, BENCH_ROUNDS);
+
+    lprintf(LO_INFO, "%-14s C: %7.1f Mpixel/s  SSE2: %7.1f Mpixel/s  %s\n",
+      bench->name,
+      mpixels * 1000 / MAX(scalar_ms, 1), mpixels * 1000 / MAX(simd_ms, 1),
+      memcmp(scalar_out, simd_out, outsize) ? "MISMATCH" : "identical");
+  }
+
+  V_Palette32 = saved_palette;
+  drawvars.int_topleft = saved_topleft;
+  drawvars.int_pitch = saved_pitch;
+  drawvars.filterz = saved_filterz;
+
+  free(palette);
+  free(flat);
+  free(colormap);
+  free(spans);
+  free(scalar_out);
+  free(simd_out);
+#else
+  lprintf(LO_WARN, "R_BenchmarkDrawers: no SIMD drawers on this platform\n");
+#endif
+}
+
 void R_InitBuffersRes(void)
 {
   extern byte *solidcol;
 
   if (solidcol) free(solidcol);
+
+  solidcol = calloc(1, SCREENWIDTH * sizeof(*solidcol));
+
+  R_InitBuffersThreadRes();
+}
+
+// Column buffers that every rendering thread has its own copy of
+void R_InitBuffersThreadRes(void)
+{
   if (byte_tempbuf) free(byte_tempbuf);
   if (short_tempbuf) free(short_tempbuf);
   if (int_tempbuf) free(int_tempbuf);
 
-  solidcol = calloc(1, SCREENWIDTH * sizeof(*solidcol));
   byte_tempbuf = calloc(1, (SCREENHEIGHT * 4) * sizeof(*byte_tempbuf));
   short_tempbuf = calloc(1, (SCREENHEIGHT * 4) * sizeof(*short_tempbuf));
   int_tempbuf = calloc(1, (SCREENHEIGHT * 4) * sizeof(*int_tempbuf));
@@ -155,8 +155,11 @@ R_DrawSpan_f R_GetDrawSpanFunc(enum draw_filter_type_e filter,
 void R_DrawSpan(draw_span_vars_t *dsvars);
 
 void R_InitBuffer(int width, int height);
+void R_InitDrawers(void);
+void R_BenchmarkDrawers(void);
 
 void R_InitBuffersRes(void);
+void R_InitBuffersThreadRes(void);
 
 // Initialize color translation tables, for player rendering etc.
 void R_InitTranslationTables(void);
@@ -0,0 +1,217 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      SSE2 versions of the truecolor span drawers.
+ *
+ *      The texture coordinates, texel offsets and filter weights of four
+ *      pixels are computed at once, the flat, colormap and palette lookups
+ *      stay scalar (SSE2 has no gather) and the four results are stored
+ *      with one write. The output is bit for bit the same as that of the
+ *      r_drawspan.inl versions, which R_BenchmarkDrawers checks.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doomtype.h"
+#include "m_fixed.h"
+#include "r_draw.h"
+#include "r_drawsimd.h"
+#include "v_video.h"
+
+#ifdef RDRAW_SSE2
+
+#include <emmintrin.h>
+
+// allow building the SSE2 code without -msse2 on 32 bit x86;
+// it is only called after SDL_HasSSE2()
+#if defined(__GNUC__) && !defined(__SSE2__)
+#define SSE2_FUNC __attribute__((target("sse2")))
+#else
+#define SSE2_FUNC
+#endif
+
+
+SSE2_FUNC void R_DrawSpan32_PointUV_PointZ_SSE2(draw_span_vars_t *dsvars)
+{
+  unsigned count = dsvars->x2 - dsvars->x1 + 1;
+  fixed_t xfrac = dsvars->xfrac;
+  fixed_t yfrac = dsvars->yfrac;
+  const fixed_t xstep = dsvars->xstep;
+  const fixed_t ystep = dsvars->ystep;
+  const byte *source = dsvars->source;
+  const byte *colormap = dsvars->colormap;
+  unsigned int *dest = drawvars.int_topleft + dsvars->y*drawvars.int_pitch + dsvars->x1;
+
+  if (count >= 4)
+  {
+    const __m128i umask = _mm_set1_epi32(63);
+    const __m128i vmask = _mm_set1_epi32(4032);
+    const __m128i xstep4 = _mm_set1_epi32(xstep * 4);
+    const __m128i ystep4 = _mm_set1_epi32(ystep * 4);
+    __m128i xf = _mm_setr_epi32(xfrac, xfrac + xstep, xfrac + xstep * 2, xfrac + xstep * 3);
+    __m128i yf = _mm_setr_epi32(yfrac, yfrac + ystep, yfrac + ystep * 2, yfrac + ystep * 3);
+    union { __m128i v; int i[4]; } spot;
+
+    do
+    {
+      spot.v = _mm_or_si128(
+        _mm_and_si128(_mm_srli_epi32(xf, 16), umask),
+        _mm_and_si128(_mm_srli_epi32(yf, 10), vmask));
+
+      _mm_storeu_si128((__m128i *)dest, _mm_setr_epi32(
+        VID_PAL32(colormap[source[spot.i[0]]], VID_COLORWEIGHTMASK),
+        VID_PAL32(colormap[source[spot.i[1]]], VID_COLORWEIGHTMASK),
+        VID_PAL32(colormap[source[spot.i[2]]], VID_COLORWEIGHTMASK),
+        VID_PAL32(colormap[source[spot.i[3]]], VID_COLORWEIGHTMASK)));
+
+      xf = _mm_add_epi32(xf, xstep4);
+      yf = _mm_add_epi32(yf, ystep4);
+      dest += 4;
+      count -= 4;
+    } while (count >= 4);
+
+    xfrac = _mm_cvtsi128_si32(xf);
+    yfrac = _mm_cvtsi128_si32(yf);
+  }
+
+  while (count--)
+  {
+    const fixed_t spot = ((xfrac >> 16) & 63) | ((yfrac >> 10) & 4032);
+    *dest++ = VID_PAL32(colormap[source[spot]], VID_COLORWEIGHTMASK);
+    xfrac += xstep;
+    yfrac += ystep;
+  }
+}
+
+SSE2_FUNC void R_DrawSpan32_LinearUV_PointZ_SSE2(draw_span_vars_t *dsvars)
+{
+  unsigned count;
+  fixed_t xfrac, yfrac, xstep, ystep;
+  const byte *source;
+  const byte *colormap;
+  unsigned int *dest;
+
+  // drop back to point filtering if we're minifying
+  if ((D_abs(dsvars->xstep) > drawvars.mag_threshold)
+      || (D_abs(dsvars->ystep) > drawvars.mag_threshold))
+  {
+    R_GetDrawSpanFunc(RDRAW_FILTER_POINT, drawvars.filterz)(dsvars);
+    return;
+  }
+
+  count = dsvars->x2 - dsvars->x1 + 1;
+  xfrac = dsvars->xfrac;
+  yfrac = dsvars->yfrac;
+  xstep = dsvars->xstep;
+  ystep = dsvars->ystep;
+  source = dsvars->source;
+  colormap = dsvars->colormap;
+  dest = drawvars.int_topleft + dsvars->y*drawvars.int_pitch + dsvars->x1;
+
+  if (count >= 4)
+  {
+    const __m128i umask = _mm_set1_epi32(63);
+    const __m128i vmask = _mm_set1_epi32(0xfc0);
+    const __m128i fracmask = _mm_set1_epi32(0xffff);
+    const __m128i one = _mm_set1_epi32(FRACUNIT);
+    const __m128i xstep4 = _mm_set1_epi32(xstep * 4);
+    const __m128i ystep4 = _mm_set1_epi32(ystep * 4);
+    __m128i xf = _mm_setr_epi32(xfrac, xfrac + xstep, xfrac + xstep * 2, xfrac + xstep * 3);
+    __m128i yf = _mm_setr_epi32(yfrac, yfrac + ystep, yfrac + ystep * 2, yfrac + ystep * 3);
+    union { __m128i v; int i[4]; } s0, s1, s2, s3, w0, w1, w2, w3;
+
+    do
+    {
+      // texel offsets of the four neighbours, see filter_getFilteredForSpan32
+      __m128i u0 = _mm_and_si128(_mm_srli_epi32(xf, 16), umask);
+      __m128i u1 = _mm_and_si128(_mm_srli_epi32(_mm_add_epi32(xf, one), 16), umask);
+      __m128i v0 = _mm_and_si128(_mm_srli_epi32(yf, 10), vmask);
+      __m128i v1 = _mm_and_si128(_mm_srli_epi32(_mm_add_epi32(yf, one), 10), vmask);
+
+      // weights: (a*b)>>(32-VID_COLORWEIGHTBITS) for 16 bit fractions a, b.
+      // The upper halves of the lanes are zero, so a 16 bit high multiply
+      // gives (a*b)>>16 in each lane.
+      __m128i fu = _mm_and_si128(xf, fracmask);
+      __m128i fv = _mm_and_si128(yf, fracmask);
+      __m128i nfu = _mm_xor_si128(fu, fracmask);
+      __m128i nfv = _mm_xor_si128(fv, fracmask);
+
+      s0.v = _mm_or_si128(u1, v1);
+      s1.v = _mm_or_si128(u0, v1);
+      s2.v = _mm_or_si128(u0, v0);
+      s3.v = _mm_or_si128(u1, v0);
+      w0.v = _mm_srli_epi32(_mm_mulhi_epu16(fu, fv), 16 - VID_COLORWEIGHTBITS);
+      w1.v = _mm_srli_epi32(_mm_mulhi_epu16(nfu, fv), 16 - VID_COLORWEIGHTBITS);
+      w2.v = _mm_srli_epi32(_mm_mulhi_epu16(nfu, nfv), 16 - VID_COLORWEIGHTBITS);
+      w3.v = _mm_srli_epi32(_mm_mulhi_epu16(fu, nfv), 16 - VID_COLORWEIGHTBITS);
+
+#define TEXEL(n) ( \
+  VID_PAL32(colormap[source[s0.i[n]]], w0.i[n]) + \
+  VID_PAL32(colormap[source[s1.i[n]]], w1.i[n]) + \
+  VID_PAL32(colormap[source[s2.i[n]]], w2.i[n]) + \
+  VID_PAL32(colormap[source[s3.i[n]]], w3.i[n]))
+
+      _mm_storeu_si128((__m128i *)dest, _mm_setr_epi32(TEXEL(0), TEXEL(1), TEXEL(2), TEXEL(3)));
+
+#undef TEXEL
+
+      xf = _mm_add_epi32(xf, xstep4);
+      yf = _mm_add_epi32(yf, ystep4);
+      dest += 4;
+      count -= 4;
+    } while (count >= 4);
+
+    xfrac = _mm_cvtsi128_si32(xf);
+    yfrac = _mm_cvtsi128_si32(yf);
+  }
+
+  while (count--)
+  {
+    const unsigned int fu = xfrac & 0xffff;
+    const unsigned int fv = yfrac & 0xffff;
+    const int u0 = (xfrac >> 16) & 0x3f;
+    const int u1 = ((xfrac + FRACUNIT) >> 16) & 0x3f;
+    const int v0 = (yfrac >> 10) & 0xfc0;
+    const int v1 = ((yfrac + FRACUNIT) >> 10) & 0xfc0;
+
+    *dest++ =
+      VID_PAL32(colormap[source[u1 | v1]], (fu * fv) >> (32 - VID_COLORWEIGHTBITS)) +
+      VID_PAL32(colormap[source[u0 | v1]], ((0xffff - fu) * fv) >> (32 - VID_COLORWEIGHTBITS)) +
+      VID_PAL32(colormap[source[u0 | v0]], ((0xffff - fu) * (0xffff - fv)) >> (32 - VID_COLORWEIGHTBITS)) +
+      VID_PAL32(colormap[source[u1 | v0]], (fu * (0xffff - fv)) >> (32 - VID_COLORWEIGHTBITS));
+    xfrac += xstep;
+    yfrac += ystep;
+  }
+}
+
+#endif // RDRAW_SSE2
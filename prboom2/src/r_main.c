@@ -56,9 +56,11 @@
 #include "g_game.h"
 #include "r_demo.h"
 #include "r_fps.h"
+#include "r_threads.h"
 #include <math.h>
 #include "e6y.h"//e6y
 #include "xs_Float.h"
+#include "m_profile.h"
 
 // e6y
 // Now they are variables. Depends from render_doom_lightmaps variable.
@@ -116,8 +118,8 @@ int viewport[4];
 float modelMatrix[16];
 float projMatrix[16];
 
-extern const lighttable_t **walllights;
-extern const lighttable_t **walllightsnext;
+extern THREADLOCAL const lighttable_t **walllights;
+extern THREADLOCAL const lighttable_t **walllightsnext;
 
 //
 // precalculated math tables
@@ -891,6 +893,7 @@ void R_Init (void)
   R_InitTranslationTables();
   lprintf(LO_INFO, "R_InitPatches ");
   R_InitPatches();
+  R_InitDrawers();
 }
 
 //
@@ -1061,10 +1064,15 @@ void R_ShowStats(void)
     renderer_fps = 1000 * FPS_FrameCount / (tick - FPS_SavedTick);
     if (rendering_stats)
     {
-      doom_printf((V_GetMode() == VID_MODEGL)
-                  ?"Frame rate %d fps\nWalls %d, Flats %d, Sprites %d"
-                  :"Frame rate %d fps\nSegs %d, Visplanes %d, Sprites %d",
-      renderer_fps, rendered_segs, rendered_visplanes, rendered_vissprites);
+      if (V_GetMode() == VID_MODEGL)
+        doom_printf("Frame rate %d fps\nWalls %d, Flats %d, Sprites %d",
+          renderer_fps, rendered_segs, rendered_visplanes, rendered_vissprites);
+      else
+        doom_printf("Frame rate %d fps\nSegs %d, Visplanes %d, Sprites %d\n"
+                    "Planes new %d, merged %d, split %d, arena %dK/%dK",
+          renderer_fps, rendered_segs, rendered_visplanes, rendered_vissprites,
+          visplanes_new, visplanes_merged, visplanes_split,
+          (int)(visplane_arena_used / 1024), (int)(visplane_arena_size / 1024));
     }
     FPS_SavedTick = tick;
     FPS_FrameCount = 0;
@@ -1076,6 +1084,28 @@ void R_ClearStats(void)
   rendered_visplanes = 0;
   rendered_segs = 0;
   rendered_vissprites = 0;
+  visplanes_new = 0;
+  visplanes_merged = 0;
+  visplanes_split = 0;
+}
+
+//
+// R_DrawPlanesSlice, R_DrawViewSlice
+// The parts of the software view that are drawn per slice, after the BSP
+// walk has drawn the walls. See r_threads.c.
+//
+static void R_DrawPlanesSlice(void)
+{
+  R_DrawPlanes();
+  R_ResetColumnBuffer();
+}
+
+static void R_DrawViewSlice(void)
+{
+  R_DrawPlanesSlice();
+
+  R_DrawMaskedSlice();
+  R_ResetColumnBuffer();
 }
 
 //
@@ -1087,6 +1117,8 @@ void R_RenderPlayerView (player_t* player)
 
   r_frame_count++;
 
+  PROFILE_BEGIN(prof_render);
+  PROFILE_BEGIN(prof_r_setup);
   R_SetupFrame (player);
 
   // Clear buffers.
@@ -1115,6 +1147,7 @@ void R_RenderPlayerView (player_t* player)
       R_DrawViewBorder();
     }
   }
+  PROFILE_END(prof_r_setup);
 
   // check for new console commands.
 #ifdef HAVE_NET
@@ -1133,25 +1166,28 @@ void R_RenderPlayerView (player_t* player)
 #endif
 
   // The head node is the last node output.
+  PROFILE_BEGIN(prof_r_bsp);
   R_RenderBSPNode (numnodes-1);
+  PROFILE_END(prof_r_bsp);
 
 #ifdef HAVE_NET
   NetUpdate ();
 #endif
 
-  if (V_GetMode() != VID_MODEGL)
-    R_DrawPlanes();
-
+  PROFILE_BEGIN(prof_r_draw);
   R_ResetColumnBuffer();
 
-  // Check for new console commands.
-#ifdef HAVE_NET
-  NetUpdate ();
-#endif
-
   if (V_GetMode() != VID_MODEGL) {
-    R_DrawMasked ();
-    R_ResetColumnBuffer();
+    R_SetupMasked();
+    if (R_MaskedHasFuzz())
+    {
+      // keep the fuzz sequence of the single threaded renderer
+      R_RunRenderSlices(R_DrawPlanesSlice);
+      R_DrawMaskedSlice();
+      R_ResetColumnBuffer();
+    }
+    else
+      R_RunRenderSlices(R_DrawViewSlice);
   }
 
   // Check for new console commands.
@@ -1167,4 +1203,6 @@ void R_RenderPlayerView (player_t* player)
     gld_EndDrawScene();
 #endif
   }
+  PROFILE_END(prof_r_draw);
+  PROFILE_END(prof_render);
 }
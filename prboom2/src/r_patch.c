@@ -71,6 +71,7 @@
 #include "lprintf.h"
 #include "r_patch.h"
 #include "v_video.h"
+#include "r_threads.h"
 #include <assert.h>
 
 // posts are runs of non masked source pixels
@@ -882,6 +883,8 @@ const rpatch_t *R_CachePatchNum(int id) {
     I_Error("createPatch: %i >= numlumps", id);
 #endif
 
+  R_LockRenderCache();
+
   if (!patches[id].data)
     createPatch(id);
 
@@ -900,6 +903,8 @@ const rpatch_t *R_CachePatchNum(int id) {
 	    lumpinfo[id].name, patches[id].locks);
 #endif
 
+  R_UnlockRenderCache();
+
   return &patches[id];
 }
 
@@ -911,12 +916,14 @@ void R_UnlockPatchNum(int id)
     lprintf(LO_DEBUG, "R_UnlockPatchNum: Excess unlocks on %8s (%d-%d)\n", 
 	    lumpinfo[id].name, patches[id].locks, unlocks);
 #endif
+  R_LockRenderCache();
   patches[id].locks -= unlocks;
   /* cph - Note: must only tell z_zone to make purgeable if currently locked, 
    * else it might already have been purged
    */
   if (unlocks && !patches[id].locks)
     Z_ChangeTag(patches[id].data, PU_CACHE);
+  R_UnlockRenderCache();
 }
 
 //---------------------------------------------------------------------------
@@ -931,6 +938,8 @@ const rpatch_t *R_CacheTextureCompositePatchNum(int id) {
     I_Error("createTextureCompositePatch: %i >= numtextures", id);
 #endif
 
+  R_LockRenderCache();
+
   if (!texture_composites[id].data)
     createTextureCompositePatch(id);
 
@@ -949,6 +958,8 @@ const rpatch_t *R_CacheTextureCompositePatchNum(int id) {
 	    textures[id]->name, texture_composites[id].locks);
 #endif
 
+  R_UnlockRenderCache();
+
   return &texture_composites[id];
 
 }
@@ -961,12 +972,14 @@ void R_UnlockTextureCompositePatchNum(int id)
     lprintf(LO_DEBUG, "R_UnlockTextureCompositePatchNum: Excess unlocks on %8s (%d-%d)\n", 
 	    textures[id]->name, texture_composites[id].locks, unlocks);
 #endif
+  R_LockRenderCache();
   texture_composites[id].locks -= unlocks;
   /* cph - Note: must only tell z_zone to make purgeable if currently locked, 
    * else it might already have been purged
    */
   if (unlocks && !texture_composites[id].locks)
     Z_ChangeTag(texture_composites[id].data, PU_CACHE);
+  R_UnlockRenderCache();
 }
 
 //---------------------------------------------------------------------------
@@ -60,14 +60,33 @@
 #include "r_main.h"
 #include "v_video.h"
 #include "lprintf.h"
+#include "r_threads.h"
 
 #define MAXVISPLANES 128    /* must be a power of 2 */
 
 static visplane_t *visplanes[MAXVISPLANES];   // killough
-static visplane_t *freetail;                  // killough
-static visplane_t **freehead = &freetail;     // killough
 visplane_t *floorplane, *ceilingplane;
 
+// Visplanes and their top/bottom arrays are bump allocated from a
+// chain of blocks, all of which are handed back at the start of each
+// frame. The blocks are kept, so after the first few frames of a
+// level no memory is allocated at all.
+
+#define VISPLANE_BLOCKSIZE (256*1024)
+
+typedef struct visplane_block_s
+{
+  struct visplane_block_s *next;
+  size_t size, used;
+} visplane_block_t;
+
+static visplane_block_t *visplane_blocks;
+static visplane_block_t *visplane_curblock;
+
+// for R_ShowStats
+int visplanes_new, visplanes_merged, visplanes_split;
+size_t visplane_arena_used, visplane_arena_size;
+
 // killough -- hash function for visplanes
 // Empirically verified to be fairly uniform:
 
@@ -89,30 +108,37 @@ int *ceilingclip = NULL;
 // spanstart holds the start of a plane span; initialized to 0 at start
 
 // e6y: resolution limitation is removed
-static int *spanstart = NULL;                // killough 2/8/98
+static THREADLOCAL int *spanstart = NULL;    // killough 2/8/98
 
 //
 // texture mapping
 //
 
-static const lighttable_t **planezlight;
-static fixed_t planeheight;
+static THREADLOCAL const lighttable_t **planezlight;
+static THREADLOCAL fixed_t planeheight;
 
 // killough 2/8/98: make variables static
 
 static fixed_t basexscale, baseyscale;
 static fixed_t *cachedheight = NULL;
-static fixed_t xoffs,yoffs;    // killough 2/28/98: flat offsets
+static THREADLOCAL fixed_t xoffs,yoffs;    // killough 2/28/98: flat offsets
 
 // e6y: resolution limitation is removed
 fixed_t *yslope = NULL;
 fixed_t *distscale = NULL;
 
+// Buffers that every rendering thread has its own copy of
+void R_InitPlanesThreadRes(void)
+{
+  if (spanstart) free(spanstart);
+
+  spanstart = calloc(1, SCREENHEIGHT * sizeof(*spanstart));
+}
+
 void R_InitPlanesRes(void)
 {
   if (floorclip) free(floorclip);
   if (ceilingclip) free(ceilingclip);
-  if (spanstart) free(spanstart);
 
   if (cachedheight) free(cachedheight);
 
@@ -121,7 +147,7 @@ void R_InitPlanesRes(void)
 
   floorclip = calloc(1, SCREENWIDTH * sizeof(*floorclip));
   ceilingclip = calloc(1, SCREENWIDTH * sizeof(*ceilingclip));
-  spanstart = calloc(1, SCREENHEIGHT * sizeof(*spanstart));
+  R_InitPlanesThreadRes();
 
   cachedheight = calloc(1, SCREENHEIGHT * sizeof(*cachedheight));
 
@@ -132,14 +158,16 @@ void R_InitPlanesRes(void)
 void R_InitVisplanesRes(void)
 {
   int i;
-  
-  freetail = NULL;
-  freehead = &freetail;
 
+  // the arena does not depend on the resolution, only drop the planes
   for (i = 0; i < MAXVISPLANES; i++)
   {
     visplanes[i] = 0;
   }
+
+  visplane_curblock = visplane_blocks;
+  if (visplane_curblock)
+    visplane_curblock->used = 0;
 }
 
 //
@@ -239,8 +267,12 @@ void R_ClearPlanes(void)
     floorclip[i] = viewheight, ceilingclip[i] = -1;
 
   for (i=0;i<MAXVISPLANES;i++)    // new code -- killough
-    for (*freehead = visplanes[i], visplanes[i] = NULL; *freehead; )
-      freehead = &(*freehead)->next;
+    visplanes[i] = NULL;
+
+  visplane_curblock = visplane_blocks;
+  if (visplane_curblock)
+    visplane_curblock->used = 0;
+  visplane_arena_used = 0;
 
   lastopening = openings;
 
@@ -252,25 +284,84 @@ void R_ClearPlanes(void)
   baseyscale = FixedDiv (viewcos,projection);
 }
 
+//
+// R_VisplaneAlloc
+// Bump allocates size bytes from the visplane arena, moving on to the
+// next block (or chaining a new one) when the current one is full.
+//
+
+static void *R_VisplaneAlloc(size_t size)
+{
+  visplane_block_t *block = visplane_curblock;
+  void *p;
+
+  size = (size + 7) & ~7;
+
+  if (!block || block->used + size > block->size)
+  {
+    if (block && block->next)
+    {
+      block = block->next;
+    }
+    else
+    {
+      size_t blocksize = MAX(VISPLANE_BLOCKSIZE, size + sizeof(*block));
+      visplane_block_t *newblock = malloc(blocksize);
+
+      newblock->next = NULL;
+      newblock->size = blocksize - sizeof(*block);
+      if (block)
+        block->next = newblock;
+      else
+        visplane_blocks = newblock;
+      block = newblock;
+      visplane_arena_size += blocksize;
+    }
+    block->used = 0;
+    visplane_curblock = block;
+
+    // a block from an earlier frame may be too small for a new resolution
+    if (size > block->size)
+      return R_VisplaneAlloc(size);
+  }
+
+  p = (byte *)(block + 1) + block->used;
+  block->used += size;
+  visplane_arena_used += size;
+  return p;
+}
+
 // New function, by Lee Killough
 
 static visplane_t *new_visplane(unsigned hash)
 {
-  visplane_t *check = freetail;
-  if (!check)
+  visplane_t *check = R_VisplaneAlloc(sizeof(*check));
+
+  // e6y: resolution limitation is removed
+  if (V_GetMode() != VID_MODEGL)
   {
-    // e6y: resolution limitation is removed
-    check = calloc(1, sizeof(*check) + sizeof(*check->top) * (SCREENWIDTH * 2));
-    check->bottom = &check->top[SCREENWIDTH + 2];
+    check->top = R_VisplaneAlloc(viewwidth * sizeof(*check->top));
+    check->bottom = R_VisplaneAlloc(viewwidth * sizeof(*check->bottom));
   }
   else
-    if (!(freetail = freetail->next))
-      freehead = &freetail;
+  {
+    check->top = check->bottom = NULL;
+  }
   check->next = visplanes[hash];
   visplanes[hash] = check;
+  visplanes_new++;
   return check;
 }
 
+// Marks the columns [start, stop] of a plane as not covered yet
+static void R_ClearPlaneColumns(visplane_t *pl, int start, int stop)
+{
+  int x;
+
+  for (x = start; x <= stop; x++)
+    pl->top[x] = SHRT_MAX;
+}
+
 /*
  * R_DupPlane
  *
@@ -278,10 +369,11 @@ static visplane_t *new_visplane(unsigned hash)
  */
 visplane_t *R_DupPlane(const visplane_t *pl, int start, int stop)
 {
-      int i;
       unsigned hash = visplane_hash(pl->picnum, pl->lightlevel, pl->height);
       visplane_t *new_pl = new_visplane(hash);
 
+      visplanes_split++;
+
       new_pl->height = pl->height;
       new_pl->picnum = pl->picnum;
       new_pl->lightlevel = pl->lightlevel;
@@ -289,8 +381,7 @@ visplane_t *R_DupPlane(const visplane_t *pl, int start, int stop)
       new_pl->yoffs = pl->yoffs;
       new_pl->minx = start;
       new_pl->maxx = stop;
-      for (i = 0; i != SCREENWIDTH; i++)
-        new_pl->top[i] = SHRT_MAX;
+      R_ClearPlaneColumns(new_pl, start, stop);
       return new_pl;
 }
 //
@@ -325,17 +416,9 @@ visplane_t *R_FindPlane(fixed_t height, int picnum, int lightlevel,
   check->lightlevel = lightlevel;
   check->xoffs = xoffs;               // killough 2/28/98: Save offsets
   check->yoffs = yoffs;
-#ifdef GL_DOOM
-  if (V_GetMode() != VID_MODEGL)
-#endif
-  {
-    int i;
-    check->minx = viewwidth; // Was SCREENWIDTH -- killough 11/98
-    check->maxx = -1;
-
-    for (i = 0; i != SCREENWIDTH; i++)
-      check->top[i] = SHRT_MAX;
-  }
+  // empty; R_CheckPlane clears the columns as the range grows
+  check->minx = viewwidth; // Was SCREENWIDTH -- killough 11/98
+  check->maxx = -1;
 
   return check;
 }
@@ -361,6 +444,14 @@ visplane_t *R_CheckPlane(visplane_t *pl, int start, int stop)
     ;
 
   if (x > intrh) { /* Can use existing plane; extend range */
+    if (pl->minx > pl->maxx)
+      R_ClearPlaneColumns(pl, start, stop);
+    else
+    {
+      R_ClearPlaneColumns(pl, unionl, pl->minx - 1);
+      R_ClearPlaneColumns(pl, pl->maxx + 1, unionh);
+      visplanes_merged++;
+    }
     pl->minx = unionl; pl->maxx = unionh;
     return pl;
   } else /* Cannot use existing plane; create a new one */
@@ -390,12 +481,17 @@ static void R_MakeSpans(int x, unsigned int t1, unsigned int b1,
 static void R_DoDrawPlane(visplane_t *pl)
 {
   register int x;
+  int x1, x2;
   draw_column_vars_t dcvars;
   R_DrawColumn_f colfunc = R_GetDrawColumnFunc(RDC_PIPELINE_STANDARD, drawvars.filterwall, drawvars.filterz);
 
   R_SetDefaultDrawColumnVars(&dcvars);
 
-  if (pl->minx <= pl->maxx) {
+  // only the columns of this thread's slice of the view
+  x1 = MAX(pl->minx, r_slice_x1);
+  x2 = MIN(pl->maxx, r_slice_x2);
+
+  if (x1 <= x2) {
     if (pl->picnum == skyflatnum || pl->picnum & PL_SKYFLAT) { // sky flat
       int texture;
       const rpatch_t *tex_patch;
@@ -473,7 +569,7 @@ static void R_DoDrawPlane(visplane_t *pl)
       tex_patch = R_CacheTextureCompositePatchNum(texture);
 
   // killough 10/98: Use sky scrolling offset, and possibly flip picture
-        for (x = pl->minx; (dcvars.x = x) <= pl->maxx; x++)
+        for (x = x1; (dcvars.x = x) <= x2; x++)
           if ((dcvars.yl = pl->top[x]) != SHRT_MAX && dcvars.yl <= (dcvars.yh = pl->bottom[x])) // dropoff overflow
             {
               dcvars.source = R_GetTextureColumn(tex_patch, ((an + xtoviewangle[x])^flip) >> ANGLETOSKYSHIFT);
@@ -489,7 +585,9 @@ static void R_DoDrawPlane(visplane_t *pl)
       int stop, light;
       draw_span_vars_t dsvars;
 
+      R_LockRenderCache();
       dsvars.source = W_CacheLumpNum(firstflat + flattranslation[pl->picnum]);
+      R_UnlockRenderCache();
 
       xoffs = pl->xoffs;  // killough 2/28/98: Add offsets
       yoffs = pl->yoffs;
@@ -507,15 +605,22 @@ static void R_DoDrawPlane(visplane_t *pl)
       if(light < 0)
         light = 0;
 
-      stop = pl->maxx + 1;
+      stop = x2 + 1;
       planezlight = zlight[light];
-      pl->top[pl->minx-1] = pl->top[stop] = SHRT_MAX; // dropoff overflow
 
-      for (x = pl->minx ; x <= stop ; x++)
+      // The plane is empty left and right of the drawn range. This used
+      // to be done by setting pl->top[minx-1] and pl->top[maxx+1], but
+      // the plane is shared by all slices, and a slice can start in the
+      // middle of it.
+      R_MakeSpans(x1, SHRT_MAX, 0, pl->top[x1], pl->bottom[x1], &dsvars); // dropoff overflow
+      for (x = x1 + 1 ; x < stop ; x++)
          R_MakeSpans(x,pl->top[x-1],pl->bottom[x-1],
                      pl->top[x],pl->bottom[x], &dsvars);
+      R_MakeSpans(stop, pl->top[x2], pl->bottom[x2], SHRT_MAX, 0, &dsvars);
 
+      R_LockRenderCache();
       W_UnlockLumpNum(firstflat + flattranslation[pl->picnum]);
+      R_UnlockRenderCache();
     }
   }
 }
@@ -530,6 +635,11 @@ void R_DrawPlanes (void)
   visplane_t *pl;
   int i;
   for (i=0;i<MAXVISPLANES;i++)
-    for (pl=visplanes[i]; pl; pl=pl->next, rendered_visplanes++)
+    for (pl=visplanes[i]; pl; pl=pl->next)
+    {
+      // counted once, by the thread drawing the first slice
+      if (r_slice_x1 == 0)
+        rendered_visplanes++;
       R_DoDrawPlane(pl);
+    }
 }
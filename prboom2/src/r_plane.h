@@ -50,8 +50,13 @@ extern int *lastopening; // dropoff overflow
 extern int *floorclip, *ceilingclip; // dropoff overflow
 extern fixed_t *yslope, *distscale;
 
+/* Visplane counters of the current frame, for R_ShowStats */
+extern int visplanes_new, visplanes_merged, visplanes_split;
+extern size_t visplane_arena_used, visplane_arena_size;
+
 void R_InitVisplanesRes(void);
 void R_InitPlanesRes(void);
+void R_InitPlanesThreadRes(void);
 void R_InitPlanes(void);
 void R_ClearPlanes(void);
 void R_DrawPlanes (void);
@@ -48,6 +48,7 @@
 #include "w_wad.h"
 #include "v_video.h"
 #include "lprintf.h"
+#include "r_threads.h"
 
 // OPTIMIZE: closed two sided lines as single sided
 
@@ -67,8 +68,8 @@ static fixed_t  toptexheight, midtexheight, bottomtexheight; // cph
 angle_t         rw_normalangle; // angle to line origin
 int             rw_angle1;
 fixed_t         rw_distance;
-const lighttable_t    **walllights;
-const lighttable_t    **walllightsnext;
+THREADLOCAL const lighttable_t **walllights;
+THREADLOCAL const lighttable_t **walllightsnext;
 
 //
 // regular wall
@@ -78,11 +79,11 @@ static int      rw_stopx;
 static angle_t  rw_centerangle;
 static fixed_t  rw_offset;
 static fixed_t  rw_scale;
-static fixed_t  rw_scalestep;
+static THREADLOCAL fixed_t rw_scalestep;
 static fixed_t  rw_midtexturemid;
 static fixed_t  rw_toptexturemid;
 static fixed_t  rw_bottomtexturemid;
-static int      rw_lightlevel;
+static THREADLOCAL int rw_lightlevel;
 static int      worldtop;
 static int      worldbottom;
 static int      worldhigh;
@@ -95,7 +96,7 @@ static int_64_t  topfrac; // R_WiggleFix
 static fixed_t  topstep;
 static int_64_t  bottomfrac; // R_WiggleFix
 static fixed_t  bottomstep;
-static int      *maskedtexturecol; // dropoff overflow
+static THREADLOCAL int *maskedtexturecol; // dropoff overflow
 
 static int	max_rwscale = 64 * FRACUNIT;
 static int	HEIGHTBITS = 12;
@@ -257,6 +258,12 @@ void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2)
   draw_column_vars_t dcvars;
   angle_t angle;
 
+  // only the columns of this thread's slice of the view
+  x1 = MAX(x1, r_slice_x1);
+  x2 = MIN(x2, r_slice_x2);
+  if (x1 > x2)
+    return;
+
   R_SetDefaultDrawColumnVars(&dcvars);
 
   // Calculate light table.
@@ -273,7 +280,11 @@ void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2)
       colfunc = R_GetDrawColumnFunc(RDC_PIPELINE_TRANSLUCENT, drawvars.filterwall, drawvars.filterz);
       tranmap = main_tranmap;
       if (curline->linedef->tranlump > 0)
+      {
+        R_LockRenderCache();
         tranmap = W_CacheLumpNum(curline->linedef->tranlump-1);
+        R_UnlockRenderCache();
+      }
     }
   // killough 4/11/98: end translucent 2s normal code
 
@@ -392,7 +403,11 @@ void R_RenderMaskedSegRange(drawseg_t *ds, int x1, int x2)
 
   // Except for main_tranmap, mark others purgable at this point
   if (curline->linedef->tranlump > 0 && general_translucency)
+  {
+    R_LockRenderCache();
     W_UnlockLumpNum(curline->linedef->tranlump-1); // cph - unlock it
+    R_UnlockRenderCache();
+  }
 
   R_UnlockTextureCompositePatchNum(texnum);
 
@@ -42,12 +42,13 @@
 #include "v_video.h"
 #include "p_pspr.h"
 #include "lprintf.h"
+#include "r_threads.h"
 #include "e6y.h"//e6y
 
 #define BASEYCENTER 100
 
-static int *clipbot = NULL; // killough 2/8/98: // dropoff overflow
-static int *cliptop = NULL; // change to MAX_*  // dropoff overflow
+static THREADLOCAL int *clipbot = NULL; // killough 2/8/98: // dropoff overflow
+static THREADLOCAL int *cliptop = NULL; // change to MAX_*  // dropoff overflow
 
 //
 // Sprite rotation 0 is facing the viewer,
@@ -83,18 +84,17 @@ typedef struct drawseg_xrange_item_s
   drawseg_t *user;
 } drawseg_xrange_item_t;
 
-typedef struct drawsegs_xrange_s
-{
-  drawseg_xrange_item_t *items;
-  int count;
-} drawsegs_xrange_t;
-
-#define DS_RANGES_COUNT 3
-static drawsegs_xrange_t drawsegs_xranges[DS_RANGES_COUNT];
+// The view columns are split in halves DS_RANGE_LEVELS-1 times, which
+// gives a binary tree of column ranges numbered like a heap (1 is the
+// whole view, 2n and 2n+1 the halves of n). Every node lists the
+// drawsegs that overlap it, in drawing order, and a sprite only scans
+// the list of the smallest node that holds all its columns.
+#define DS_RANGE_LEVELS 6
+#define DS_RANGE_NODES (1 << DS_RANGE_LEVELS)
 
 static drawseg_xrange_item_t *drawsegs_xrange;
 static unsigned int drawsegs_xrange_size = 0;
-static int drawsegs_xrange_count = 0;
+static int drawsegs_xrange_start[DS_RANGE_NODES + 1]; // node n is [start[n], start[n+1])
 
 // constant arrays
 //  used for psprite clipping and initializing clipping
@@ -127,6 +127,12 @@ void R_InitSpritesRes(void)
   negonearray = calloc(1, SCREENWIDTH * sizeof(*negonearray));
   screenheightarray = calloc(1, SCREENWIDTH * sizeof(*screenheightarray));
 
+  R_InitSpritesThreadRes();
+}
+
+// Buffers that every rendering thread has its own copy of
+void R_InitSpritesThreadRes(void)
+{
   if (clipbot) free(clipbot);
 
   clipbot = calloc(1, 2 * SCREENWIDTH * sizeof(*clipbot));
@@ -440,10 +446,10 @@ static vissprite_t *R_NewVisSprite(void)
 //  in posts/runs of opaque pixels.
 //
 
-int   *mfloorclip;   // dropoff overflow
-int   *mceilingclip; // dropoff overflow
-fixed_t spryscale;
-int_64_t sprtopscreen; // R_WiggleFix
+THREADLOCAL int   *mfloorclip;   // dropoff overflow
+THREADLOCAL int   *mceilingclip; // dropoff overflow
+THREADLOCAL fixed_t spryscale;
+THREADLOCAL int_64_t sprtopscreen; // R_WiggleFix
 
 void R_DrawMaskedColumn(
   const rpatch_t *patch,
@@ -512,11 +518,20 @@ static void R_DrawVisSprite(vissprite_t *vis)
 {
   int      texturecolumn;
   fixed_t  frac;
-  const rpatch_t *patch = R_CachePatchNum(vis->patch+firstspritelump);
+  const rpatch_t *patch;
   R_DrawColumn_f colfunc;
   draw_column_vars_t dcvars;
   enum draw_filter_type_e filter;
   enum draw_filter_type_e filterz;
+  int      x1, x2;
+
+  // only the columns of this thread's slice of the view
+  x1 = MAX(vis->x1, r_slice_x1);
+  x2 = MIN(vis->x2, r_slice_x2);
+  if (x1 > x2)
+    return;
+
+  patch = R_CachePatchNum(vis->patch+firstspritelump);
 
   R_SetDefaultDrawColumnVars(&dcvars);
   if (vis->mobjflags & MF_PLAYERSPRITE) {
@@ -563,7 +578,7 @@ static void R_DrawVisSprite(vissprite_t *vis)
 // proff 11/06/98: Changed for high-res
   dcvars.iscale = FixedDiv (FRACUNIT, vis->scale);
   dcvars.texturemid = vis->texturemid;
-  frac = vis->startfrac;
+  frac = vis->startfrac + (x1 - vis->x1) * vis->xiscale;
   if (filter == RDRAW_FILTER_LINEAR)
     frac -= (FRACUNIT>>1);
   spryscale = vis->scale;
@@ -578,7 +593,7 @@ static void R_DrawVisSprite(vissprite_t *vis)
     sprtopscreen += (viewheight/2 - centery)<<FRACBITS;
   }
 
-  for (dcvars.x=vis->x1 ; dcvars.x<=vis->x2 ; dcvars.x++, frac += vis->xiscale)
+  for (dcvars.x=x1 ; dcvars.x<=x2 ; dcvars.x++, frac += vis->xiscale)
     {
       texturecolumn = frac>>FRACBITS;
       dcvars.texu = frac;
@@ -936,6 +951,10 @@ static void R_ApplyWeaponBob (fixed_t *sx, dboolean bobx, fixed_t *sy, dboolean
 // R_DrawPSprite
 //
 
+// player sprites projected for the current frame (software mode)
+static vissprite_t psprite_vis[NUMPSPRITES];
+static int num_psprite_vis;
+
 static void R_DrawPSprite (pspdef_t *psp)
 {
   int           x1, x2;
@@ -1088,9 +1107,11 @@ static void R_DrawPSprite (pspdef_t *psp)
   }
 
   // proff 11/99: don't use software stuff in OpenGL
+  // Software psprites are drawn later, slice by slice
   if (V_GetMode() != VID_MODEGL)
   {
-    R_DrawVisSprite(vis);
+    if (num_psprite_vis < NUMPSPRITES)
+      psprite_vis[num_psprite_vis++] = *vis;
   }
 #ifdef GL_DOOM
   else
@@ -1124,27 +1145,43 @@ static void R_DrawPSprite (pspdef_t *psp)
 // R_DrawPlayerSprites
 //
 
-void R_DrawPlayerSprites(void)
+static void R_ProjectPlayerSprites(void)
 {
   int i;
   pspdef_t *psp;
 
+  num_psprite_vis = 0;
+
   if (walkcamera.type != 0)
     return;
 
   // get light level
   R_SetSpritelights(viewplayer->mo->subsector->sector->lightlevel);
 
-  // clip to screen bounds
-  mfloorclip = screenheightarray;
-  mceilingclip = negonearray;
-
   // add all active psprites
   for (i=0, psp=viewplayer->psprites; i<NUMPSPRITES; i++,psp++)
     if (psp->state)
       R_DrawPSprite (psp);
 }
 
+static void R_DrawProjectedPlayerSprites(void)
+{
+  int i;
+
+  // clip to screen bounds
+  mfloorclip = screenheightarray;
+  mceilingclip = negonearray;
+
+  for (i = 0; i < num_psprite_vis; i++)
+    R_DrawVisSprite(&psprite_vis[i]);
+}
+
+void R_DrawPlayerSprites(void)
+{
+  R_ProjectPlayerSprites();
+  R_DrawProjectedPlayerSprites();
+}
+
 //
 // R_SortVisSprites
 //
@@ -1165,6 +1202,8 @@ void R_DrawPlayerSprites(void)
 #endif
 
 // killough 9/2/98: merge sort
+// Takes the left run on equal scales, so it is stable like the radix
+// sort below and both keep the order sprites_doom_order asks for.
 
 static void msort(vissprite_t **s, vissprite_t **t, int n)
 {
@@ -1176,7 +1215,7 @@ static void msort(vissprite_t **s, vissprite_t **t, int n)
       msort(s1, t, n1);
       msort(s2, t, n2);
 
-      while ((*s1)->scale > (*s2)->scale ?
+      while ((*s1)->scale >= (*s2)->scale ?
              (*d++ = *s1++, --n1) : (*d++ = *s2++, --n2));
 
       if (n2)
@@ -1202,6 +1241,60 @@ static void msort(vissprite_t **s, vissprite_t **t, int n)
     }
 }
 
+// LSD radix sort by descending scale, 8 bits per pass. Stable, so
+// sprites of equal scale keep the order they were put in. Passes on a
+// byte that is the same for every key (usually the top one) are skipped.
+
+#define RADIX_SORT_MIN 512 // below this msort is faster
+
+static void R_RadixSortVisSprites(vissprite_t **s, vissprite_t **t, int n)
+{
+  static int counts[4][256];
+  int pass, i;
+
+  memset(counts, 0, sizeof(counts));
+  for (i = 0; i < n; i++)
+  {
+    // flip the sign bit for signed order, invert for descending
+    unsigned int key = ~((unsigned int)s[i]->scale ^ 0x80000000u);
+
+    counts[0][key & 0xff]++;
+    counts[1][(key >> 8) & 0xff]++;
+    counts[2][(key >> 16) & 0xff]++;
+    counts[3][key >> 24]++;
+  }
+
+  for (pass = 0; pass < 4; pass++)
+  {
+    int *count = counts[pass];
+    int shift = pass * 8;
+    int sum = 0;
+    vissprite_t **swap;
+
+    if (count[(~((unsigned int)s[0]->scale ^ 0x80000000u) >> shift) & 0xff] == n)
+      continue;
+
+    for (i = 0; i < 256; i++)
+    {
+      int c = count[i];
+      count[i] = sum;
+      sum += c;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+      unsigned int key = ~((unsigned int)s[i]->scale ^ 0x80000000u);
+      t[count[(key >> shift) & 0xff]++] = s[i];
+    }
+
+    swap = s; s = t; t = swap;
+  }
+
+  // an odd number of passes leaves the result in the scratch half
+  if (s != vissprite_ptrs)
+    bcopyp(vissprite_ptrs, s, n);
+}
+
 void R_SortVisSprites (void)
 {
   if (num_vissprite)
@@ -1232,11 +1325,25 @@ void R_SortVisSprites (void)
 
       // killough 9/22/98: replace qsort with merge sort, since the keys
       // are roughly in order to begin with, due to BSP rendering.
+      // Radix sort for scenes with thousands of sprites.
 
-      msort(vissprite_ptrs, vissprite_ptrs + num_vissprite, num_vissprite);
+      if (num_vissprite < RADIX_SORT_MIN)
+        msort(vissprite_ptrs, vissprite_ptrs + num_vissprite, num_vissprite);
+      else
+        R_RadixSortVisSprites(vissprite_ptrs, vissprite_ptrs + num_vissprite, num_vissprite);
     }
 }
 
+//
+// R_DrawSegBin
+// Column range of the deepest level of the drawseg tree holding x
+//
+
+static int R_DrawSegBin(int x)
+{
+  return (x << (DS_RANGE_LEVELS - 1)) / viewwidth;
+}
+
 //
 // R_DrawSprite
 //
@@ -1249,10 +1356,17 @@ static void R_DrawSprite (vissprite_t* spr)
   int     r2;
   fixed_t scale;
   fixed_t lowscale;
+  int     x1, x2;
 
-  for (x = spr->x1 ; x<=spr->x2 ; x++)
+  // only the columns of this thread's slice of the view
+  x1 = MAX(spr->x1, r_slice_x1);
+  x2 = MIN(spr->x2, r_slice_x2);
+  if (x1 > x2)
+    return;
+
+  for (x = x1 ; x<=x2 ; x++)
     clipbot[x] = -2;
-  for (x = spr->x1 ; x<=spr->x2 ; x++)
+  for (x = x1 ; x<=x2 ; x++)
     cliptop[x] = -2;
 
   // Scan drawsegs from end to start for obscuring segs.
@@ -1263,14 +1377,22 @@ static void R_DrawSprite (vissprite_t* spr)
   // and buggy, by going past LEFT end of array):
 
   // e6y: optimization
-  if (drawsegs_xrange_size)
   {
-    const drawseg_xrange_item_t *last = &drawsegs_xrange[drawsegs_xrange_count - 1];
-    drawseg_xrange_item_t *curr = &drawsegs_xrange[-1];
-    while (++curr <= last)
+    int bin1 = R_DrawSegBin(x1);
+    int bin2 = R_DrawSegBin(x2);
+    int shift = 0;
+    int node, i;
+
+    while ((bin1 >> shift) != (bin2 >> shift))
+      shift++;
+    node = (1 << (DS_RANGE_LEVELS - 1 - shift)) + (bin1 >> shift);
+
+    for (i = drawsegs_xrange_start[node]; i < drawsegs_xrange_start[node + 1]; i++)
     {
+      const drawseg_xrange_item_t *curr = &drawsegs_xrange[i];
+
       // determine if the drawseg obscures the sprite
-      if (curr->x1 > spr->x2 || curr->x2 < spr->x1)
+      if (curr->x1 > x2 || curr->x2 < x1)
         continue;      // does not cover sprite
 
       ds = curr->user;
@@ -1291,15 +1413,15 @@ static void R_DrawSprite (vissprite_t* spr)
       {
         if (ds->maskedtexturecol)       // masked mid texture?
         {
-          r1 = ds->x1 < spr->x1 ? spr->x1 : ds->x1;
-          r2 = ds->x2 > spr->x2 ? spr->x2 : ds->x2;
+          r1 = ds->x1 < x1 ? x1 : ds->x1;
+          r2 = ds->x2 > x2 ? x2 : ds->x2;
           R_RenderMaskedSegRange(ds, r1, r2);
         }
         continue;               // seg is behind sprite
       }
 
-      r1 = ds->x1 < spr->x1 ? spr->x1 : ds->x1;
-      r2 = ds->x2 > spr->x2 ? spr->x2 : ds->x2;
+      r1 = ds->x1 < x1 ? x1 : ds->x1;
+      r2 = ds->x2 > x2 ? x2 : ds->x2;
 
       // clip this piece of the sprite
       // killough 3/27/98: optimized and made much shorter
@@ -1331,13 +1453,13 @@ static void R_DrawSprite (vissprite_t* spr)
           (h >>= FRACBITS) < viewheight) {
         if (mh <= 0 || (phs != -1 && viewz > sectors[phs].floorheight))
           {                          // clip bottom
-            for (x=spr->x1 ; x<=spr->x2 ; x++)
+            for (x=x1 ; x<=x2 ; x++)
               if (clipbot[x] == -2 || h < clipbot[x])
                 clipbot[x] = h;
           }
         else                        // clip top
     if (phs != -1 && viewz <= sectors[phs].floorheight) // killough 11/98
-      for (x=spr->x1 ; x<=spr->x2 ; x++)
+      for (x=x1 ; x<=x2 ; x++)
         if (cliptop[x] == -2 || h > cliptop[x])
     cliptop[x] = h;
       }
@@ -1347,12 +1469,12 @@ static void R_DrawSprite (vissprite_t* spr)
           (h >>= FRACBITS) < viewheight) {
         if (phs != -1 && viewz >= sectors[phs].ceilingheight)
           {                         // clip bottom
-            for (x=spr->x1 ; x<=spr->x2 ; x++)
+            for (x=x1 ; x<=x2 ; x++)
               if (clipbot[x] == -2 || h < clipbot[x])
                 clipbot[x] = h;
           }
         else                       // clip top
-          for (x=spr->x1 ; x<=spr->x2 ; x++)
+          for (x=x1 ; x<=x2 ; x++)
             if (cliptop[x] == -2 || h > cliptop[x])
               cliptop[x] = h;
       }
@@ -1362,11 +1484,11 @@ static void R_DrawSprite (vissprite_t* spr)
   // all clipping has been performed, so draw the sprite
   // check for unclipped columns
 
-  for (x = spr->x1 ; x<=spr->x2 ; x++)
+  for (x = x1 ; x<=x2 ; x++)
     if (clipbot[x] == -2)
       clipbot[x] = viewheight;
 
-  for (x = spr->x1 ; x<=spr->x2 ; x++)
+  for (x = x1 ; x<=x2 ; x++)
     if (cliptop[x] == -2)
       cliptop[x] = -1;
 
@@ -1376,14 +1498,17 @@ static void R_DrawSprite (vissprite_t* spr)
 }
 
 //
-// R_DrawMasked
+// R_SetupMasked
+// Everything before the drawing of sprites and masked textures that is
+// done once per frame, not per slice of the view
 //
 
-void R_DrawMasked(void)
+void R_SetupMasked(void)
 {
-  int i;
+  int i, level, node;
   drawseg_t *ds;
-  int cx = SCREENWIDTH / 2;
+  unsigned int total;
+  int fill[DS_RANGE_NODES];
 
   R_SortVisSprites();
 
@@ -1391,73 +1516,98 @@ void R_DrawMasked(void)
   // Reducing of cache misses in the following R_DrawSprite()
   // Makes sense for scenes with huge amount of drawsegs.
   // ~12% of speed improvement on epic.wad map05
-  for(i = 0; i < DS_RANGES_COUNT; i++)
-    drawsegs_xranges[i].count = 0;
+  // ~13% of speed improvement on sunder.wad map10 (split in halves)
+  memset(fill, 0, sizeof(fill));
+  total = 0;
 
   if (num_vissprite > 0)
   {
-    if (drawsegs_xrange_size < maxdrawsegs)
+    // count the items of each node...
+    for (ds = ds_p; ds-- > drawsegs;)
     {
-      drawsegs_xrange_size = 2 * maxdrawsegs;
-      for(i = 0; i < DS_RANGES_COUNT; i++)
+      if (ds->silhouette || ds->maskedtexturecol)
       {
-        drawsegs_xranges[i].items = realloc(
-          drawsegs_xranges[i].items,
-          drawsegs_xrange_size * sizeof(drawsegs_xranges[i].items[0]));
+        int bin1 = R_DrawSegBin(ds->x1);
+        int bin2 = R_DrawSegBin(ds->x2);
+
+        for (level = 0; level < DS_RANGE_LEVELS; level++)
+        {
+          int shift = DS_RANGE_LEVELS - 1 - level;
+
+          for (node = bin1 >> shift; node <= bin2 >> shift; node++)
+            fill[(1 << level) + node]++;
+          total += (bin2 >> shift) - (bin1 >> shift) + 1;
+        }
       }
     }
+
+    if (drawsegs_xrange_size < total)
+    {
+      drawsegs_xrange_size = 2 * total;
+      drawsegs_xrange = realloc(drawsegs_xrange,
+        drawsegs_xrange_size * sizeof(drawsegs_xrange[0]));
+    }
+  }
+
+  // ...lay the nodes out one after the other...
+  drawsegs_xrange_start[0] = 0;
+  for (i = 0; i < DS_RANGE_NODES; i++)
+  {
+    drawsegs_xrange_start[i + 1] = drawsegs_xrange_start[i] + fill[i];
+    fill[i] = drawsegs_xrange_start[i];
+  }
+
+  // ...and fill them in drawing order
+  if (total)
+  {
     for (ds = ds_p; ds-- > drawsegs;)
     {
       if (ds->silhouette || ds->maskedtexturecol)
       {
-        drawsegs_xranges[0].items[drawsegs_xranges[0].count].x1 = ds->x1;
-        drawsegs_xranges[0].items[drawsegs_xranges[0].count].x2 = ds->x2;
-        drawsegs_xranges[0].items[drawsegs_xranges[0].count].user = ds;
-        
-        // e6y: ~13% of speed improvement on sunder.wad map10
-        if (ds->x1 < cx)
-        {
-          drawsegs_xranges[1].items[drawsegs_xranges[1].count] = 
-            drawsegs_xranges[0].items[drawsegs_xranges[0].count];
-          drawsegs_xranges[1].count++;
-        }
-        if (ds->x2 >= cx)
+        int bin1 = R_DrawSegBin(ds->x1);
+        int bin2 = R_DrawSegBin(ds->x2);
+
+        for (level = 0; level < DS_RANGE_LEVELS; level++)
         {
-          drawsegs_xranges[2].items[drawsegs_xranges[2].count] = 
-            drawsegs_xranges[0].items[drawsegs_xranges[0].count];
-          drawsegs_xranges[2].count++;
-        }
+          int shift = DS_RANGE_LEVELS - 1 - level;
+
+          for (node = bin1 >> shift; node <= bin2 >> shift; node++)
+          {
+            drawseg_xrange_item_t *item = &drawsegs_xrange[fill[(1 << level) + node]++];
 
-        drawsegs_xranges[0].count++;
+            item->x1 = ds->x1;
+            item->x2 = ds->x2;
+            item->user = ds;
+          }
+        }
       }
     }
   }
 
-  // draw all vissprites back to front
-
   rendered_vissprites = num_vissprite;
-  for (i = num_vissprite ;--i>=0; )
-  {
-    vissprite_t* spr = vissprite_ptrs[i];
 
-    if (spr->x2 < cx)
-    {
-      drawsegs_xrange = drawsegs_xranges[1].items;
-      drawsegs_xrange_count = drawsegs_xranges[1].count;
-    }
-    else if (spr->x1 >= cx)
-    {
-      drawsegs_xrange = drawsegs_xranges[2].items;
-      drawsegs_xrange_count = drawsegs_xranges[2].count;
-    }
-    else
-    {
-      drawsegs_xrange = drawsegs_xranges[0].items;
-      drawsegs_xrange_count = drawsegs_xranges[0].count;
-    }
+  // the psprites are drawn on top of everything
+  //  but not on side views
+  num_psprite_vis = 0;
+  if (!viewangleoffset && !viewpitchoffset)
+    R_ProjectPlayerSprites();
+}
+
+//
+// R_DrawMaskedSlice
+// Draws the sprites, masked textures and psprites in the columns
+// r_slice_x1..r_slice_x2
+//
+
+void R_DrawMaskedSlice(void)
+{
+  int i;
+  drawseg_t *ds;
 
+  // draw all vissprites back to front
+
+  for (i = num_vissprite ;--i>=0; )
     R_DrawSprite(vissprite_ptrs[i]);
-  }
 
   // render any remaining masked mid textures
 
@@ -1471,8 +1621,27 @@ void R_DrawMasked(void)
     if (ds->maskedtexturecol)
       R_RenderMaskedSegRange(ds, ds->x1, ds->x2);
 
-  // draw the psprites on top of everything
-  //  but does not draw on side views
-  if (!viewangleoffset && !viewpitchoffset)
-    R_DrawPlayerSprites ();
+  R_DrawProjectedPlayerSprites();
+}
+
+//
+// R_MaskedHasFuzz
+// True if any sprite of this frame is drawn with the spectre fuzz. The fuzz
+// pattern advances with every pixel drawn, so those frames have to draw
+// their masked things on one thread, in order, to come out the same.
+//
+
+dboolean R_MaskedHasFuzz(void)
+{
+  int i;
+
+  for (i = 0; i < num_vissprite; i++)
+    if (!vissprite_ptrs[i]->colormap)
+      return true;
+
+  for (i = 0; i < num_psprite_vis; i++)
+    if (!psprite_vis[i].colormap)
+      return true;
+
+  return false;
 }
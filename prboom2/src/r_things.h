@@ -52,10 +52,10 @@ extern int *screenheightarray; /* change to MAX_*  */ // dropoff overflow
 
 /* Vars for R_DrawMaskedColumn */
 
-extern int     *mfloorclip;    // dropoff overflow
-extern int     *mceilingclip;  // dropoff overflow
-extern fixed_t spryscale;
-extern int_64_t sprtopscreen;
+extern THREADLOCAL int     *mfloorclip;    // dropoff overflow
+extern THREADLOCAL int     *mceilingclip;  // dropoff overflow
+extern THREADLOCAL fixed_t spryscale;
+extern THREADLOCAL int_64_t sprtopscreen;
 extern fixed_t pspriteiscale;
 /* proff 11/06/98: Added for high-res */
 extern fixed_t pspritexscale;
@@ -90,9 +90,12 @@ void R_AddSprites(subsector_t* subsec, int lightlevel);
 void R_AddAllAliveMonstersSprites(void);
 void R_DrawPlayerSprites(void);
 void R_InitSpritesRes(void);
+void R_InitSpritesThreadRes(void);
 void R_InitSprites(const char * const * namelist);
 void R_ClearSprites(void);
-void R_DrawMasked(void);
+void R_SetupMasked(void);
+void R_DrawMaskedSlice(void);
+dboolean R_MaskedHasFuzz(void);
 
 void R_SetClipPlanes(void);
 
@@ -0,0 +1,208 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Drawing the software view in vertical slices on several threads.
+ *
+ *      The BSP walk, and with it the walls, stays on the main thread.
+ *      Afterwards the visplanes, sprites, masked textures and player
+ *      sprites are drawn per slice of columns, one slice per thread. The
+ *      drawing state that is written during that phase (clip pointers,
+ *      span starts, the column buffer) is THREADLOCAL, and everything each
+ *      slice computes for a column is independent of where the slice
+ *      begins, so the image is the same as with a single thread. Frames
+ *      with spectre fuzz draw their masked things on the main thread,
+ *      because the fuzz pattern runs on from pixel to pixel.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "SDL.h"
+#include "SDL_thread.h"
+
+#include "doomdef.h"
+#include "r_main.h"
+#include "r_draw.h"
+#include "r_plane.h"
+#include "r_things.h"
+#include "r_threads.h"
+#include "i_system.h"
+#include "lprintf.h"
+
+int render_threads = 1;
+
+THREADLOCAL int r_slice_x1 = 0;
+THREADLOCAL int r_slice_x2 = INT_MAX;
+
+// narrower slices are not worth the synchronization
+#define MIN_SLICE_WIDTH 64
+
+typedef struct
+{
+  SDL_Thread *thread;
+  SDL_sem *start;
+  SDL_sem *done;
+  int x1, x2;
+} render_worker_t;
+
+// workers[0] is unused, the main thread draws the first slice itself
+static render_worker_t workers[MAX_RENDER_THREADS];
+static void (*slice_func)(void);
+static SDL_mutex *cache_lock;
+static dboolean slices_active;
+static dboolean workers_quit;
+
+void R_LockRenderCache(void)
+{
+  if (slices_active)
+    SDL_LockMutex(cache_lock);
+}
+
+void R_UnlockRenderCache(void)
+{
+  if (slices_active)
+    SDL_UnlockMutex(cache_lock);
+}
+
+static int R_RenderWorker(void *arg)
+{
+  render_worker_t *worker = arg;
+  int width = 0, height = 0;
+
+  for (;;)
+  {
+    SDL_SemWait(worker->start);
+
+    if (workers_quit)
+      break;
+
+    // the per thread buffers follow the resolution
+    if (width != SCREENWIDTH || height != SCREENHEIGHT)
+    {
+      R_LockRenderCache();
+      R_InitPlanesThreadRes();
+      R_InitSpritesThreadRes();
+      R_InitBuffersThreadRes();
+      R_UnlockRenderCache();
+
+      width = SCREENWIDTH;
+      height = SCREENHEIGHT;
+    }
+
+    r_slice_x1 = worker->x1;
+    r_slice_x2 = worker->x2;
+    slice_func();
+
+    SDL_SemPost(worker->done);
+  }
+
+  return 0;
+}
+
+//
+// R_StopRenderWorkers
+// Wakes the idle workers with nothing to do but return, and joins them
+//
+static void R_StopRenderWorkers(void)
+{
+  int i;
+
+  workers_quit = true;
+
+  for (i = 1; i < MAX_RENDER_THREADS; i++)
+  {
+    if (workers[i].thread)
+    {
+      SDL_SemPost(workers[i].start);
+      SDL_WaitThread(workers[i].thread, NULL);
+      workers[i].thread = NULL;
+    }
+  }
+}
+
+//
+// R_RunRenderSlices
+// Calls func once for every slice of the view, in parallel if
+// render_threads allows it. Returns when all slices are done. func must
+// leave the column buffer flushed (R_ResetColumnBuffer).
+//
+void R_RunRenderSlices(void (*func)(void))
+{
+  int i, count;
+
+  count = BETWEEN(1, MAX_RENDER_THREADS, render_threads);
+  count = MIN(count, viewwidth / MIN_SLICE_WIDTH);
+
+  if (count <= 1)
+  {
+    func();
+    return;
+  }
+
+  if (!cache_lock)
+  {
+    cache_lock = SDL_CreateMutex();
+    I_AtExit(R_StopRenderWorkers, false);
+  }
+
+  slice_func = func;
+  slices_active = true;
+
+  for (i = 1; i < count; i++)
+  {
+    render_worker_t *worker = &workers[i];
+
+    if (!worker->thread)
+    {
+      worker->start = SDL_CreateSemaphore(0);
+      worker->done = SDL_CreateSemaphore(0);
+      worker->thread = SDL_CreateThread(R_RenderWorker, "render_worker", worker);
+      if (!worker->thread)
+        I_Error("R_RunRenderSlices: unable to create thread: %s", SDL_GetError());
+    }
+
+    worker->x1 = viewwidth * i / count;
+    worker->x2 = viewwidth * (i + 1) / count - 1;
+    SDL_SemPost(worker->start);
+  }
+
+  r_slice_x1 = 0;
+  r_slice_x2 = viewwidth / count - 1;
+  func();
+
+  for (i = 1; i < count; i++)
+    SDL_SemWait(workers[i].done);
+
+  slices_active = false;
+  r_slice_x1 = 0;
+  r_slice_x2 = INT_MAX;
+}
@@ -0,0 +1,53 @@
+/* Emacs style mode select   -*- C++ -*-
+ *-----------------------------------------------------------------------------
+ *
+ *
+ *  PrBoom: a Doom port merged with LxDoom and LSDLDoom
+ *  based on BOOM, a modified and improved DOOM engine
+ *  Copyright (C) 1999 by
+ *  id Software, Chi Hoang, Lee Killough, Jim Flynn, Rand Phares, Ty Halderman
+ *  Copyright (C) 1999-2000 by
+ *  Jess Haas, Nicolas Kalkhof, Colin Phipps, Florian Schulze
+ *  Copyright 2005, 2006 by
+ *  Florian Schulze, Colin Phipps, Neil Stevens, Andrey Budko
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ *  02111-1307, USA.
+ *
+ * DESCRIPTION:
+ *      Drawing the software view in vertical slices on several threads.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef __R_THREADS__
+#define __R_THREADS__
+
+#include "doomtype.h"
+
+#define MAX_RENDER_THREADS 16
+
+extern int render_threads; // config: threads drawing the view, 1 = off
+
+// columns of the view drawn by the current thread, inclusive
+extern THREADLOCAL int r_slice_x1, r_slice_x2;
+
+void R_RunRenderSlices(void (*func)(void));
+
+// serialize the patch, texture and lump caches while slices are drawn
+void R_LockRenderCache(void);
+void R_UnlockRenderCache(void);
+
+#endif
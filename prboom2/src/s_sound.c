@@ -49,6 +49,7 @@
 #include "lprintf.h"
 #include "sc_man.h"
 #include "e6y.h"
+#include "m_profile.h"
 
 // when to clip out sounds
 // Does not fit the large outdoor areas.
@@ -441,6 +442,7 @@ void S_UpdateSounds(void* listener_p)
   if (!snd_card || nosfxparm)
     return;
 
+  PROFILE_BEGIN(prof_sound);
 #ifdef UPDATE_MUSIC
   I_UpdateMusic();
 #endif
@@ -486,6 +488,7 @@ void S_UpdateSounds(void* listener_p)
             S_StopChannel(cnum);
         }
     }
+  PROFILE_END(prof_sound);
 }
 
 
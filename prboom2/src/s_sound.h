@@ -38,7 +38,7 @@
 #pragma interface
 #endif
 
-#define MAX_CHANNELS 32
+#define MAX_CHANNELS 256
 
 //
 // Initializes sound stuff, including volume
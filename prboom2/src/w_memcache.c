@@ -152,3 +152,27 @@ void W_UnlockLumpNum(int lump)
     Z_ChangeTag(cachelump[lump].cache, PU_CACHE);
 }
 
+
+/*
+ * W_PrefetchLumpNum
+ *
+ * Without a memory mapping, prefetching means reading the lump into the
+ * zone as a purgeable block.
+ */
+
+void W_PrefetchLumpNum(int lump)
+{
+  W_CacheLumpNum(lump);
+  W_UnlockLumpNum(lump);
+}
+
+size_t W_HeapLumpBytes(void)
+{
+  size_t bytes = 0;
+  int i;
+
+  for (i=0; i<numlumps; i++)
+    if (cachelump[i].cache)
+      bytes += W_LumpLength(i);
+  return bytes;
+}
@@ -57,8 +57,9 @@
 
 #include "e6y.h"//e6y
 
+// Lumps are never copied out of the mapping, so only the lock counts
+// are kept, for W_ReportLocks.
 static struct {
-  void *cache;
 #ifdef TIMEDIAG
   int locktic;
 #endif
@@ -67,13 +68,6 @@ static struct {
 
 #ifdef HEAPDUMP
 void W_PrintLump(FILE* fp, void* p) {
-  int i;
-  for (i=0; i<numlumps; i++)
-    if (cachelump[i].cache == p) {
-      fprintf(fp, " %8.8s %6u %2d %6d", lumpinfo[i].name,
-        W_LumpLength(i), cachelump[i].locks, gametic - cachelump[i].locktic);
-      return;
-    }
   fprintf(fp, " not found");
 }
 #endif
@@ -302,49 +296,66 @@ const void* W_CacheLumpNum(int lump)
 }
 #endif
 
+/*
+ * W_PrefetchLumpNum
+ *
+ * Asks the OS to start reading in the pages of a lump the level is going to
+ * need, so that the first access from the renderer or playsim does not stall
+ * on disk I/O. Does not block.
+ */
+void W_PrefetchLumpNum(int lump)
+{
+#ifndef _WIN32
+  const byte *data = W_CacheLumpNum(lump);
+  size_t pagesize = sysconf(_SC_PAGESIZE);
+  size_t start, end;
+
+  if (!data || !lumpinfo[lump].size)
+    return;
+
+  start = (size_t)data & ~(pagesize - 1);
+  end = (size_t)data + lumpinfo[lump].size;
+  madvise((void *)start, end - start, MADV_WILLNEED);
+#endif
+}
+
 /*
  * W_LockLumpNum
  *
- * This copies the lump into a malloced memory region and returns its address
- * instead of returning a pointer into the memory mapped area
+ * Returns a pointer into the memory mapped area, like W_CacheLumpNum, but
+ * faults in all of the lump's pages first. This is used for data that is
+ * read from the audio callback, where a page fault would mean a dropout.
+ * The lump is not copied to the heap.
  *
  */
 const void* W_LockLumpNum(int lump)
 {
-  size_t len = W_LumpLength(lump);
-  const void *data = W_CacheLumpNum(lump);
+  const byte *data = W_CacheLumpNum(lump);
+  int len = W_LumpLength(lump);
+  volatile byte sum = 0;
+  int i;
 
-  if (!cachelump[lump].cache) {
-    // read the lump in
-    Z_Malloc(len, PU_CACHE, &cachelump[lump].cache);
-    memcpy(cachelump[lump].cache, data, len);
-  }
+  for (i = 0; data && i < len; i += 4096)
+    sum += data[i];
 
-  /* cph - if wasn't locked but now is, tell z_zone to hold it */
   if (cachelump[lump].locks <= 0) {
-    Z_ChangeTag(cachelump[lump].cache,PU_STATIC);
 #ifdef TIMEDIAG
     cachelump[lump].locktic = gametic;
 #endif
-    // reset lock counter
     cachelump[lump].locks = 1;
   } else {
-    // increment lock counter
     cachelump[lump].locks += 1;
   }
 
-  return cachelump[lump].cache;
+  return data;
 }
 
 void W_UnlockLumpNum(int lump) {
-  if (cachelump[lump].locks == -1)
-    return; // this lump is memory mapped
-
-  cachelump[lump].locks -= 1;
-  /* cph - Note: must only tell z_zone to make purgeable if currently locked,
-   * else it might already have been purged
-   */
-  if (cachelump[lump].locks == 0)
-    Z_ChangeTag(cachelump[lump].cache, PU_CACHE);
+  if (cachelump[lump].locks > 0)
+    cachelump[lump].locks -= 1;
 }
 
+size_t W_HeapLumpBytes(void)
+{
+  return 0;
+}
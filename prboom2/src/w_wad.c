@@ -62,6 +62,7 @@
 #include "e6y.h"
 
 #include "m_io.h"
+#include "m_argv.h"
 
 //
 // GLOBALS
@@ -540,6 +541,8 @@ void W_Init(void)
   W_InitCache();
 
   V_FreePlaypal();
+
+  W_ReportStats("W_Init");
 }
 
 void W_ReleaseAllWads(void)
@@ -602,3 +605,24 @@ void W_ReadLump(int lump, void *dest)
     }
 }
 
+//
+// W_ReportStats
+// With -wadstats, prints time since startup, resident memory and how much
+// lump data has been copied to the heap. Comparing a memory mapped build
+// against one configured with -DHAVE_MMAP=OFF shows what the mapping saves.
+//
+
+void W_ReportStats(const char *when)
+{
+  static int wadstats = -1;
+
+  if (wadstats == -1)
+    wadstats = M_CheckParm("-wadstats");
+  if (!wadstats)
+    return;
+
+  lprintf(LO_INFO, "W_ReportStats (%s): %u ms since startup, resident %lu KB, "
+    "lump data in heap %lu KB\n", when, I_GetUptimeMS(), (unsigned long)I_GetResidentMemory(),
+    (unsigned long)(W_HeapLumpBytes() / 1024));
+}
+
@@ -155,6 +155,9 @@ void    W_ReadLump (int lump, void *dest);
 const void* W_CacheLumpNum (int lump);
 const void* W_LockLumpNum(int lump);
 void    W_UnlockLumpNum(int lump);
+void    W_PrefetchLumpNum(int lump);
+size_t  W_HeapLumpBytes(void);
+void    W_ReportStats(const char *when);
 
 // CPhipps - convenience macros
 //#define W_CacheLumpNum(num) (W_CacheLumpNum)((num),1)